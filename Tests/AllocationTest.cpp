@@ -0,0 +1,90 @@
+/*
+ * Checks that assembling a longer source does not take more heap allocations per line.
+ */
+#include "stdafx.h"
+#include "Assembler.h"
+#include "Metrics.h"
+#include <cstdint>
+#include <streambuf>
+
+// Takes the symbol table and the listing, so that they are formatted and written as by the CLI.
+class NullBuffer : public std::streambuf {
+
+protected:
+    int_type overflow(int_type a_c) override { return traits_type::not_eof(a_c); }
+    std::streamsize xsputn(const char*, std::streamsize a_count) override { return a_count; }
+};
+
+// The number of lines of the short and the long source.
+static constexpr size_t ShortLineCount = 1000;
+static constexpr size_t LongLineCount = 5000;
+
+/// <summary>
+/// Builds a source of labelled machine instructions, with a label expression on every other
+/// one, followed by the labelled constants they use.
+/// </summary>
+/// <param name="a_lineCount">The number of instructions and constants</param>
+/// <returns>The text of the source</returns>
+static std::string MakeSource(size_t a_lineCount)
+{
+    std::string source = "        ORG     100\n";
+    const size_t pairCount = a_lineCount / 2;
+    for (size_t i = 0; i < pairCount; ++i) {
+        source += std::format("A{:<9}{:<8}B{}{}\n", i, i % 3 == 0 ? "LOAD" : "ADD", i, i % 2 == 0 ? "+0" : "");
+    }
+    source += "        HALT\n";
+    for (size_t i = 0; i < pairCount; ++i) {
+        source += std::format("B{:<9}DC      {}\n", i, i);
+    }
+    source += "        END\n";
+    return source;
+}
+
+/// <summary>
+/// Assembles a source and counts the heap allocations it took.
+/// </summary>
+/// <param name="a_assem">The assembler, which keeps its buffers from one source to the next</param>
+/// <param name="a_source">The source</param>
+/// <returns>The number of allocations</returns>
+static std::uint64_t CountAllocations(Assembler& a_assem, const std::string& a_source)
+{
+    Metrics::Reset();
+    const Assembler::Result result = a_assem.Assemble(a_source);
+    const std::uint64_t count = Metrics::GetCount(Metrics::Counter::HEAP_ALLOCATIONS);
+    if (!result.Succeeded()) {
+        std::cerr << "The test source has errors\n";
+        std::exit(1);
+    }
+    return count;
+}
+
+int main()
+{
+#if VC370_COUNT_ALLOCATIONS
+    NullBuffer discard;
+    std::ostream out(&discard);
+    Assembler assem;
+    assem.SetOutput(out, false);
+    Metrics::Enable(true);
+
+    const std::string shortSource = MakeSource(ShortLineCount);
+    const std::string longSource = MakeSource(LongLineCount);
+
+    // The first assembly sizes the tables; the others are the steady state
+    static_cast<void>(CountAllocations(assem, shortSource));
+    const std::uint64_t shortCount = CountAllocations(assem, shortSource);
+    const std::uint64_t longCount = CountAllocations(assem, longSource);
+
+    // The buffers that grow with the source double, so they only add a few allocations
+    const std::uint64_t allowance = (LongLineCount - ShortLineCount) / 100;
+    std::cout << std::format("{} lines: {} allocations, {} lines: {} allocations\n", ShortLineCount, shortCount, LongLineCount, longCount);
+    if (longCount > shortCount + allowance) {
+        std::cout << std::format("FAILED: {} more allocations for {} more lines\n", longCount - shortCount, LongLineCount - ShortLineCount);
+        return 1;
+    }
+    std::cout << "PASSED\n";
+#else
+    std::cout << "SKIPPED: built without VC370_COUNT_ALLOCATIONS\n";
+#endif
+    return 0;
+}
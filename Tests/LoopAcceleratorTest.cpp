@@ -0,0 +1,242 @@
+/*
+ * Checks that the loops run ahead by the LoopAccelerator give the same run as the interpreter.
+ */
+#include "stdafx.h"
+#include "Assembler.h"
+
+// A program with counting loops, and what it READs.
+struct Sample {
+    std::string_view m_name;
+    std::string_view m_source;
+    bool m_extendedFl;
+    std::vector<std::string> m_input;
+};
+
+static const Sample Samples[] = {
+    { "countdown", R"(
+        ORG     100
+LOOP    LOAD    N
+        SUB     ONE
+        STORE   N
+        BP      LOOP
+        WRITE   N
+        HALT
+N       DC      5000
+ONE     DC      1
+        END
+)", false, {} },
+
+    // A total that grows by a step while a counter read at the start goes down
+    { "total", R"(
+        ORG     100
+        READ    N
+LOOP    LOAD    T
+        ADD     STEP
+        STORE   T
+        LOAD    N
+        SUB     ONE
+        STORE   N
+        BP      LOOP
+        WRITE   T
+        WRITE   N
+        HALT
+T       DC      0
+STEP    DC      7
+N       DS      1
+ONE     DC      1
+        END
+)", false, { "300" } },
+
+    // The total wraps around the word size every third iteration and the loop goes on
+    { "wrap", R"(
+        ORG     100
+LOOP    LOAD    T
+        ADD     BIG
+        STORE   T
+        LOAD    N
+        SUB     ONE
+        STORE   N
+        BP      LOOP
+        WRITE   T
+        HALT
+T       DC      0
+BIG     DC      333333
+N       DC      50
+ONE     DC      1
+        END
+)", false, {} },
+
+    // The loop ends on the iteration that wraps around
+    { "wrap exit", R"(
+        ORG     100
+LOOP    LOAD    X
+        ADD     ONE
+        STORE   X
+        BP      LOOP
+        WRITE   X
+        HALT
+X       DC      990001
+ONE     DC      1
+        END
+)", false, {} },
+
+    // A negative counter that goes up to zero
+    { "negative", R"(
+        ORG     100
+        LOAD    X
+        SUB     START
+        STORE   X
+LOOP    LOAD    X
+        ADD     TWO
+        STORE   X
+        BM      LOOP
+        WRITE   X
+        HALT
+X       DC      0
+START   DC      3001
+TWO     DC      2
+        END
+)", false, {} },
+
+    // Only the accumulator changes
+    { "extended", R"(
+        ORG     100
+        LOADI   9000
+LOOP    SUBI    3
+        BP      LOOP
+        STORE   R
+        WRITE   R
+        HALT
+R       DS      1
+        END
+)", true, {} },
+};
+
+// The programs with at most this many instructions are checked at every instruction limit.
+static constexpr unsigned long long ExhaustiveLimit = 2500;
+
+// What a run did.
+struct Outcome {
+    Emulator::RunStatus m_status;
+    unsigned long long m_instructionCount;
+    std::vector<int> m_output;
+    std::vector<int> m_memory;
+
+    bool operator==(const Outcome&) const = default;
+};
+
+/// <summary>
+/// Runs a copy of a program.
+/// </summary>
+/// <param name="a_program">The program, which is not changed</param>
+/// <param name="a_input">The lines the program READs</param>
+/// <param name="a_limit">The instruction limit; zero for none</param>
+/// <returns>What the run did</returns>
+static Outcome RunCopy(const Emulator& a_program, const std::vector<std::string>& a_input, unsigned long long a_limit)
+{
+    Emulator emul = a_program;
+    emul.SetInstructionLimit(a_limit);
+
+    Outcome outcome;
+    size_t line = 0;
+    outcome.m_status = emul.Run({
+        [&](std::string& a_line) { return line < a_input.size() ? (a_line = a_input[line++], true) : false; },
+        [&](int a_value) { outcome.m_output.push_back(a_value); } });
+    outcome.m_instructionCount = emul.GetInstructionCount();
+    for (int loc = 0; loc < emul.GetConfig().GetMemorySize(); ++loc) {
+        outcome.m_memory.push_back(emul.GetWord(loc));
+    }
+    return outcome;
+}
+
+/// <summary>
+/// The instruction limits a sample is run with: every one for a short program; otherwise
+/// the first few, windows spread over the run and those around its end.
+/// </summary>
+/// <param name="a_count">The instructions of the run without a limit</param>
+/// <returns>The limits</returns>
+static std::vector<unsigned long long> MakeLimits(unsigned long long a_count)
+{
+    std::vector<unsigned long long> limits;
+    if (a_count <= ExhaustiveLimit) {
+        for (unsigned long long limit = 1; limit <= a_count + 1; ++limit) {
+            limits.push_back(limit);
+        }
+        return limits;
+    }
+    for (unsigned long long limit = 1; limit <= 64; ++limit) {
+        limits.push_back(limit);
+    }
+    for (unsigned long long window = 1; window < 16; ++window) {
+        const unsigned long long middle = a_count * window / 16;
+        for (unsigned long long limit = middle - 8; limit <= middle + 8; ++limit) {
+            limits.push_back(limit);
+        }
+    }
+    for (unsigned long long limit = a_count - 64; limit <= a_count + 1; ++limit) {
+        limits.push_back(limit);
+    }
+    return limits;
+}
+
+/// <summary>
+/// Assembles a sample and compares its runs with and without the accelerated loops, both
+/// to the end and stopped at each of a set of instruction limits.
+/// </summary>
+/// <param name="a_sample">The sample</param>
+/// <returns>True if the runs are the same</returns>
+static bool CheckSample(const Sample& a_sample)
+{
+    Assembler assem(MachineConfig(MachineConfig::ClassicOperandDigits, a_sample.m_extendedFl));
+    if (!assem.Assemble(a_sample.m_source).Succeeded()) {
+        std::cout << std::format("FAILED: the {} sample has errors\n", a_sample.m_name);
+        return false;
+    }
+    const Emulator plain = assem.GetEmulator();
+    const LoopAccelerator::Report report = assem.AccelerateLoops();
+    const Emulator accelerated = assem.GetEmulator();
+    if (report.m_loops != 1) {
+        std::cout << std::format("FAILED: {} loops of the {} sample can be run ahead instead of 1\n", report.m_loops, a_sample.m_name);
+        return false;
+    }
+
+    const Outcome expected = RunCopy(plain, a_sample.m_input, 0);
+    if (expected.m_status != Emulator::RunStatus::HALTED) {
+        std::cout << std::format("FAILED: the {} sample does not halt\n", a_sample.m_name);
+        return false;
+    }
+
+    // The accelerated program must also skip iterations, or the test proves nothing
+    Emulator probe = accelerated;
+    static_cast<void>(probe.Run({ [&](std::string& a_line) { return !a_sample.m_input.empty() ? (a_line = a_sample.m_input[0], true) : false; },
+        [](int) {} }));
+    if (probe.GetIterationsAccelerated() == 0) {
+        std::cout << std::format("FAILED: no iteration of the {} sample was run ahead\n", a_sample.m_name);
+        return false;
+    }
+
+    std::vector<unsigned long long> limits = MakeLimits(expected.m_instructionCount);
+    limits.insert(limits.begin(), 0);
+    for (const unsigned long long limit : limits) {
+        const Outcome plainRun = RunCopy(plain, a_sample.m_input, limit);
+        const Outcome acceleratedRun = RunCopy(accelerated, a_sample.m_input, limit);
+        if (plainRun != acceleratedRun) {
+            std::cout << std::format("FAILED: the {} sample with a limit of {} ran {} instructions to status {} "
+                "but {} to status {} with its loops run ahead\n", a_sample.m_name, limit,
+                plainRun.m_instructionCount, static_cast<int>(plainRun.m_status),
+                acceleratedRun.m_instructionCount, static_cast<int>(acceleratedRun.m_status));
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    bool passedFl = true;
+    for (const Sample& sample : Samples) {
+        passedFl = CheckSample(sample) && passedFl;
+    }
+    std::cout << (passedFl ? "PASSED\n" : "");
+    return passedFl ? 0 : 1;
+}
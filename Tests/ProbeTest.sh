@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Checks that every USDT probe of the assembler is in its .note.stapsdt ELF notes:
+#   Tests/ProbeTest.sh <AssemblerBinary>
+#
+binary=$1
+
+case "$(uname -s)-$(uname -m)" in
+    Linux-x86_64 | Linux-aarch64) ;;
+    *) echo "SKIPPED: the probes are only emitted on Linux on x86-64 and AArch64"; exit 0 ;;
+esac
+if ! command -v readelf > /dev/null 2>&1; then
+    echo "SKIPPED: readelf is not installed"
+    exit 0
+fi
+
+notes=$(readelf -n "$binary") || exit 1
+if ! printf '%s\n' "$notes" | grep -Eq '^[[:space:]]*Provider: vc370$'; then
+    echo "FAILED: $binary has no vc370 probes"
+    exit 1
+fi
+
+failed=0
+for probe in pass1__start pass1__done pass2__start pass2__done symbol__add error__record \
+    run__start run__block read write halt run__done machine__park machine__done; do
+    if ! printf '%s\n' "$notes" | grep -Eq "^[[:space:]]*Name: $probe\$"; then
+        echo "FAILED: probe vc370:$probe is missing"
+        failed=1
+    fi
+done
+[ "$failed" -eq 0 ] && echo "PASSED"
+exit $failed
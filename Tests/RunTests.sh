@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+# Builds the assembler and the tests with GCC or Clang and runs the tests:
+#   Tests/RunTests.sh [<BuildDirectory>]
+# Each <Name>Test.cpp is a program linked with the assembler that returns non-zero when it fails.
+# Each <Name>Test.sh is given the path of the assembler binary.  CXX and CXXFLAGS are taken
+# from the environment.
+#
+set -u
+
+tests=$(cd "$(dirname "$0")" && pwd)
+src="$tests/../VC370-AssemblyCompiler"
+build=${1:-"$tests/build"}
+CXX=${CXX:-c++}
+CXXFLAGS=${CXXFLAGS:--O2}
+mkdir -p "$build" || exit 1
+
+# The assembler, without its main program, is linked into each test.  The CLI and the
+# allocation test link the Metrics that counts heap allocations instead of the plain one.
+objects=""
+for file in "$src"/*.cpp; do
+    name=$(basename "$file" .cpp)
+    $CXX -std=c++20 $CXXFLAGS -I"$src" -c "$file" -o "$build/$name.o" || exit 1
+    if [ "$name" != AssemblerTest ] && [ "$name" != Metrics ]; then
+        objects="$objects $build/$name.o"
+    fi
+done
+counting=-DVC370_COUNT_ALLOCATIONS=1
+$CXX -std=c++20 $CXXFLAGS $counting -I"$src" -c "$src/Metrics.cpp" -o "$build/CountingMetrics.o" || exit 1
+$CXX $CXXFLAGS $objects "$build/CountingMetrics.o" "$build/AssemblerTest.o" -o "$build/Assem" -pthread || exit 1
+
+failures=0
+for test in "$tests"/*Test.cpp; do
+    name=$(basename "$test" .cpp)
+    flags="" metrics="$build/Metrics.o"
+    if [ "$name" = AllocationTest ]; then
+        flags=$counting metrics="$build/CountingMetrics.o"
+    fi
+    echo "== $name"
+    if ! $CXX -std=c++20 $CXXFLAGS $flags -I"$src" "$test" $objects "$metrics" -o "$build/$name" -pthread || ! "$build/$name"; then
+        echo "$name FAILED"
+        failures=$((failures + 1))
+    fi
+done
+for test in "$tests"/*Test.sh; do
+    [ -e "$test" ] || continue
+    name=$(basename "$test" .sh)
+    echo "== $name"
+    if ! sh "$test" "$build/Assem"; then
+        echo "$name FAILED"
+        failures=$((failures + 1))
+    fi
+done
+
+echo "$failures test(s) failed"
+[ "$failures" -eq 0 ]
@@ -0,0 +1,77 @@
+/*
+ * Checks that StaticAssembler assembles the same images as the Assembler.
+ */
+#include "stdafx.h"
+#include "StaticAssembler.h"
+#include "Assembler.h"
+
+static constexpr std::string_view ClassicSource = R"(
+        ORG     100
+        LOAD    TAB+1
+        ADD     TAB+LEN(TAB)-1
+        STORE   SUM
+        WRITE   SUM
+        HALT
+TAB     DC      5
+        DC      7
+        DC      TAB+1
+SUM     DS      2*3
+Q       DC      SUM-TAB
+        END
+)";
+
+static constexpr std::string_view ExtendedSource = R"(
+        ORG     100
+        LDXI    2
+        LOADX   TAB
+        MULTI   3
+        DIVI    2
+        HALT
+TAB     DC      4
+        END
+)";
+
+// The images are constants; if StaticAssembler falls out of step with Instruction or
+// Expression, these no longer compile or no longer hold
+static constexpr StaticAssembler::Image ClassicImage = StaticAssembler::Assemble(ClassicSource);
+static constexpr StaticAssembler::Image ExtendedImage = StaticAssembler::Assemble(ExtendedSource, true);
+
+static_assert(ClassicImage[100] == 50106 && ClassicImage[101] == 10105 && ClassicImage[102] == 60108);
+static_assert(ClassicImage[103] == 80108 && ClassicImage[104] == 130000);
+static_assert(ClassicImage[105] == 5 && ClassicImage[106] == 7 && ClassicImage[107] == 106 && ClassicImage[114] == 3);
+static_assert(ExtendedImage[100] == 160002 && ExtendedImage[101] == 180105 && ExtendedImage[102] == 230003);
+static_assert(ExtendedImage[103] == 240002 && ExtendedImage[104] == 130000 && ExtendedImage[105] == 4);
+
+/// <summary>
+/// Assembles a source with the Assembler and compares its image with that of StaticAssembler.
+/// </summary>
+/// <param name="a_name">The name of the source in the report</param>
+/// <param name="a_source">The source</param>
+/// <param name="a_image">The image StaticAssembler made of it</param>
+/// <param name="a_extendedFl">True for the extended instruction set</param>
+/// <returns>True if the images are the same</returns>
+static bool CompareImages(std::string_view a_name, std::string_view a_source, const StaticAssembler::Image& a_image, bool a_extendedFl)
+{
+    Assembler assem(MachineConfig(MachineConfig::ClassicOperandDigits, a_extendedFl));
+    const Assembler::Result result = assem.Assemble(a_source);
+    if (!result.Succeeded()) {
+        std::cout << std::format("FAILED: the Assembler found errors in the {} source\n", a_name);
+        return false;
+    }
+    for (int loc = 0; loc < Emulator::MEMSZ; ++loc) {
+        if (result.m_image->GetWord(loc) != a_image[loc]) {
+            std::cout << std::format("FAILED: {} word {} is {} but the Assembler made {}\n", a_name, loc, a_image[loc], result.m_image->GetWord(loc));
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    const bool classicFl = CompareImages("classic", ClassicSource, ClassicImage, false);
+    const bool extendedFl = CompareImages("extended", ExtendedSource, ExtendedImage, true);
+    const bool passedFl = classicFl && extendedFl;
+    std::cout << (passedFl ? "PASSED\n" : "");
+    return passedFl ? 0 : 1;
+}
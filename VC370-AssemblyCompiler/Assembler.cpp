@@ -1,18 +1,140 @@
 #include "Assembler.h"
 #include "stdafx.h"
 #include "Error.h"
+#include "Metrics.h"
+#include "Probes.h"
+#include <thread>
+#include <functional>
 
 /// <summary>
-/// Constructor for the Assembler class.
+/// Constructor for an assembler that is given its sources by Assemble, e.g. by a program
+/// that embeds it.  The symbol table and the listing go nowhere until SetOutput is called.
 /// </summary>
-/// <param name="argc">The number of arguments passed to the program</param>
-/// <param name="argv">The arguments passed to the program</param>
-Assembler::Assembler(int argc, char* argv[]) 
-	: m_fileAcc(argc, argv)
-	, m_symTab()
-	, m_inst()
-	, m_emul()
-{ 
+/// <param name="a_config">The dimensions of the target machine</param>
+Assembler::Assembler(const MachineConfig& a_config)
+	: m_fileAcc()
+	, m_arena()
+	, m_symTab(&m_arena)
+	, m_inst(a_config.IsExtended())
+	, m_emul(a_config)
+	, m_object(&m_arena)
+	, m_config(a_config)
+{
+	m_out = &m_discard;
+	m_pauseFl = false;
+}
+
+/// <summary>
+/// Constructor for the Assembler class that assembles the given source file.
+/// </summary>
+/// <param name="a_fileName">The name of the source file</param>
+/// <param name="a_config">The dimensions of the target machine</param>
+Assembler::Assembler(const std::string& a_fileName, const MachineConfig& a_config)
+	: m_fileAcc(a_fileName)
+	, m_arena()
+	, m_symTab(&m_arena)
+	, m_inst(a_config.IsExtended())
+	, m_emul(a_config)
+	, m_object(&m_arena)
+	, m_config(a_config)
+{
+}
+
+/// <summary>
+/// Constructor for the Assembler class that assembles a source held in a stream,
+/// e.g. a source that is already in memory.
+/// </summary>
+/// <param name="a_source">The source stream</param>
+/// <param name="a_config">The dimensions of the target machine</param>
+Assembler::Assembler(std::unique_ptr<std::istream> a_source, const MachineConfig& a_config)
+	: m_fileAcc(std::move(a_source))
+	, m_arena()
+	, m_symTab(&m_arena)
+	, m_inst(a_config.IsExtended())
+	, m_emul(a_config)
+	, m_object(&m_arena)
+	, m_config(a_config)
+{
+}
+
+/// <summary>
+/// Assembles a source held in memory.  The assembler starts again from an empty symbol
+/// table and machine, which keep the memory they have, so one assembler can assemble
+/// any number of sources.  The source is not copied; it is only read during the call.
+/// The errors are those of the calling thread, which are cleared first.
+/// </summary>
+/// <param name="a_source">The text of the source</param>
+/// <returns>The translation, the symbols, the listing and the errors</returns>
+Assembler::Result Assembler::Assemble(std::string_view a_source)
+{
+	Error::InitErrorReporting();
+	m_fileAcc.SetSource(a_source);
+	m_symTab.Clear();
+	m_object.Clear();
+	m_emul.Clear();
+	m_lines.clear();
+
+	// The tables are empty, so the arena can start over rather than grow with each assembly
+	m_arena.release();
+
+	Result result;
+	m_result = &result;
+	PassI();
+	DisplaySymbolTable();
+	PassII();
+	m_result = nullptr;
+
+	// The buffer may go away once the call returns
+	m_fileAcc.SetSource({});
+	m_lines.clear();
+
+	result.m_image = std::make_shared<const Emulator>(m_emul);
+	result.m_symbols = m_symTab.GetSymbols();
+	result.m_errors = Error::GetErrors();
+	result.m_errorCount = Error::GetErrorCount();
+	return result;
+}
+
+/// <summary>
+/// Sends the symbol table, the listing and the emulator output to a stream instead of the console.
+/// </summary>
+/// <param name="a_out">The output stream</param>
+/// <param name="a_pauseFl">True to pause after each section, as on the console</param>
+void Assembler::SetOutput(std::ostream& a_out, bool a_pauseFl) noexcept
+{
+	m_out = &a_out;
+	m_pauseFl = a_pauseFl;
+}
+
+/// <summary>
+/// Watches a word of the translation while it runs.  Each write to the word is reported
+/// with the old and new values and the source line of the instruction that wrote it.
+/// </summary>
+/// <param name="a_addr">The address of the word</param>
+/// <returns>False if the word cannot be watched</returns>
+bool Assembler::WatchWord(int a_addr)
+{
+	m_emul.SetWatchHandler([this](const Emulator::WatchHit& a_hit) {
+		*m_out << std::format("Watch: word {} changed from {} to {} at location {}: {}\n",
+			a_hit.m_addr, a_hit.m_oldValue, a_hit.m_newValue, a_hit.m_loc, FindSourceLine(a_hit.m_loc));
+	});
+	return m_emul.AddWatchpoint(a_addr);
+}
+
+/// <summary>
+/// Finds the source line of the word at a location in the lines Pass II kept.  It is only
+/// called when a watchpoint fires, after the source itself may be gone.
+/// </summary>
+/// <param name="a_loc">The location of the word</param>
+/// <returns>The last line that generated a word at the location, or an empty string</returns>
+std::string_view Assembler::FindSourceLine(int a_loc) const
+{
+	// The lines at a location are in source order, so the last one is the word that is there
+	const auto it = std::ranges::upper_bound(m_wordLines, a_loc, {}, &WordLine::m_loc);
+	if (it == m_wordLines.begin() || std::prev(it)->m_loc != a_loc) {
+		return {};
+	}
+	return std::string_view(m_wordText).substr(std::prev(it)->m_offset, std::prev(it)->m_length);
 }
 
 /// <summary>
@@ -20,314 +142,968 @@ Assembler::Assembler(int argc, char* argv[])
 /// stores the labels in the symbol table as well as the location of each label
 /// </summary>
 void Assembler::PassI() {
+	Metrics::ScopedTimer timer(Metrics::Phase::PASS_I);
+	VC370_PROBE1(pass1__start, m_threadCount);
+
+	if (m_threadCount > 1) {
+		ParallelPassI();
+		VC370_PROBE0(pass1__done);
+		return;
+	}
+
 	int loc = 0; // Tracks the location of the instructions
+	std::vector<std::string> entries; // Symbols named by ENTRY directives
+	std::string line; // The current line; its buffer is reused from line to line
 
 	// Loop that reads every line and finds the location of each label
 	while (true) {
-		std::string line; // Read the next line from the source file
 
 		// Check if there are more lines to read
 		// If not, pass I is completed
-		if (!m_fileAcc.GetNextLine(line)) return;
+		if (!m_fileAcc.GetNextLine(line)) break;
 
 		const auto st = m_inst.ParseInstruction(line);
+		Metrics::Count(Metrics::Counter::LINES_PARSED);
 
 		// If the instruction is an END command, then Pass I is completed
 		if (st == Instruction::InstructionType::ST_END)
-			return;
+			break;
 		
 		// If the instruction is a comment or blank, then we can skip it
 		if (st == Instruction::InstructionType::ST_COMMENT_OR_BLANK)
 			continue;
 
+		const LocationEffect effect = PassIEffect(m_inst);
+
 		// If the instruction is a label,
 		// then we can add it to the symbol table
 		if (!m_inst.IsLabelBlank()) {
-			std::string label = m_inst.GetLabel();
-			m_symTab.AddSymbol(label, loc);
-		}
-		
-		// If operand is not numeric or is missing, then there is an error and we can skip it
-		if (!m_inst.IsOperandNumeric() || m_inst.IsOperandBlank())
-		{
-			loc = Instruction::NextInstructionLocation(loc) % 10000;
-			continue;
+			m_symTab.AddSymbol(m_inst.GetLabel(), loc, SymbolLength(effect));
 		}
 
-		// If the instruction is an ORG or DS command, we need to process this in a special way
-		if (m_inst.GetOpCode() == "ORG") {
-			loc = Instruction::NextInstructionLocation(std::stoi(m_inst.GetOperand()) - 1) % 10000;
-		}
-		else if (m_inst.GetOpCode() == "DS") {
-			loc = Instruction::NextInstructionLocation(loc + std::stoi(m_inst.GetOperand()) - 1) % 10000;
-		}
-		// If the instruction is neither, we need to move to the next location in the memory
-		else {
-			loc = Instruction::NextInstructionLocation(loc) % 10000;
+		// ENTRY and EXTRN only declare the linkage of a symbol and take no memory
+		if (m_inst.IsLinkageDirective()) {
+			if (m_inst.GetOpCode() == "EXTRN" && !m_inst.IsOperandBlank()) {
+				m_symTab.AddExternalSymbol(m_inst.GetOperand());
+			}
+			else if (!m_inst.IsOperandBlank()) {
+				entries.push_back(m_inst.GetOperand());
+			}
 		}
+
+		loc = NextPassILocation(effect, loc);
+	}
+
+	// Symbols may be exported before they are defined, so the exports are applied last.
+	// Undefined entries are reported in Pass II.
+	for (const auto& entry : entries) {
+		static_cast<void>(m_symTab.ExportSymbol(entry));
 	}
+	VC370_PROBE0(pass1__done);
 }
 
 /// <summary>
 /// The Pass II function of the assembler that reads the source file
-/// and translates the assembly instructions into machine code
+/// and translates the assembly instructions into machine code.
+/// The listing is formatted and written by the listing writer thread.
 /// </summary>
 void Assembler::PassII() {
+	Metrics::ScopedTimer timer(Metrics::Phase::PASS_II);
+	VC370_PROBE1(pass2__start, m_threadCount);
+
+	m_listing.Start(*m_out, m_config.GetOperandDigits());
+	m_wordLines.clear();
+	m_wordText.clear();
+	if (m_threadCount > 1) {
+		ParallelPassII();
+	}
+	else {
+		SequentialPassII();
+	}
+	m_listing.Finish();
+
+	// FindSourceLine looks the lines up by location
+	std::ranges::sort(m_wordLines, [](const WordLine& a_left, const WordLine& a_right) {
+		return a_left.m_loc != a_right.m_loc ? a_left.m_loc < a_right.m_loc : a_left.m_offset < a_right.m_offset;
+	});
+	VC370_PROBE1(pass2__done, Error::GetErrorCount());
+}
+
+/// <summary>
+/// Pass II line by line.
+/// </summary>
+void Assembler::SequentialPassII()
+{
 	m_fileAcc.Rewind();
 	Error::InitErrorReporting();
+	m_object.Clear();
+	m_object.SetOperandDigits(m_config.GetOperandDigits());
+	m_object.SetExtended(m_config.IsExtended());
 
 	int loc = 0; // Tracks the location of the instructions
-	int currOpCode = 0; // Tracks the current opcode
-	int currOperand = 0; // Tracks the current operand
-	int tempLoc = -1; // Tracks the temporary location in case of ORG or DS commands
-
-	std::vector<std::string> currErrors; // Tracks the current errors
-	
 	bool machineCodeFinishedFl = false; // Tracks if there we have received a HALT command (therefore, the machine code is finished)
+	PassIIOutput out; // The translation of the current line
+
+	m_listing.WriteText("Translation of Program:\n");
+	m_listing.WriteText("Location  Contents       Original Statement\n");
 
-	std::cout << "Translation of Program:\n";
-	std::cout << "Location  Contents       Original Statement\n";
+	std::string line; // The current line; its buffer is reused from line to line
 
 	// Loop that reads every line and finds the location of each label
 	while (true) {
-		std::string line; // Read the next line from the source file
-
 		// Check if there are more lines to read
 		// If not, pass II is completed, but there is no END statement, so we also report it as an error
 		if (!m_fileAcc.GetNextLine(line)) {
-			Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MISSING_END_STATEMENT, loc));
-			std::cout << "Error: Missing END statement\n";
-			std::cout << "____________________________________________\n\n";
-			system("pause");
-			std::cout << '\n';
+			TranslateMissingEnd(loc);
 			return;
 		}
 
 		// Parse the line into an instruction with all its elements
 		const auto st = m_inst.ParseInstruction(line);
-		
-		// Reset the variables
-		currOpCode = 0;
-		currOperand = 0;
-		currErrors.clear();
-		tempLoc = -1;
-
-		// If the instruction cannot be identified, we report it as a syntax error
-		if (st == Instruction::InstructionType::ST_ERROR) {
-			currOpCode = -1;
-			Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_INVALID_OPCODE, loc));
-			currErrors.emplace_back("Error: Invalid opcode");
-		}
+		Metrics::Count(Metrics::Counter::LINES_PARSED);
 
 		// If the instruction is an END command, then Pass II is completed
 		if (st == Instruction::InstructionType::ST_END) {
+			std::string nextLine;
+			TranslateEnd(line, loc, m_fileAcc.GetNextLine(nextLine));
+			return;
+		}
 
-			std::cout << std::format("{:20}     {}\n", "", line);
+		TranslateLine(line, m_inst, st, loc, machineCodeFinishedFl, out);
+		if (!EmitTranslation(out)) {
+			TranslateTooManyErrors();
+			return;
+		}
+	}
+}
 
-			// If there is an operand after the END statement, we record an error
-			if (!m_inst.IsOperandBlank()) {
-				currOperand = -1;
-				m_emul.InsertMemory(loc, currOpCode, currOperand);
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_EXTRA_ELEMENTS, loc));
-				currErrors.emplace_back("Error: Extra elements on line");
-			}
+/// <summary>
+/// Determines how a line moves the location counter in Pass I.
+/// Lines that are not ORG or DS with a numeric operand take one word.
+/// </summary>
+/// <param name="a_inst">The parsed instruction</param>
+/// <returns>The location effect of the instruction</returns>
+Assembler::LocationEffect Assembler::PassIEffect(const Instruction& a_inst) const
+{
+	// ENTRY and EXTRN take no memory
+	if (a_inst.IsLinkageDirective()) {
+		return { LocationEffect::Kind::KEEP, 0 };
+	}
 
-			// If there are more lines after the END statement, we record an error
-			if (m_fileAcc.GetNextLine(line)) {
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_END_STATEMENT_NOT_LAST, loc));
-				currErrors.emplace_back("Error: END statement not last");
-			}
+	// ORG and DS take a number or an expression of numbers.  If the operand is not one,
+	// is missing or is too big, then there is an error and we take one word
+	const long long operandValue = Expression::EvaluateConstant(a_inst.GetOperand());
+	if (operandValue < 0) {
+		return { LocationEffect::Kind::ADVANCE, 1 };
+	}
 
-			// We output the errors if there are any
-			for (const auto& error : currErrors) {
-				std::cout << error << '\n';
-			}
+	// If the instruction is an ORG or DS command, we need to process this in a special way
+	if (a_inst.GetOpCode() == "ORG") {
+		return { LocationEffect::Kind::SET, static_cast<int>(operandValue % m_config.GetMemorySize()) };
+	}
+	if (a_inst.GetOpCode() == "DS") {
+		return { LocationEffect::Kind::ADVANCE, static_cast<int>(operandValue % m_config.GetMemorySize()) };
+	}
 
-			std::cout << "____________________________________________\n\n";
-			system("pause");
-			std::cout << '\n';
-			return;
-		}
+	// If the instruction is neither, we need to move to the next location in the memory
+	return { LocationEffect::Kind::ADVANCE, 1 };
+}
 
-		// If the instruction is a comment or blank, then we can skip it
-		if (st == Instruction::InstructionType::ST_COMMENT_OR_BLANK) {
-			std::cout << std::format("{:20}     {}\n", "", line);
-			continue;
-		}
+/// <summary>
+/// The length of the statement a label is on, for LEN in operand expressions: the words
+/// a DS reserves, none for ORG, ENTRY and EXTRN, and one for the other statements.
+/// </summary>
+/// <param name="a_effect">The Pass I location effect of the statement</param>
+/// <returns>The number of words</returns>
+int Assembler::SymbolLength(LocationEffect a_effect) noexcept
+{
+	return a_effect.m_kind == LocationEffect::Kind::ADVANCE ? a_effect.m_value : 0;
+}
 
-		// If the instruction has a label, then we need to check if it is a duplicate label
-		if (!m_inst.IsLabelBlank()) {
-			// If the label is a duplicate, we can record an error
-			if (!m_symTab.LookupSymbol(m_inst.GetLabel())) {
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_DUPLICATE_LABEL, loc));
-				currErrors.emplace_back("Error: Duplicate label");
-			}
+/// <summary>
+/// Applies a Pass I location effect. Pass I wraps around the memory silently.
+/// </summary>
+/// <param name="a_effect">The location effect of the line</param>
+/// <param name="a_loc">The location of the line</param>
+/// <returns>The location of the next line</returns>
+int Assembler::NextPassILocation(LocationEffect a_effect, int a_loc) const noexcept
+{
+	switch (a_effect.m_kind) {
+		case LocationEffect::Kind::SET:
+			return a_effect.m_value;
+		case LocationEffect::Kind::ADVANCE:
+		case LocationEffect::Kind::RESERVE:
+			return (a_loc + a_effect.m_value) % m_config.GetMemorySize();
+		default:
+			return a_loc;
+	}
+}
+
+/// <summary>
+/// Determines how a line (other than END) moves the location counter in Pass II.
+/// </summary>
+/// <param name="a_st">The type of the instruction</param>
+/// <param name="a_inst">The parsed instruction</param>
+/// <returns>The location effect of the instruction</returns>
+Assembler::LocationEffect Assembler::PassIIEffect(Instruction::InstructionType a_st, const Instruction& a_inst) const
+{
+	// Comments, ENTRY and EXTRN take no memory
+	if (a_st == Instruction::InstructionType::ST_COMMENT_OR_BLANK || a_inst.IsLinkageDirective()) {
+		return { LocationEffect::Kind::KEEP, 0 };
+	}
 
-			if (m_inst.GetLabel().size() > 10) {
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_INVALID_LABEL, loc));
-				currErrors.emplace_back("Error: Invalid label");
+	// A HALT with an operand is reported but not translated
+	if (a_st == Instruction::InstructionType::ST_MACHINE && a_inst.GetNumericOpCodeValue() == 13 && !a_inst.IsOperandBlank()) {
+		return { LocationEffect::Kind::KEEP, 0 };
+	}
+
+	// Only ORG and DS with a valid operand do not produce a word
+	if (a_st == Instruction::InstructionType::ST_ASSEMBLY && a_inst.GetOpCode() != "DC") {
+		const long long operandValue = Expression::EvaluateConstant(a_inst.GetOperand());
+		if (operandValue >= 0 && operandValue < m_config.GetWordLimit()) {
+			if (a_inst.GetOpCode() == "ORG") {
+				return { LocationEffect::Kind::SET, m_config.GetOperand(static_cast<int>(operandValue)) };
 			}
+			return { LocationEffect::Kind::RESERVE, m_config.GetOperand(static_cast<int>(operandValue)) };
 		}
+	}
 
-		// If the instruction has extra elements, we can record an error
-		if (!m_inst.IsExtraBlank()) {
-			Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_EXTRA_ELEMENTS, loc));
-			currErrors.emplace_back("Error: Extra elements on line");
+	return { LocationEffect::Kind::ADVANCE, 1 };
+}
+
+/// <summary>
+/// Applies a Pass II location effect. Unlike Pass I, Pass II reports the locations
+/// that run past the end of the memory.
+/// </summary>
+/// <param name="a_effect">The location effect of the line</param>
+/// <param name="a_loc">The location of the line</param>
+/// <param name="a_overflowFl">Set to true if the memory overflowed</param>
+/// <returns>The location of the next line</returns>
+int Assembler::NextPassIILocation(LocationEffect a_effect, int a_loc, bool& a_overflowFl) const noexcept
+{
+	const int memorySize = m_config.GetMemorySize();
+	a_overflowFl = false;
+
+	switch (a_effect.m_kind) {
+		case LocationEffect::Kind::SET:
+			return a_effect.m_value;
+		case LocationEffect::Kind::ADVANCE: {
+			const int loc = Instruction::NextInstructionLocation(a_loc);
+			a_overflowFl = loc >= memorySize;
+			return loc % memorySize;
 		}
+		case LocationEffect::Kind::RESERVE: {
+			// If the location is not within the limit, we move to the next location in the memory
+			const int loc = a_loc + a_effect.m_value;
+			a_overflowFl = loc >= memorySize;
+			return a_overflowFl ? (a_loc + 1) % memorySize : loc;
+		}
+		default:
+			return a_loc;
+	}
+}
 
-		if (st == Instruction::InstructionType::ST_MACHINE) {
-			currOpCode = m_inst.GetNumericOpCodeValue();
-			
-			// If there is a machine instruction after HALT command, we record an error
-			if (machineCodeFinishedFl) {
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MACHINE_CODE_AFTER_HALT, loc));
-				currErrors.emplace_back("Error: Machine Code After HALT");
-			}
+/// <summary>
+/// Translates one source line (other than END) in Pass II.
+/// The listing records, the errors and the generated words are collected in a_out
+/// so that the line can be translated independently of the output.  The listing
+/// records refer to a_line, which must not change until a_out is emitted.
+/// </summary>
+/// <param name="a_line">The source line</param>
+/// <param name="a_inst">The instruction parsed from the line</param>
+/// <param name="a_st">The type of the instruction</param>
+/// <param name="a_loc">The location of the line; updated to the location of the next line</param>
+/// <param name="a_haltFl">True if a HALT was translated before; updated by the line</param>
+/// <param name="a_out">Receives the translation of the line</param>
+void Assembler::TranslateLine(const std::string& a_line, const Instruction& a_inst, Instruction::InstructionType a_st, int& a_loc, bool& a_haltFl, PassIIOutput& a_out) const
+{
+	const auto st = a_st;
+	const int loc = a_loc;
+	int currOpCode = 0; // Tracks the current opcode
+	int currOperand = 0; // Tracks the current operand
 
-			// If the machine instruction is a HALT, we need to check if there is an operand
-			if (m_inst.GetNumericOpCodeValue() == 13) {
-				// If the operand is not missing, then there are extra elements. Therefore, we report an error
-				if (!m_inst.IsOperandBlank()) {
-					currOperand = -1;
-					Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_EXTRA_ELEMENTS, loc));
-					currErrors.emplace_back("Error: Extra elements on line");
-					continue;
-				}
+	const size_t firstError = a_out.m_errors.size(); // The errors of this line are listed under it
 
-				// We set the machineCodeFinishedFl to true since we have received a HALT command
-				machineCodeFinishedFl = true;
-			}
-			// If the machine instruction is not a HALT command, then we need to check the operand
-			else {
-				// If there are no operands, we record an error
-				if (m_inst.IsOperandBlank()) {
-					currOperand = -1;
-					Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MISSING_OPERAND, loc));
-					currErrors.emplace_back("Error: Missing operand");
-				}
+	const LocationEffect effect = PassIIEffect(st, a_inst);
 
-				// If the label is not valid, we record an error
-				else if (!std::isalpha(static_cast<unsigned char>(m_inst.GetOperand()[0]))) {
-					currOperand = -1;
-					Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_SYNTAX_ERROR, loc));
-					currErrors.emplace_back("Error: Syntax Error");
-				}
+	// If the instruction cannot be identified, we report it as a syntax error
+	if (st == Instruction::InstructionType::ST_ERROR) {
+		currOpCode = -1;
+		a_out.m_errors.emplace_back(Error::ErrorCode::ERR_INVALID_OPCODE, loc);
+	}
 
-				else if (m_inst.GetOperand().size() > 10) {
-					currOperand = -1;
-					Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_INVALID_OPERAND, loc));
-					currErrors.emplace_back("Error: Invalid operand");
-				}
+	// If the instruction is a comment or blank, then we can skip it
+	if (st == Instruction::InstructionType::ST_COMMENT_OR_BLANK) {
+		a_out.m_listing.push_back({ ListingWriter::Kind::STATEMENT, loc, 0, 0, a_line, firstError, 0 });
+		return;
+	}
 
-				// If the label is not defined, we record an error
-				else if (!m_symTab.GetSymbolLocation(m_inst.GetOperand())) {
-					currOperand = -1;
-					Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_UNDEFINED_LABEL, loc));
-					currErrors.emplace_back("Error: Undefined label operand");
-				}
+	// If the instruction has a label, then we need to check if it is a duplicate label
+	if (!a_inst.IsLabelBlank()) {
+		// If the label is a duplicate, we can record an error
+		if (!m_symTab.LookupSymbol(a_inst.GetLabel())) {
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_DUPLICATE_LABEL, loc);
+		}
+
+		if (a_inst.GetLabel().size() > 10) {
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_INVALID_LABEL, loc);
+		}
+	}
+
+	// If the instruction has extra elements, we can record an error
+	if (!a_inst.IsExtraBlank()) {
+		a_out.m_errors.emplace_back(Error::ErrorCode::ERR_EXTRA_ELEMENTS, loc);
+	}
+
+	if (st == Instruction::InstructionType::ST_MACHINE) {
+		currOpCode = a_inst.GetNumericOpCodeValue();
+		
+		// If there is a machine instruction after HALT command, we record an error
+		if (a_haltFl) {
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_MACHINE_CODE_AFTER_HALT, loc);
+		}
+
+		// If the machine instruction is a HALT, we need to check if there is an operand
+		if (a_inst.GetNumericOpCodeValue() == 13) {
+			// If the operand is not missing, then there are extra elements. Therefore, we report an error
+			if (!a_inst.IsOperandBlank()) {
+				a_out.m_errors.emplace_back(Error::ErrorCode::ERR_EXTRA_ELEMENTS, loc);
+				return;
+			}
+
+			// We set the haltFl to true since we have received a HALT command
+			a_haltFl = true;
+		}
+		// If the machine instruction is not a HALT command, then we need to check the operand
+		else {
+			// If there are no operands, we record an error
+			if (a_inst.IsOperandBlank()) {
+				currOperand = -1;
+				a_out.m_errors.emplace_back(Error::ErrorCode::ERR_MISSING_OPERAND, loc);
+			}
 
-				// If the operand uses a multiply defined label, we record an error
-				else if (m_symTab.GetSymbolLocation(m_inst.GetOperand()) == SymbolTable::multiplyDefinedSymbol) {
+			// The operand of an immediate instruction may be a number below the memory size
+			else if (a_inst.TakesImmediate() && a_inst.IsOperandNumeric()) {
+				if (a_inst.GetOperand().size() >= 10 || std::stoi(a_inst.GetOperand()) >= m_config.GetMemorySize()) {
 					currOperand = -1;
-					Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_INVALID_OPERAND, loc));
-					currErrors.emplace_back("Error: Invalid operand");
+					a_out.m_errors.emplace_back(Error::ErrorCode::ERR_OPERAND_OVERFLOW, loc);
 				}
-
-				// If the operand is valid, we can put it in currOperand
 				else {
-					std::string operand = m_inst.GetOperand();
-					currOperand = m_symTab.GetSymbolLocation(operand);
+					currOperand = std::stoi(a_inst.GetOperand());
 				}
 			}
-		}
 
-		else if (st == Instruction::InstructionType::ST_ASSEMBLY) {
-			// If the instruction is an assembly instruction before HALT command and is not ORG, we record an error
-			if (!machineCodeFinishedFl && m_inst.GetOpCode() != "ORG") {
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_ASSEMBLY_CODE_BEFORE_HALT, loc));
-				currErrors.emplace_back("Error: Assembly code before HALT");
+			// An expression such as TABLE+3 is evaluated now; immediate instructions may also take a number
+			else if (Expression::IsExpression(a_inst.GetOperand())) {
+				currOperand = TranslateExpression(a_inst.GetOperand(), loc, m_config.GetMemorySize(),
+					a_inst.TakesImmediate() ? ExpressionUse::VALUE : ExpressionUse::ADDRESS, a_out);
 			}
 
-			// If the operand is missing, we record an error
-			if (m_inst.IsOperandBlank()) {
+			// If the label is not valid, we record an error
+			else if (!std::isalpha(static_cast<unsigned char>(a_inst.GetOperand()[0]))) {
 				currOperand = -1;
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MISSING_OPERAND, loc));
-				currErrors.emplace_back("Error: Missing operand");
+				a_out.m_errors.emplace_back(Error::ErrorCode::ERR_SYNTAX_ERROR, loc);
 			}
 
-			// If the operand is not a number, we record an error
-			else if (!m_inst.IsOperandNumeric()) {
+			else if (a_inst.GetOperand().size() > 10) {
 				currOperand = -1;
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_SYNTAX_ERROR, loc));
-				currErrors.emplace_back("Error: Syntax Error");
+				a_out.m_errors.emplace_back(Error::ErrorCode::ERR_INVALID_OPERAND, loc);
 			}
 
-			else if (m_inst.GetOperand().size() >= 10) {
+			// If the label is defined in another module, the linker fills in its location
+			else if (m_symTab.IsExternalSymbol(a_inst.GetOperand())) {
+				currOperand = 0;
+				a_out.m_object.AddExternalRef(loc, a_inst.GetOperand());
+			}
+
+			// If the label is not defined, we record an error
+			else if (!m_symTab.GetSymbolLocation(a_inst.GetOperand())) {
 				currOperand = -1;
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_OPERAND_OVERFLOW, loc));
-				currErrors.emplace_back("Error: Operand overflow");
+				a_out.m_errors.emplace_back(Error::ErrorCode::ERR_UNDEFINED_LABEL, loc);
 			}
 
-			// If the operand is not a number within the limit, we record an error
-			else if (std::stoi(m_inst.GetOperand()) >= 1000000 || std::stoi(m_inst.GetOperand()) < 0) {
+			// If the operand uses a multiply defined label, we record an error
+			else if (m_symTab.GetSymbolLocation(a_inst.GetOperand()) == SymbolTable::multiplyDefinedSymbol) {
 				currOperand = -1;
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_OPERAND_OVERFLOW, loc));
-				currErrors.emplace_back("Error: Operand overflow");
+				a_out.m_errors.emplace_back(Error::ErrorCode::ERR_INVALID_OPERAND, loc);
 			}
 
 			// If the operand is valid, we can put it in currOperand
 			else {
-				const int operandValue = std::stoi(m_inst.GetOperand());
-				currOpCode = operandValue / 10000;		// If the operand is a number bigger than 10000, then we put the first two digits in currOpCode
-				currOperand = operandValue % 10000;	// If the operand is a number bigger than 10000, then we put the last four digits in currOperand
-
-				// If the instruction is an ORG or DS command (or not a DC command),
-				// then we have to update the location in a special way
-				if (m_inst.GetOpCode() != "DC") {
-					tempLoc = currOperand;
-
-					// If the instruction is DS command, we need to add the operand to the current location
-					if (m_inst.GetOpCode() == "DS") {
-						tempLoc += loc;
-					}
-
-					// If the location is not within the limit, we record an error
-					if (tempLoc >= 10000 || tempLoc < 0) {
-						currOpCode = -1;
-						currOperand = -1;
-						tempLoc = loc + 1; // We move to the next location in the memory
-						Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MEMORY_OVERFLOW, loc));
-						currErrors.emplace_back("Error: Memory overflow");
-					}
-				}
+				currOperand = m_symTab.GetSymbolLocation(a_inst.GetOperand());
+
+				// The operand is an address in this module, so it moves when the module is relocated
+				a_out.m_object.AddRelocation(loc);
+			}
+
+			// A zero divisor made of numbers only is known now, rather than when the run reaches it
+			if (currOperand == 0 && Instruction::MatchesOpCode(a_inst.GetOpCode(), "DIVI") && Expression::EvaluateConstant(a_inst.GetOperand()) == 0) {
+				currOperand = -1;
+				a_out.m_errors.emplace_back(Error::ErrorCode::ERR_DIVISION_BY_ZERO, loc);
 			}
 		}
+	}
+
+	else if (a_inst.IsLinkageDirective()) {
+		// If the operand is missing, we record an error
+		if (a_inst.IsOperandBlank()) {
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_MISSING_OPERAND, loc);
+		}
 
-		// If the instruction is not a ORG or DS command, we need to output and move to the next location in the memory
-		if (tempLoc == -1) {
-			m_emul.InsertMemory(loc, currOpCode, currOperand);
-			std::cout << std::format("{:10}{:10}     {}\n", loc, m_emul.GetMemoryContent(loc), line);
+		// An exported symbol must be defined in this module
+		else if (a_inst.GetOpCode() == "ENTRY" && (!m_symTab.LookupSymbol(a_inst.GetOperand()) || m_symTab.IsExternalSymbol(a_inst.GetOperand()))) {
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_UNDEFINED_LABEL, loc);
+		}
+	}
 
-			// We move to the next location in the memory
-			loc = Instruction::NextInstructionLocation(loc);
+	else if (st == Instruction::InstructionType::ST_ASSEMBLY) {
+		// If the instruction is an assembly instruction before HALT command and is not ORG, we record an error
+		if (!a_haltFl && a_inst.GetOpCode() != "ORG") {
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_ASSEMBLY_CODE_BEFORE_HALT, loc);
+		}
+
+		// If the operand is missing, we record an error
+		if (a_inst.IsOperandBlank()) {
+			currOperand = -1;
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_MISSING_OPERAND, loc);
+		}
 
-			// If the location is not within the limit, we record an error
-			if (loc >= 10000) {
-				loc %= 10000;
-				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MEMORY_OVERFLOW, loc));
-				currErrors.emplace_back("Error: Memory overflow");
+		// DC may hold an address, e.g. TABLE+3; ORG and DS are needed in Pass I, before the labels are known
+		else if (Expression::IsExpression(a_inst.GetOperand())) {
+			const int operandValue = TranslateExpression(a_inst.GetOperand(), loc, m_config.GetWordLimit(),
+				a_inst.GetOpCode() == "DC" ? ExpressionUse::VALUE : ExpressionUse::CONSTANT, a_out);
+			if (operandValue < 0) {
+				currOperand = -1;
+			}
+			else {
+				currOpCode = m_config.GetOpCode(operandValue);
+				currOperand = m_config.GetOperand(operandValue);
 			}
 		}
-		// If the instruction is a ORG or DS command, we need to output and move to the location in the memory that was stored in tempLoc
+
+		// If the operand is not a number, we record an error
+		else if (!a_inst.IsOperandNumeric()) {
+			currOperand = -1;
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_SYNTAX_ERROR, loc);
+		}
+
+		else if (a_inst.GetOperand().size() >= 10) {
+			currOperand = -1;
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_OPERAND_OVERFLOW, loc);
+		}
+
+		// If the operand is not a number within the limit, we record an error
+		else if (std::stoi(a_inst.GetOperand()) >= m_config.GetWordLimit() || std::stoi(a_inst.GetOperand()) < 0) {
+			currOperand = -1;
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_OPERAND_OVERFLOW, loc);
+		}
+
+		// If the operand is valid, we can put it in currOperand
 		else {
-			std::cout << std::format("{:10}{:15}{}\n", loc, "", line); // Output the location and the instruction				
+			const int operandValue = std::stoi(a_inst.GetOperand());
+			currOpCode = m_config.GetOpCode(operandValue);		// If the operand is a number bigger than the memory, then we put the first two digits in currOpCode
+			currOperand = m_config.GetOperand(operandValue);	// If the operand is a number bigger than the memory, then we put the last (four) digits in currOperand
+		}
+	}
+
+	bool overflowFl = false;
+	a_loc = NextPassIILocation(effect, loc, overflowFl);
 
-			loc = tempLoc % 10000; // We move to the location in the memory that was stored in tempLoc
+	// If the instruction is not a ORG or DS command, we need to output and move to the next location in the memory
+	if (effect.m_kind == LocationEffect::Kind::ADVANCE) {
+		// Pass II keeps what each word was generated from for the Classifier
+		const Emulator::WordKind kind = st == Instruction::InstructionType::ST_MACHINE ? Emulator::WordKind::CODE
+			: st == Instruction::InstructionType::ST_ASSEMBLY ? Emulator::WordKind::CONSTANT : Emulator::WordKind::UNKNOWN;
+		a_out.m_words.push_back({ loc, currOpCode, currOperand, kind });
+		a_out.m_listing.push_back({ ListingWriter::Kind::WORD, loc, currOpCode, currOperand, a_line, firstError, 0 });
+
+		// If the location is not within the limit, we record an error
+		if (overflowFl) {
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_MEMORY_OVERFLOW, a_loc);
 		}
-		
-		// Output the errors if there are any
-		for (const auto& error : currErrors) {
-			std::cout << error << '\n';
+	}
+	// If the instruction is a ORG or DS command, we need to output and move to the location in the memory that was computed
+	else {
+		// If the location is not within the limit, we record an error
+		if (overflowFl) {
+			a_out.m_errors.emplace_back(Error::ErrorCode::ERR_MEMORY_OVERFLOW, loc);
+		}
+
+		a_out.m_listing.push_back({ ListingWriter::Kind::LOCATION, loc, 0, 0, a_line, firstError, 0 }); // Output the location and the instruction
+	}
+	a_out.m_end = std::max(a_out.m_end, a_loc);
+	
+	// The errors are listed under the line
+	a_out.m_listing.back().m_errorCount = a_out.m_errors.size() - firstError;
+}
+
+/// <summary>
+/// Evaluates an operand expression against the symbol table in Pass II.  An address of this module
+/// is relocated by the linker, and an external symbol is added to the value by it.
+/// </summary>
+/// <param name="a_operand">The operand</param>
+/// <param name="a_loc">The location of the line</param>
+/// <param name="a_limit">The value must be below it: the memory size, or the word limit for DC, ORG and DS</param>
+/// <param name="a_use">What the value may be</param>
+/// <param name="a_out">Receives the error, the relocation or the external reference</param>
+/// <returns>The value, or -1 if there was an error</returns>
+int Assembler::TranslateExpression(std::string_view a_operand, int a_loc, int a_limit, ExpressionUse a_use, PassIIOutput& a_out) const
+{
+	const auto lookup = [this](std::string_view a_name) -> std::optional<Expression::Symbol> {
+		const SymbolTable::Symbol* symbol = m_symTab.FindSymbol(a_name);
+		if (symbol == nullptr) {
+			return std::nullopt;
+		}
+		return Expression::Symbol{ symbol->m_loc, symbol->m_length, symbol->m_kind == SymbolTable::SymbolKind::SYM_EXTERNAL,
+			symbol->m_loc == SymbolTable::multiplyDefinedSymbol };
+	};
+	const Expression::Value value = Expression::Evaluate(a_operand, lookup);
+
+	if (value.m_error) {
+		a_out.m_errors.emplace_back(*value.m_error, a_loc);
+		return -1;
+	}
+
+	// An address has exactly one label of this module or one external symbol.  ORG and DS take no labels
+	const bool externalFl = !value.m_external.empty();
+	const bool addressFl = externalFl || value.m_relocations == 1;
+	if ((!addressFl && !value.IsAbsolute()) || (externalFl && value.m_relocations != 0)
+		|| (a_use == ExpressionUse::ADDRESS && !addressFl) || (a_use == ExpressionUse::CONSTANT && value.m_symbolicFl)) {
+		a_out.m_errors.emplace_back(Error::ErrorCode::ERR_INVALID_OPERAND, a_loc);
+		return -1;
+	}
+
+	// For an external symbol, this is what is added to its address
+	if (value.m_value < 0 || value.m_value >= a_limit) {
+		a_out.m_errors.emplace_back(Error::ErrorCode::ERR_OPERAND_OVERFLOW, a_loc);
+		return -1;
+	}
+
+	if (externalFl) {
+		a_out.m_object.AddExternalRef(a_loc, value.m_external);
+	}
+	else if (addressFl) {
+		a_out.m_object.AddRelocation(a_loc);
+	}
+	return static_cast<int>(value.m_value);
+}
+
+/// <summary>
+/// Translates the END statement that finishes Pass II.
+/// </summary>
+/// <param name="a_line">The END line</param>
+/// <param name="a_loc">The location of the END line</param>
+/// <param name="a_moreLinesFl">True if there are lines after the END statement</param>
+void Assembler::TranslateEnd(const std::string& a_line, int a_loc, bool a_moreLinesFl)
+{
+	const Error::ErrorMsg extraElements(Error::ErrorCode::ERR_EXTRA_ELEMENTS, a_loc);
+	const Error::ErrorMsg notLast(Error::ErrorCode::ERR_END_STATEMENT_NOT_LAST, a_loc);
+	std::array<Error::ErrorMsg, 2> errors{ extraElements, notLast };
+	size_t errorCount = 0;
+
+	// If there is an operand after the END statement, we record an error
+	if (!m_inst.IsOperandBlank()) {
+		m_emul.InsertMemory(a_loc, 0, -1);
+		errors[errorCount++] = extraElements;
+	}
+
+	// If there are more lines after the END statement, we record an error
+	if (a_moreLinesFl) {
+		errors[errorCount++] = notLast;
+	}
+
+	for (size_t i = 0; i < errorCount; ++i) {
+		Error::RecordError(errors[i]);
+	}
+	ListLine(ListingWriter::Kind::STATEMENT, a_loc, 0, 0, a_line, std::span<const Error::ErrorMsg>(errors).first(errorCount));
+
+	m_listing.WriteText("____________________________________________\n\n");
+	if (m_pauseFl) {
+		m_listing.Flush();
+		system("pause");
+	}
+	m_listing.WriteText("\n");
+}
+
+/// <summary>
+/// Passes a line of the translation to the listing writer.  The line of each word is kept
+/// for the watchpoint reports, and Assemble also keeps the line as a record; the text and
+/// the errors of all records share two buffers.
+/// </summary>
+/// <param name="a_kind">What the line adds to the listing</param>
+/// <param name="a_loc">The location of the line</param>
+/// <param name="a_opCode">The opcode of the word generated, -1 if it is invalid</param>
+/// <param name="a_operand">The operand of the word generated, -1 if it is invalid</param>
+/// <param name="a_line">The source line</param>
+/// <param name="a_errors">The errors listed under the line</param>
+void Assembler::ListLine(ListingWriter::Kind a_kind, int a_loc, int a_opCode, int a_operand, std::string_view a_line, std::span<const Error::ErrorMsg> a_errors)
+{
+	m_listing.Write(a_kind, a_loc, a_opCode, a_operand, a_line, a_errors);
+	if (a_kind == ListingWriter::Kind::WORD) {
+		m_wordLines.push_back({ a_loc, m_wordText.size(), a_line.size() });
+		m_wordText += a_line;
+	}
+	if (m_result != nullptr) {
+		m_result->m_listing.push_back({ a_kind, a_loc, a_opCode, a_operand, m_result->m_listingText.size(), a_line.size(),
+			m_result->m_listingErrors.size(), a_errors.size() });
+		m_result->m_listingText += a_line;
+		for (const Error::ErrorMsg& error : a_errors) {
+			m_result->m_listingErrors.push_back(error.m_emsg);
+		}
+	}
+}
+
+/// <summary>
+/// Finishes Pass II of a source without an END statement.
+/// </summary>
+/// <param name="a_loc">The location after the last line</param>
+void Assembler::TranslateMissingEnd(int a_loc)
+{
+	Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MISSING_END_STATEMENT, a_loc));
+	m_listing.WriteText("Error: Missing END statement\n");
+	m_listing.WriteText("____________________________________________\n\n");
+	if (m_pauseFl) {
+		m_listing.Flush();
+		system("pause");
+	}
+	m_listing.WriteText("\n");
+}
+
+/// <summary>
+/// Outputs the translation of one or more lines in source order and clears it:
+/// the listing is passed to the listing writer, the errors are recorded and the
+/// words are stored in the emulator and the object module.  Only the errors that
+/// were kept are listed; when there are too many errors, the lines after the one
+/// that reached the limit are dropped.
+/// </summary>
+/// <param name="a_out">The translation to be output</param>
+/// <returns>False if Pass II should stop because of the number of errors</returns>
+bool Assembler::EmitTranslation(PassIIOutput& a_out)
+{
+	bool continueFl = true;
+	size_t next = 0;	// The next error to be recorded
+	size_t kept = 0;	// The kept errors of the lines are moved to the front of m_errors
+	for (const auto& line : a_out.m_listing) {
+		// A line that is not listed, such as a HALT with an operand, still has its errors recorded
+		for (; next < line.m_firstError; ++next) {
+			static_cast<void>(Error::RecordError(a_out.m_errors[next]));
+		}
+		const size_t firstKept = kept;
+		for (; next < line.m_firstError + line.m_errorCount; ++next) {
+			if (Error::RecordError(a_out.m_errors[next])) {
+				a_out.m_errors[kept++] = a_out.m_errors[next];
+			}
+		}
+		ListLine(line.m_kind, line.m_loc, line.m_opCode, line.m_operand, line.m_line,
+			std::span<const Error::ErrorMsg>(a_out.m_errors).subspan(firstKept, kept - firstKept));
+		if (Error::TooManyErrors()) {
+			continueFl = false;
+			break;
+		}
+	}
+	for (; continueFl && next < a_out.m_errors.size(); ++next) {
+		static_cast<void>(Error::RecordError(a_out.m_errors[next]));
+	}
+
+	for (const auto& word : a_out.m_words) {
+		m_emul.InsertMemory(word.m_loc, word.m_opCode, word.m_operand, word.m_kind);
+		if (word.m_opCode != -1 && word.m_operand != -1) {
+			m_object.AddWord(word.m_loc, m_config.MakeWord(word.m_opCode, word.m_operand));
+		}
+	}
+
+	m_object.Append(a_out.m_object);
+	m_object.SetEnd(std::max(m_object.GetEnd(), a_out.m_end));
+
+	a_out.m_listing.clear();
+	a_out.m_errors.clear();
+	a_out.m_words.clear();
+	a_out.m_object.Clear();
+	a_out.m_end = 0;
+	return continueFl;
+}
+
+/// <summary>
+/// Finishes Pass II early, after so many errors that the rest of the listing would not help.
+/// </summary>
+void Assembler::TranslateTooManyErrors()
+{
+	m_listing.WriteText(std::format("Error: Too many errors; Pass II stopped after {} errors\n", Error::GetErrorCount()));
+	m_listing.WriteText("____________________________________________\n\n");
+	if (m_pauseFl) {
+		m_listing.Flush();
+		system("pause");
+	}
+	m_listing.WriteText("\n");
+}
+
+/// <summary>
+/// Runs a function on contiguous chunks of the source lines, one thread per chunk.
+/// </summary>
+/// <param name="a_lineCount">The number of lines to divide</param>
+/// <param name="a_func">Called with the chunk number and its first and past-the-end line</param>
+/// <returns>The number of chunks</returns>
+size_t Assembler::ForEachChunk(size_t a_lineCount, const std::function<void(size_t, size_t, size_t)>& a_func) const
+{
+	const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(m_threadCount, a_lineCount));
+	const size_t chunkSize = (a_lineCount + chunkCount - 1) / chunkCount;
+
+	std::vector<std::thread> threads;
+	threads.reserve(chunkCount);
+	for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+		const size_t begin = std::min(a_lineCount, chunk * chunkSize);
+		const size_t end = std::min(a_lineCount, begin + chunkSize);
+		threads.emplace_back(a_func, chunk, begin, end);
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	return chunkCount;
+}
+
+/// <summary>
+/// Pass I over the source divided into chunks.
+/// Each thread tokenizes a chunk and computes the location effect of every line.
+/// The effects compose as "add k" or "set to v" (modulo the memory size), so the
+/// start location of every chunk follows from a prefix scan of the chunk summaries.
+/// The threads then assign the locations of the labels in their chunks, and the
+/// symbols are added in source order so the symbol table is the same as in the
+/// sequential Pass I.
+/// </summary>
+void Assembler::ParallelPassI()
+{
+	LoadSourceLines();
+
+	const size_t lineCount = m_lines.size();
+	std::vector<LocationEffect> effects(lineCount, LocationEffect{ LocationEffect::Kind::KEEP, 0 });
+	std::vector<size_t> firstEnd(m_threadCount, lineCount);		// The first END line of each chunk
+	std::vector<LocationEffect> summaries(m_threadCount);		// The composed effect of each chunk
+	std::vector<int> startLocs(m_threadCount, 0);
+
+	// The symbols declared in a chunk, in source order
+	struct SymbolEvent {
+		size_t m_line;
+		std::string m_symbol;
+		enum class Kind { LABEL, EXTERNAL, ENTRY } m_kind;
+		int m_loc;
+	};
+	std::vector<std::vector<SymbolEvent>> events(m_threadCount);
+
+	// Tokenize the chunks and compute the effect of each line
+	const size_t chunkCount = ForEachChunk(lineCount, [&](size_t a_chunk, size_t a_begin, size_t a_end) {
+		Instruction inst(m_config.IsExtended());
+		LocationEffect summary{ LocationEffect::Kind::ADVANCE, 0 };
+
+		for (size_t i = a_begin; i < a_end; ++i) {
+			const auto st = inst.ParseInstruction(m_lines[i]);
+			if (st == Instruction::InstructionType::ST_END) {
+				firstEnd[a_chunk] = i;
+				break;
+			}
+			if (st == Instruction::InstructionType::ST_COMMENT_OR_BLANK) {
+				continue;
+			}
+
+			if (!inst.IsLabelBlank()) {
+				events[a_chunk].push_back({ i, inst.GetLabel(), SymbolEvent::Kind::LABEL, 0 });
+			}
+			if (inst.IsLinkageDirective() && !inst.IsOperandBlank()) {
+				events[a_chunk].push_back({ i, inst.GetOperand(),
+					inst.GetOpCode() == "EXTRN" ? SymbolEvent::Kind::EXTERNAL : SymbolEvent::Kind::ENTRY, 0 });
+			}
+
+			effects[i] = PassIEffect(inst);
+			summary = ComposeEffects(summary, effects[i]);
+		}
+		summaries[a_chunk] = summary;
+	});
+
+	// Prefix scan of the chunk summaries up to the first END
+	int loc = 0;
+	size_t endLine = lineCount;
+	for (size_t chunk = 0; chunk < chunkCount && endLine == lineCount; ++chunk) {
+		startLocs[chunk] = loc;
+		loc = NextPassILocation(summaries[chunk], loc);
+		endLine = firstEnd[chunk];
+	}
+	Metrics::Count(Metrics::Counter::LINES_PARSED, std::min(endLine + 1, lineCount));
+
+	// Assign the locations of the labels from the start location of each chunk
+	ForEachChunk(lineCount, [&](size_t a_chunk, size_t a_begin, size_t /*a_end*/) {
+		int loc = startLocs[a_chunk];
+		size_t line = a_begin;
+
+		for (auto& event : events[a_chunk]) {
+			for (; line < event.m_line; ++line) {
+				loc = NextPassILocation(effects[line], loc);
+			}
+			event.m_loc = loc;
+		}
+	});
+
+	// Add the symbols in source order
+	std::vector<std::string> entries;
+	for (const auto& chunkEvents : events) {
+		for (const auto& event : chunkEvents) {
+			if (event.m_line >= endLine) {
+				break;
+			}
+			if (event.m_kind == SymbolEvent::Kind::LABEL) {
+				m_symTab.AddSymbol(event.m_symbol, event.m_loc, SymbolLength(effects[event.m_line]));
+			}
+			else if (event.m_kind == SymbolEvent::Kind::EXTERNAL) {
+				m_symTab.AddExternalSymbol(event.m_symbol);
+			}
+			else {
+				entries.push_back(event.m_symbol);
+			}
+		}
+	}
+
+	for (const auto& entry : entries) {
+		static_cast<void>(m_symTab.ExportSymbol(entry));
+	}
+}
+
+/// <summary>
+/// Pass II over the source divided into chunks.
+/// The threads first tokenize their chunks to find the location effect of every line.
+/// Pass II reports memory overflows, which makes its effects non-associative, so the
+/// start location of each chunk is found by a scan over the compact effects.  The
+/// threads then translate their chunks into separate buffers, which are output in
+/// source order, so the listing and the errors are identical to the sequential Pass II.
+/// </summary>
+void Assembler::ParallelPassII()
+{
+	LoadSourceLines();
+	Error::InitErrorReporting();
+	m_object.Clear();
+	m_object.SetOperandDigits(m_config.GetOperandDigits());
+	m_object.SetExtended(m_config.IsExtended());
+
+	const size_t lineCount = m_lines.size();
+	std::vector<LocationEffect> effects(lineCount, LocationEffect{ LocationEffect::Kind::KEEP, 0 });
+	std::vector<char> haltLines(lineCount, 0);				// Lines with a HALT that finishes the machine code
+	std::vector<size_t> firstEnd(m_threadCount, lineCount);	// The first END line of each chunk
+
+	// Tokenize the chunks and compute the effect of each line
+	const size_t chunkCount = ForEachChunk(lineCount, [&](size_t a_chunk, size_t a_begin, size_t a_end) {
+		Instruction inst(m_config.IsExtended());
+		for (size_t i = a_begin; i < a_end; ++i) {
+			const auto st = inst.ParseInstruction(m_lines[i]);
+			if (st == Instruction::InstructionType::ST_END) {
+				firstEnd[a_chunk] = i;
+				break;
+			}
+			effects[i] = PassIIEffect(st, inst);
+			haltLines[i] = st == Instruction::InstructionType::ST_MACHINE
+				&& inst.GetNumericOpCodeValue() == 13 && inst.IsOperandBlank();
+		}
+	});
+
+	const size_t endLine = *std::ranges::min_element(firstEnd);
+	Metrics::Count(Metrics::Counter::LINES_PARSED, std::min(endLine + 1, lineCount));
+
+	// Find the location and the HALT state at the start of every chunk
+	std::vector<int> startLocs(chunkCount, 0);
+	std::vector<char> startHalts(chunkCount, 0);
+	const size_t chunkSize = (lineCount + chunkCount - 1) / std::max<size_t>(1, chunkCount);
+	int loc = 0;
+	bool haltFl = false;
+	for (size_t i = 0; i < endLine; ++i) {
+		if (i % chunkSize == 0) {
+			startLocs[i / chunkSize] = loc;
+			startHalts[i / chunkSize] = haltFl;
+		}
+		bool overflowFl = false;
+		loc = NextPassIILocation(effects[i], loc, overflowFl);
+		haltFl = haltFl || haltLines[i];
+	}
+
+	// Translate the chunks
+	std::vector<PassIIOutput> outputs(chunkCount);
+	ForEachChunk(lineCount, [&](size_t a_chunk, size_t a_begin, size_t a_end) {
+		Instruction inst(m_config.IsExtended());
+		int chunkLoc = startLocs[a_chunk];
+		bool chunkHaltFl = startHalts[a_chunk];
+		for (size_t i = a_begin; i < std::min(a_end, endLine); ++i) {
+			TranslateLine(m_lines[i], inst, inst.ParseInstruction(m_lines[i]), chunkLoc, chunkHaltFl, outputs[a_chunk]);
+		}
+	});
+
+	m_listing.WriteText("Translation of Program:\n");
+	m_listing.WriteText("Location  Contents       Original Statement\n");
+
+	for (auto& output : outputs) {
+		if (!EmitTranslation(output)) {
+			TranslateTooManyErrors();
+			return;
 		}
 	}
-}
\ No newline at end of file
+
+	if (endLine == lineCount) {
+		TranslateMissingEnd(loc);
+		return;
+	}
+
+	static_cast<void>(m_inst.ParseInstruction(m_lines[endLine]));
+	TranslateEnd(m_lines[endLine], loc, endLine + 1 < lineCount);
+}
+
+/// <summary>
+/// Reads the whole source file into memory for the parallel passes.
+/// </summary>
+void Assembler::LoadSourceLines()
+{
+	if (!m_lines.empty()) {
+		return;
+	}
+
+	m_fileAcc.Rewind();
+	std::string line;
+	while (m_fileAcc.GetNextLine(line)) {
+		m_lines.push_back(line);
+	}
+}
+
+/// <summary>
+/// Composes two Pass I location effects.
+/// </summary>
+/// <param name="a_first">The effect that is applied first</param>
+/// <param name="a_second">The effect that is applied second</param>
+/// <returns>The effect of applying both</returns>
+Assembler::LocationEffect Assembler::ComposeEffects(LocationEffect a_first, LocationEffect a_second) const noexcept
+{
+	switch (a_second.m_kind) {
+		case LocationEffect::Kind::SET:
+			return a_second;
+		case LocationEffect::Kind::KEEP:
+			return a_first;
+		default:
+			// Both "set to v" and "add k" followed by "add m" keep their kind
+			return { a_first.m_kind == LocationEffect::Kind::SET ? LocationEffect::Kind::SET : LocationEffect::Kind::ADVANCE,
+				(a_first.m_value + a_second.m_value) % m_config.GetMemorySize() };
+	}
+}
+
+/// <summary>
+/// Writes the translation from Pass II as a relocatable object module
+/// that can be linked with other modules.
+/// </summary>
+/// <param name="a_fileName">The name of the object file</param>
+/// <returns>True if the object module was written</returns>
+bool Assembler::WriteObjectModule(const std::string& a_fileName)
+{
+	// A module with errors cannot be linked, the same way it cannot be run
+	if (Error::WasThereErrors()) {
+		Error::DisplayErrors();
+		return false;
+	}
+
+	for (const auto& [symbol, loc] : m_symTab.GetExportedSymbols()) {
+		m_object.AddExport(symbol, loc);
+	}
+
+	return m_object.Write(a_fileName);
+}
@@ -8,19 +8,75 @@
 #include "Instruction.h"
 #include "FileAccess.h"
 #include "Emulator.h"
+#include "ObjectModule.h"
+#include "Optimizer.h"
+#include "Classifier.h"
+#include "LoopAccelerator.h"
+#include "ListingWriter.h"
+#include "Error.h"
+#include "Expression.h"
 #include "stdafx.h"
+#include <functional>
+#include <memory>
+#include <memory_resource>
 
 
 class Assembler {
 
 public:
-    Assembler(int argc, char* argv[]);
+    // An assembler for sources given to Assemble.  It writes nothing unless SetOutput is called.
+    explicit Assembler(const MachineConfig& a_config = MachineConfig());
+    explicit Assembler(const std::string& a_fileName, const MachineConfig& a_config = MachineConfig());
+    explicit Assembler(std::unique_ptr<std::istream> a_source, const MachineConfig& a_config = MachineConfig());
     ~Assembler() = default;
 
     // Prevent copying
     Assembler(const Assembler&) = delete;
     Assembler& operator=(const Assembler&) = delete;
 
+    // A line of the listing of Pass II.  Its text and its errors are kept in the Result.
+    struct ListingRecord {
+        ListingWriter::Kind m_kind;
+        int m_loc;
+        int m_opCode;               // The word generated, with -1 for an invalid part
+        int m_operand;
+        size_t m_lineOffset;        // The source line in Result::m_listingText
+        size_t m_lineLength;
+        size_t m_firstError;        // The errors listed under the line in Result::m_listingErrors
+        size_t m_errorCount;
+    };
+
+    // What Assemble produced.
+    struct Result {
+        std::shared_ptr<const Emulator> m_image;    // The translation; run it on an instance, Emulator(m_image)
+        std::vector<SymbolTable::Entry> m_symbols;
+        std::vector<ListingRecord> m_listing;
+        std::string m_listingText;                  // The source lines of the listing records
+        std::vector<Error::ErrorCode> m_listingErrors;
+        std::vector<Error::ErrorMsg> m_errors;      // The errors kept within the Error::Limits
+        size_t m_errorCount = 0;                    // All the errors, kept or not
+
+        [[nodiscard]] bool Succeeded() const noexcept { return m_errorCount == 0; }
+
+        // The source line and the errors of a listing record.
+        [[nodiscard]] std::string_view GetLine(const ListingRecord& a_record) const noexcept {
+            return std::string_view(m_listingText).substr(a_record.m_lineOffset, a_record.m_lineLength);
+        }
+        [[nodiscard]] std::span<const Error::ErrorCode> GetErrors(const ListingRecord& a_record) const noexcept {
+            return std::span<const Error::ErrorCode>(m_listingErrors).subspan(a_record.m_firstError, a_record.m_errorCount);
+        }
+    };
+
+    // Assembles a source held in memory; both passes, with the symbol table and the listing
+    // written to the output as by the CLI.  The assembler can be used again for another source.
+    Result Assemble(std::string_view a_source);
+
+    // Returns false if the source file given to the constructor could not be opened.
+    [[nodiscard]] bool IsSourceOpen() const noexcept { return m_fileAcc.IsOpen(); }
+
+    // The dimensions of the target machine.
+    [[nodiscard]] const MachineConfig& GetConfig() const noexcept { return m_config; }
+
     // Pass I - establish the locations of the symbols
     void PassI();
 
@@ -28,15 +84,140 @@ public:
     void PassII();
 
     // Display the symbols in the symbol table.
-    void DisplaySymbolTable() const { m_symTab.DisplaySymbolTable(); }
+    void DisplaySymbolTable() const { m_symTab.DisplaySymbolTable(*m_out, m_pauseFl); }
 
     // Run emulator on the translation.
-    void RunProgramInEmulator() { m_emul.RunProgram(); }
+    bool RunProgramInEmulator(std::istream& a_in = std::cin) { return m_emul.RunProgram(a_in, *m_out); }
+
+    // Runs the peephole optimizer over the translated program.
+    Optimizer::Report OptimizeProgram() { return Optimizer(m_emul).Optimize(); }
+
+    // Classifies the code and data of the translated program and decodes read-only code.
+    Classifier::Report ClassifyProgram() { return Classifier(m_emul).Classify(); }
+
+    // Finds the loops of the translated program that the emulator can run in closed form.
+    LoopAccelerator::Report AccelerateLoops() { return LoopAccelerator(m_emul).Accelerate(); }
+
+    // Reports each write to the word at a_addr while the program runs.  Returns false if the word cannot be watched.
+    bool WatchWord(int a_addr);
+
+    // Attributes the host events of the runs of the program to its instructions (null to stop).
+    void ProfileProgram(HardwareProfile* a_profile) noexcept { m_emul.SetProfile(a_profile); }
+
+    // The source line that generated the word at a location, or an empty string.  It is kept until the next assembly.
+    [[nodiscard]] std::string_view FindSourceLine(int a_loc) const;
+
+    // Send all output to a stream instead of the console.
+    void SetOutput(std::ostream& a_out, bool a_pauseFl) noexcept;
+
+    // The emulator holding the translation.
+    [[nodiscard]] const Emulator& GetEmulator() const noexcept { return m_emul; }
+
+    // Write the translation as a relocatable object module.
+    bool WriteObjectModule(const std::string& a_fileName);
+
+    // Set the number of threads used by the passes.  One thread assembles line by line.
+    void SetThreadCount(unsigned a_threadCount) noexcept { m_threadCount = std::max(1u, a_threadCount); }
 
 private:
 
+    // How a source line moves the location counter.
+    struct LocationEffect {
+        enum class Kind {
+            KEEP,       // The location does not change
+            ADVANCE,    // The location moves forward by m_value words
+            RESERVE,    // DS reserves m_value words
+            SET         // ORG sets the location to m_value
+        } m_kind;
+        int m_value;
+    };
+
+    // A word generated by Pass II.
+    struct GeneratedWord {
+        int m_loc;
+        int m_opCode;
+        int m_operand;
+        Emulator::WordKind m_kind;
+    };
+
+    // A line of the listing, with the errors listed under it.
+    struct ListingLine {
+        ListingWriter::Kind m_kind;
+        int m_loc;
+        int m_opCode;
+        int m_operand;
+        std::string_view m_line;                // The source line
+        size_t m_firstError;                    // The index of the first error of the line in m_errors
+        size_t m_errorCount;
+    };
+
+    // The translation of a run of source lines in Pass II.
+    struct PassIIOutput {
+        std::vector<ListingLine> m_listing;     // The listing records
+        std::vector<Error::ErrorMsg> m_errors;  // The errors in source order
+        std::vector<GeneratedWord> m_words;     // The words to be stored in memory
+        ObjectModule m_object;                  // The relocation entries and external references
+        int m_end = 0;                          // The highest location reached
+    };
+
+    // Location effects of the two passes.
+    [[nodiscard]] LocationEffect PassIEffect(const Instruction& a_inst) const;
+    [[nodiscard]] int NextPassILocation(LocationEffect a_effect, int a_loc) const noexcept;
+    [[nodiscard]] LocationEffect PassIIEffect(Instruction::InstructionType a_st, const Instruction& a_inst) const;
+    [[nodiscard]] int NextPassIILocation(LocationEffect a_effect, int a_loc, bool& a_overflowFl) const noexcept;
+    [[nodiscard]] LocationEffect ComposeEffects(LocationEffect a_first, LocationEffect a_second) const noexcept;
+    [[nodiscard]] static int SymbolLength(LocationEffect a_effect) noexcept;
+
+    // Adds a line to the listing, and to the records of Assemble.
+    void ListLine(ListingWriter::Kind a_kind, int a_loc, int a_opCode, int a_operand, std::string_view a_line, std::span<const Error::ErrorMsg> a_errors);
+
+    // Pass II translation of a single line, the END statement, a missing END statement and too many errors.
+    void TranslateLine(const std::string& a_line, const Instruction& a_inst, Instruction::InstructionType a_st,
+        int& a_loc, bool& a_haltFl, PassIIOutput& a_out) const;
+    void TranslateEnd(const std::string& a_line, int a_loc, bool a_moreLinesFl);
+
+    // What an operand expression may be: an address of a machine instruction, the operand of an
+    // immediate instruction or DC (an address or a number), or the operand of ORG or DS (numbers only).
+    enum class ExpressionUse { ADDRESS, VALUE, CONSTANT };
+
+    // Evaluates an operand expression of the line at a_loc, which must be below a_limit, and records its
+    // relocation or external reference.  Returns the value, or -1 after recording an error.
+    [[nodiscard]] int TranslateExpression(std::string_view a_operand, int a_loc, int a_limit, ExpressionUse a_use, PassIIOutput& a_out) const;
+    void TranslateMissingEnd(int a_loc);
+    void TranslateTooManyErrors();
+    [[nodiscard]] bool EmitTranslation(PassIIOutput& a_out);
+
+    // Pass II line by line.
+    void SequentialPassII();
+
+    // Parallel versions of the passes.
+    void ParallelPassI();
+    void ParallelPassII();
+    void LoadSourceLines();
+    size_t ForEachChunk(size_t a_lineCount, const std::function<void(size_t, size_t, size_t)>& a_func) const;
+
     FileAccess m_fileAcc;	    // File Access object
+    std::pmr::monotonic_buffer_resource m_arena;    // Holds the symbols and the words of one assembly
     SymbolTable m_symTab;	    // Symbol table object
     Instruction m_inst;	        // Instruction object
     Emulator m_emul;            // Emulator object
+    ObjectModule m_object;      // Relocatable form of the translation
+    MachineConfig m_config;     // Dimensions of the target machine
+    ListingWriter m_listing;    // Formats and writes the listing of Pass II
+
+    std::ostream m_discard{ nullptr };      // Takes the output of an assembler without SetOutput
+    std::ostream* m_out = &std::cout;       // Where the symbol table, listing and program output go
+    bool m_pauseFl = true;                  // Pause after each section of the output
+    unsigned m_threadCount = 1;             // Number of threads used by the passes
+    std::vector<std::string> m_lines;       // The source lines, loaded for the parallel passes
+    Result* m_result = nullptr;             // Where Assemble collects the listing (null otherwise)
+
+    // The source line of a word generated by Pass II, for the watchpoint reports.
+    struct WordLine {
+        int m_loc;
+        size_t m_offset;                    // The line in m_wordText
+        size_t m_length;
+    };
+    std::vector<WordLine> m_wordLines;      // Sorted by location once Pass II is done
+    std::string m_wordText;                 // The source lines of m_wordLines
 };
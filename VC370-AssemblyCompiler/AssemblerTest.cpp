@@ -3,24 +3,395 @@
  */
 #include "stdafx.h"     // This must be present if you use precompiled headers which you will use. 
 #include "Assembler.h"
+#include "Linker.h"
+#include "Server.h"
+#include "Client.h"
+#include "Error.h"
+#include "Metrics.h"
+#include "Optimizer.h"
+#include "Classifier.h"
+#include "LoopAccelerator.h"
+#include "Debugger.h"
+#include "Pipeline.h"
+#include "HardwareProfile.h"
 
-int main(int argc, char* argv[])
+// Options that may come before the mode and the file names.
+struct Options {
+    unsigned m_threadCount = 1;     // -j <Threads>
+    MachineConfig m_config;         // -w <OperandDigits>, -x (the extended instruction set)
+    bool m_optimizeFl = false;      // -O
+    bool m_profileFl = false;       // -H (host counters by guest opcode and basic block)
+    unsigned long long m_snapshotInterval = Debugger::DefaultInterval;  // -s <Interval>
+    std::vector<int> m_watchpoints; // -W <Address>, once for each watched word
+};
+
+// The file the metrics are written to when the program exits (-m <MetricsFile>).
+static std::string s_metricsFile;
+
+// Prints how the program is used.
+static int Usage()
+{
+    std::cerr << "Usage: Assem [-O] [-H] [-j <Threads>] [-w <OperandDigits>] [-x] [-m <MetricsFile>] [-e <ErrorLimits>] [-W <Address> ...] <FileName>\n";
+    std::cerr << "       Assem [-w <OperandDigits>] [-x] -c <FileName> <ObjectFile>\n";
+    std::cerr << "       Assem [-O] -l <ObjectFile> [<ObjectFile> ...]\n";
+    std::cerr << "       Assem [-j <Workers>] [-m <MetricsFile>] -d <SocketPath>\n";
+    std::cerr << "       Assem [-w <OperandDigits>] [-x] -r <SocketPath> <File> [<File> ...]\n";
+    std::cerr << "       Assem [-w <OperandDigits>] [-x] [-s <Interval>] -g <FileName> [<InputFile>]\n";
+    std::cerr << "       Assem [-O] [-j <Workers>] [-w <OperandDigits>] [-x] [-m <MetricsFile>] -p <PipelineFile>\n";
+    return 1;
+}
+
+// Returns true if the argument is a non-negative number.
+static bool IsNumber(std::string_view a_arg)
+{
+    return !a_arg.empty() && a_arg.size() < 10 && std::ranges::all_of(a_arg, [](unsigned char c) { return std::isdigit(c); });
+}
+
+// Reads the error limits "<PerCode>,<Total>,<StopAfter>"; a part that is left out keeps its default.
+static bool ParseErrorLimits(std::string_view a_arg)
+{
+    Error::Limits limits;
+    size_t* const parts[] = { &limits.m_perCode, &limits.m_total, &limits.m_stopAfter };
+    for (size_t* part : parts) {
+        const std::string_view value = a_arg.substr(0, a_arg.find(','));
+        if (!value.empty()) {
+            if (!IsNumber(value)) {
+                return false;
+            }
+            *part = std::stoul(std::string(value));
+        }
+        a_arg.remove_prefix(std::min(a_arg.size(), value.size() + 1));
+    }
+    Error::SetLimits(limits);
+    return a_arg.empty();
+}
+
+// Reads the options; a_argi is left at the first argument that is not an option.
+static bool ParseOptions(int argc, char* argv[], int& a_argi, Options& a_opts)
+{
+    for (; a_argi + 1 < argc; a_argi += 2) {
+        const std::string_view option = argv[a_argi];
+        const std::string_view value = argv[a_argi + 1];
+
+        // Options without a value
+        if (option == "-O") {
+            a_opts.m_optimizeFl = true;
+            --a_argi;
+            continue;
+        }
+        if (option == "-H") {
+            a_opts.m_profileFl = true;
+            --a_argi;
+            continue;
+        }
+        if (option == "-x") {
+            a_opts.m_config = MachineConfig(a_opts.m_config.GetOperandDigits(), true);
+            --a_argi;
+            continue;
+        }
+
+        if (option == "-j" && IsNumber(value)) {
+            a_opts.m_threadCount = static_cast<unsigned>(std::stoul(std::string(value)));
+        }
+        else if (option == "-w" && IsNumber(value) && MachineConfig::IsValidOperandDigits(std::stoi(std::string(value)))) {
+            a_opts.m_config = MachineConfig(std::stoi(std::string(value)), a_opts.m_config.IsExtended());
+        }
+        else if (option == "-s" && IsNumber(value) && std::stoull(std::string(value)) > 0) {
+            a_opts.m_snapshotInterval = std::stoull(std::string(value));
+        }
+        else if (option == "-e") {
+            if (!ParseErrorLimits(value)) {
+                return false;
+            }
+        }
+        else if (option == "-W" && IsNumber(value)) {
+            a_opts.m_watchpoints.push_back(std::stoi(std::string(value)));
+        }
+        else if (option == "-m") {
+            s_metricsFile = value;
+            Metrics::Enable(true);
+            std::atexit([] { static_cast<void>(Metrics::WriteJson(s_metricsFile)); });
+        }
+        else if (option == "-j" || option == "-w" || option == "-s" || option == "-W") {
+            return false;
+        }
+        else {
+            break;
+        }
+    }
+    return true;
+}
+
+// Reads a source file into memory for Assembler::Assemble.
+static bool ReadSource(const char* a_fileName, std::string& a_source)
+{
+    std::ifstream file(a_fileName, std::ios::in);
+    if (!file) {
+        std::cerr << "Source file could not be opened, assembler terminated.\n";
+        return false;
+    }
+    a_source.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Assembles a source file into a relocatable object module:  Assem -c <FileName> <ObjectFile>
+static int AssembleObjectModule(int argc, char* argv[], int a_argi, const Options& a_opts)
+{
+    if (argc - a_argi != 3) {
+        return Usage();
+    }
+
+    std::string source;
+    if (!ReadSource(argv[a_argi + 1], source)) {
+        return 1;
+    }
+
+    Assembler assem(a_opts.m_config);
+    assem.SetOutput(std::cout, true);
+    static_cast<void>(assem.Assemble(source));
+
+    return assem.WriteObjectModule(argv[a_argi + 2]) ? 0 : 1;
+}
+
+// Reports what the optimizer did and how many instructions the run saved.
+static void ReportOptimization(const Optimizer::Report& a_report, const Emulator& a_emul)
+{
+    if (a_report.m_selfModifyingFl) {
+        std::cerr << "Optimizer: the program may store into its own code, so it was not optimized\n";
+        return;
+    }
+    std::cerr << std::format("Optimizer: {} reachable instructions, {} branches threaded, {} fall-throughs shortened, {} unreachable words\n",
+        a_report.m_reachableInstructions, a_report.m_threadedBranches, a_report.m_shortenedFallThroughs, a_report.m_unreachableWords);
+    std::cerr << std::format("Optimizer: {} instructions executed, {} saved\n", a_emul.GetInstructionCount(), a_emul.GetInstructionsSaved());
+}
+
+// Reports how the classifier divided the program into code and data.
+static void ReportClassification(const Classifier::Report& a_report)
+{
+    std::cerr << std::format("Classifier: {} code words, {} constants, {} words written, {} reachable words not assembled as instructions\n",
+        a_report.m_codeWords, a_report.m_constantWords, a_report.m_writtenWords, a_report.m_dataExecuted);
+    if (a_report.m_readOnlyCodeFl) {
+        std::cerr << std::format("Classifier: the code is read-only; {} instructions decoded, {} operands used as immediates\n",
+            a_report.m_reachableInstructions, a_report.m_immediateOperands);
+    }
+    else {
+        std::cerr << "Classifier: the program may write its own code, so it was not decoded\n";
+    }
+}
+
+// Reports the loops the emulator could run in closed form and how many iterations it ran ahead.
+static void ReportAcceleration(const LoopAccelerator::Report& a_report, const Emulator& a_emul)
+{
+    std::cerr << std::format("Accelerator: {} of {} loops run in closed form; {} iterations run ahead\n",
+        a_report.m_loops, a_report.m_backwardBranches, a_emul.GetIterationsAccelerated());
+}
+
+// Links object modules and runs the result:  Assem [-O] -l <ObjectFile> [<ObjectFile> ...]
+static int LinkAndRun(int argc, char* argv[], int a_argi, const Options& a_opts)
+{
+    if (argc - a_argi < 2) {
+        return Usage();
+    }
+
+    Linker linker;
+    MachineConfig config(MachineConfig::ClassicOperandDigits);
+    for (int i = a_argi + 1; i < argc; ++i) {
+        ObjectModule module;
+        if (!module.Read(argv[i])) {
+            return 1;
+        }
+
+        // The machine is the one the first module was assembled for
+        if (i == a_argi + 1) {
+            config = module.GetConfig();
+        }
+        linker.AddModule(std::move(module));
+    }
+
+    Emulator emul{ config };
+    static_cast<void>(linker.Link(emul));
+
+    Optimizer::Report report;
+    Classifier::Report classes;
+    LoopAccelerator::Report loops;
+    if (a_opts.m_optimizeFl && !Error::WasThereErrors()) {
+        report = Optimizer(emul).Optimize();
+        classes = Classifier(emul).Classify();
+        loops = LoopAccelerator(emul).Accelerate();
+    }
+
+    // The emulator refuses to run an image with link errors, just like one with assembly errors
+    emul.RunProgram();
+    if (a_opts.m_optimizeFl && !Error::WasThereErrors()) {
+        ReportOptimization(report, emul);
+        ReportClassification(classes);
+        ReportAcceleration(loops, emul);
+    }
+    return Error::WasThereErrors() ? -1 : 0;
+}
+
+// Assembles a source file and runs it:  Assem [-O] [-H] [-j <Threads>] [-w <OperandDigits>] [-x] [-m <MetricsFile>] [-e <ErrorLimits>] [-W <Address> ...] <FileName>
+static int AssembleAndRun(int argc, char* argv[], int a_argi, const Options& a_opts)
 {
-    Assembler assem(argc, argv);
+    if (argc - a_argi != 1) {
+        return Usage();
+    }
+
+    std::string source;
+    if (!ReadSource(argv[a_argi], source)) {
+        return 1;
+    }
+
+    Assembler assem(a_opts.m_config);
+    assem.SetOutput(std::cout, true);
+    assem.SetThreadCount(a_opts.m_threadCount);
+    static_cast<void>(assem.Assemble(source));
 
-    // Establish the location of the labels:
-    assem.PassI();
+    Optimizer::Report report;
+    Classifier::Report classes;
+    LoopAccelerator::Report loops;
+    if (a_opts.m_optimizeFl && !Error::WasThereErrors()) {
+        report = assem.OptimizeProgram();
+        classes = assem.ClassifyProgram();
+        loops = assem.AccelerateLoops();
+    }
 
-    // Display the symbol table.
-    assem.DisplaySymbolTable();
+    for (const int addr : a_opts.m_watchpoints) {
+        if (!assem.WatchWord(addr)) {
+            std::cerr << "Cannot watch word " << addr << '\n';
+        }
+    }
 
-    // Output the symbol table and the translation.
-    assem.PassII( );
+    // The profile counts in this thread, which runs the program
+    std::optional<HardwareProfile> profile;
+    if (a_opts.m_profileFl && !Error::WasThereErrors()) {
+        assem.ProfileProgram(&profile.emplace(assem.GetEmulator()));
+    }
 
-    // Run the emulator on the Quack3200 program that was generated in Pass II.
     assem.RunProgramInEmulator();
+    if (profile) {
+        assem.ProfileProgram(nullptr);
+        profile->WriteReport(std::cerr);
+    }
+    if (a_opts.m_optimizeFl && !Error::WasThereErrors()) {
+        ReportOptimization(report, assem.GetEmulator());
+        ReportClassification(classes);
+        ReportAcceleration(loops, assem.GetEmulator());
+    }
+    return Error::WasThereErrors() ? -1 : 0;
+}
+
+// Serves assembly requests until it is killed:  Assem [-j <Workers>] [-m <MetricsFile>] -d <SocketPath>
+static int RunDaemon(int argc, char* argv[], int a_argi, const Options& a_opts)
+{
+    if (argc - a_argi != 2) {
+        return Usage();
+    }
+
+    const unsigned workers = a_opts.m_threadCount > 1 ? a_opts.m_threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+    Server server(argv[a_argi + 1], workers);
+    return server.Run() ? 0 : 1;
+}
+
+// Sends files to a daemon:  Assem [-w <OperandDigits>] [-x] -r <SocketPath> <File> [<File> ...]
+static int RunRemote(int argc, char* argv[], int a_argi, const Options& a_opts)
+{
+    if (argc - a_argi < 3) {
+        return Usage();
+    }
+
+    Client client(argv[a_argi + 1]);
+    return client.Run(std::vector<std::string>(argv + a_argi + 2, argv + argc), a_opts.m_config);
+}
+
+// Assembles a source file and debugs it:  Assem [-w <OperandDigits>] [-x] [-s <Interval>] -g <FileName> [<InputFile>]
+// The program reads its input from the input file; the debugger commands come from the console.
+static int DebugProgram(int argc, char* argv[], int a_argi, const Options& a_opts)
+{
+    if (argc - a_argi != 2 && argc - a_argi != 3) {
+        return Usage();
+    }
+
+    std::string source;
+    if (!ReadSource(argv[a_argi + 1], source)) {
+        return 1;
+    }
+
+    Assembler assem(a_opts.m_config);
+    assem.SetOutput(std::cout, true);
+    const Assembler::Result result = assem.Assemble(source);
+    if (!result.Succeeded()) {
+        Error::DisplayErrors();
+        return -1;
+    }
+
+    std::ifstream input;
+    if (argc - a_argi == 3) {
+        input.open(argv[a_argi + 2]);
+        if (!input) {
+            std::cerr << "Could not open " << argv[a_argi + 2] << '\n';
+            return 1;
+        }
+    }
 
-    // Terminate indicating all is well.  If there is an unrecoverable error, the 
-    // program will terminate at the point that it occurred with an exit(1) call.
+    Debugger debugger(result.m_image, input, std::cout, a_opts.m_snapshotInterval);
+    debugger.Interact(std::cin, std::cout);
     return 0;
-}
\ No newline at end of file
+}
+
+// Runs several machines wired output to input:  Assem [-O] [-j <Workers>] [-w <OperandDigits>] [-x] [-m <MetricsFile>] -p <PipelineFile>
+static int RunPipeline(int argc, char* argv[], int a_argi, const Options& a_opts)
+{
+    if (argc - a_argi != 2) {
+        return Usage();
+    }
+
+    Pipeline pipeline(a_opts.m_config, a_opts.m_optimizeFl);
+    if (!pipeline.Load(argv[a_argi + 1])) {
+        return -1;
+    }
+
+    const unsigned workers = a_opts.m_threadCount > 1 ? a_opts.m_threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+    const bool okFl = pipeline.Run(workers);
+
+    const Pipeline::Report& report = pipeline.GetReport();
+    std::cerr << std::format("Pipeline: {} machines, {} channels, {} workers; {} words sent, {} parks, {} steals\n",
+        report.m_machines, report.m_channels, report.m_workers, report.m_words, report.m_parks, report.m_steals);
+    return okFl ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    // Options, separate assembly and linking
+    if (argc > 2 && argv[1][0] == '-') {
+        int argi = 1;
+        Options opts;
+        if (!ParseOptions(argc, argv, argi, opts)) {
+            return Usage();
+        }
+
+        const std::string_view mode = argi < argc ? argv[argi] : "";
+        if (mode == "-c") {
+            return AssembleObjectModule(argc, argv, argi, opts);
+        }
+        if (mode == "-l") {
+            return LinkAndRun(argc, argv, argi, opts);
+        }
+        if (mode == "-d") {
+            return RunDaemon(argc, argv, argi, opts);
+        }
+        if (mode == "-r") {
+            return RunRemote(argc, argv, argi, opts);
+        }
+        if (mode == "-g") {
+            return DebugProgram(argc, argv, argi, opts);
+        }
+        if (mode == "-p") {
+            return RunPipeline(argc, argv, argi, opts);
+        }
+        return AssembleAndRun(argc, argv, argi, opts);
+    }
+
+    // Assem <FileName>
+    return AssembleAndRun(argc, argv, 1, Options());
+}
@@ -0,0 +1,13 @@
+#include "Channel.h"
+#include "stdafx.h"
+#include <bit>
+
+/// <summary>
+/// Constructor for the Channel class.
+/// </summary>
+/// <param name="a_capacity">The number of words the channel must hold; rounded up to a power of two</param>
+Channel::Channel(size_t a_capacity)
+	: m_buffer(std::bit_ceil(std::max<size_t>(a_capacity, 1)))
+	, m_mask(m_buffer.size() - 1)
+{
+}
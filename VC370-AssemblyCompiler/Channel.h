@@ -0,0 +1,96 @@
+//
+//		Channel class - a bounded lock-free queue of words from the WRITEs of one VC370 machine to the READs of another.
+//
+#pragma once
+
+#include "stdafx.h"
+#include <atomic>
+#include <cstddef>
+
+// A channel has exactly one producer and one consumer, so it is a ring buffer with two
+// indexes and no locks: the producer alone advances m_tail and the consumer alone advances
+// m_head.  Each side also keeps the last value it read of the other side's index, and only
+// loads the shared one again when the cached value says the ring is full (or empty), so in
+// steady state the two cores do not bounce each other's cache line on every word.
+//
+// The words come out in the order they went in.  Either side may end: the producer closes
+// the channel when its machine stops, and the consumer abandons it, so that a producer
+// writing to a machine that is gone stops instead of blocking forever.
+class Channel {
+
+public:
+	// The default number of words a channel holds.
+	static constexpr size_t DefaultCapacity = 64;
+
+	// A channel of at least a_capacity words; the capacity is rounded up to a power of two.
+	explicit Channel(size_t a_capacity = DefaultCapacity);
+	~Channel() = default;
+
+	// Prevent copying
+	Channel(const Channel&) = delete;
+	Channel& operator=(const Channel&) = delete;
+
+	// Producer: adds a word.  Returns false if the channel is full.
+	[[nodiscard]] bool TryPush(int a_word) noexcept
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_cachedHead == m_buffer.size()) {
+			m_cachedHead = m_head.load(std::memory_order_acquire);
+			if (tail - m_cachedHead == m_buffer.size()) {
+				return false;
+			}
+		}
+		m_buffer[tail & m_mask] = a_word;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer: takes the oldest word.  Returns false if the channel is empty.
+	[[nodiscard]] bool TryPop(int& a_word) noexcept
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_cachedTail) {
+			m_cachedTail = m_tail.load(std::memory_order_acquire);
+			if (head == m_cachedTail) {
+				return false;
+			}
+		}
+		a_word = m_buffer[head & m_mask];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// True if the producer would find the channel full; for the producer only.
+	[[nodiscard]] bool IsFull() const noexcept { return m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_acquire) == m_buffer.size(); }
+
+	// True if the consumer would find the channel empty; for the consumer only.
+	[[nodiscard]] bool IsEmpty() const noexcept { return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire); }
+
+	// Producer: no more words will be added.
+	void Close() noexcept { m_closedFl.store(true, std::memory_order_release); }
+	[[nodiscard]] bool IsClosed() const noexcept { return m_closedFl.load(std::memory_order_acquire); }
+
+	// Consumer: no more words will be taken.
+	void Abandon() noexcept { m_abandonedFl.store(true, std::memory_order_release); }
+	[[nodiscard]] bool IsAbandoned() const noexcept { return m_abandonedFl.load(std::memory_order_acquire); }
+
+	[[nodiscard]] size_t GetCapacity() const noexcept { return m_buffer.size(); }
+
+private:
+	// Keeps the two sides' indexes on separate cache lines.
+	static constexpr size_t CacheLine = 64;
+
+	std::vector<int> m_buffer;
+	size_t m_mask;
+
+	// The next word to take, and the consumer's copy of m_tail
+	alignas(CacheLine) std::atomic<size_t> m_head{ 0 };
+	size_t m_cachedTail = 0;
+
+	// The next free slot, and the producer's copy of m_head
+	alignas(CacheLine) std::atomic<size_t> m_tail{ 0 };
+	size_t m_cachedHead = 0;
+
+	alignas(CacheLine) std::atomic<bool> m_closedFl{ false };
+	std::atomic<bool> m_abandonedFl{ false };
+};
@@ -0,0 +1,138 @@
+#include "Classifier.h"
+#include "stdafx.h"
+
+// The opcodes the classifier looks at.
+static constexpr int OpAdd = 1;
+static constexpr int OpLoad = 5;
+static constexpr int OpStore = 6;
+static constexpr int OpRead = 7;
+static constexpr int OpBranch = 9;
+static constexpr int OpBranchPlus = 12;
+static constexpr int OpHalt = 13;
+static constexpr int OpStoreIndex = 15;
+static constexpr int OpStoreIndexed = 19;
+static constexpr int OpReadBlock = 26;
+static constexpr int OpWriteBlock = 27;
+
+/// <summary>
+/// Classifies the words of the image.  If the code is read-only the reachable
+/// instructions are decoded for the emulator; ADD, SUB, MULT, DIV and LOAD of a word
+/// that is never written carry the value of the word.
+/// </summary>
+/// <returns>What the classification found</returns>
+Classifier::Report Classifier::Classify()
+{
+	Report report;
+
+	std::vector<char> reachable;
+	std::vector<int> written;
+	int extent = 0;
+	const bool staticWritesFl = FindReachable(m_emul, reachable, written, extent);
+
+	std::ranges::sort(written);
+	written.erase(std::ranges::unique(written).begin(), written.end());
+	report.m_writtenWords = written.size();
+	const auto isWritten = [&](int a_loc) { return std::ranges::binary_search(written, a_loc); };
+
+	for (int loc = 0; loc < std::max(extent, m_emul.GetClassifiedExtent()); ++loc) {
+		const Emulator::WordKind kind = m_emul.GetWordKind(loc);
+		report.m_codeWords += kind == Emulator::WordKind::CODE;
+		report.m_constantWords += kind == Emulator::WordKind::CONSTANT;
+		if (loc < extent && reachable[loc]) {
+			++report.m_reachableInstructions;
+			report.m_dataExecuted += kind != Emulator::WordKind::CODE;
+		}
+	}
+
+	report.m_readOnlyCodeFl = staticWritesFl && std::ranges::none_of(written, [&](int a_loc) { return a_loc < extent && reachable[a_loc]; });
+	if (!report.m_readOnlyCodeFl) {
+		return report;
+	}
+
+	std::vector<Emulator::DecodedInstruction> decoded(static_cast<size_t>(extent), Emulator::DecodedInstruction{ 0, 0, 0, false });
+	for (int loc = 0; loc < extent; ++loc) {
+		if (!reachable[loc]) {
+			continue;
+		}
+
+		const int word = m_emul.GetWord(loc);
+		const int opcode = m_config.GetOpCode(word);
+		const int operand = m_config.GetOperand(word);
+		if (opcode < OpAdd || opcode > OpHalt) {
+			continue;
+		}
+
+		const bool immediateFl = opcode <= OpLoad && !isWritten(operand);
+		decoded[loc] = { opcode, operand, immediateFl ? m_emul.GetWord(operand) : 0, immediateFl };
+		report.m_immediateOperands += immediateFl;
+	}
+
+	m_emul.SetDecodedInstructions(std::move(decoded));
+	return report;
+}
+
+/// <summary>
+/// Walks the control flow graph from location 100.  An instruction continues at the
+/// next location, at its branch target, or both; HALT and invalid opcodes end a path.
+/// The instructions of the extended machine all continue at the next location.
+/// </summary>
+/// <param name="a_emul">The emulator holding the image</param>
+/// <param name="a_reachable">Set to 1 for every reachable location below a_extent</param>
+/// <param name="a_written">The locations the reachable STORE and READ instructions write to</param>
+/// <param name="a_extent">Set to one past the highest reachable location</param>
+/// <returns>False if a reachable STOREX or READB writes to a location computed at run time</returns>
+bool Classifier::FindReachable(const Emulator& a_emul, std::vector<char>& a_reachable, std::vector<int>& a_written, int& a_extent)
+{
+	const MachineConfig& config = a_emul.GetConfig();
+	const int memorySize = config.GetMemorySize();
+	const int lastOpCode = config.IsExtended() ? OpWriteBlock : OpHalt;
+	bool staticWritesFl = true;
+	a_extent = 0;
+	if (memorySize <= 100) {
+		return staticWritesFl;
+	}
+
+	std::vector<int> pending{ 100 };
+	auto visit = [&](int a_loc) {
+		if (a_loc >= memorySize) {
+			return;
+		}
+		if (static_cast<size_t>(a_loc) >= a_reachable.size()) {
+			a_reachable.resize(static_cast<size_t>(a_loc) + 1, 0);
+		}
+		if (!a_reachable[a_loc]) {
+			a_reachable[a_loc] = 1;
+			pending.push_back(a_loc);
+		}
+	};
+
+	a_reachable.assign(101, 0);
+	a_reachable[100] = 1;
+	while (!pending.empty()) {
+		const int loc = pending.back();
+		pending.pop_back();
+
+		const int word = a_emul.GetWord(loc);
+		const int opcode = config.GetOpCode(word);
+		const int operand = config.GetOperand(word);
+		if (opcode > lastOpCode) {
+			continue;
+		}
+
+		if (opcode == OpStore || opcode == OpRead || opcode == OpStoreIndex) {
+			a_written.push_back(operand);
+		}
+		if (opcode == OpStoreIndexed || opcode == OpReadBlock) {
+			staticWritesFl = false;
+		}
+		if (opcode >= OpBranch && opcode <= OpBranchPlus) {
+			visit(operand);
+		}
+		if (opcode >= 1 && opcode <= lastOpCode && opcode != OpHalt && opcode != OpBranch) {
+			visit(loc + 1);
+		}
+	}
+
+	a_extent = static_cast<int>(a_reachable.size());
+	return staticWritesFl;
+}
@@ -0,0 +1,44 @@
+//
+//		Classifier class - static classification of the code and data of an assembled VC370 image.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Emulator.h"
+
+// Pass II records which words came from machine instructions and which from DC.  The
+// classifier combines that with the control flow from location 100 and the words the
+// reachable STORE and READ instructions can write.  The classic VC370 has no indirect
+// addressing, so these are all the words a run can change; a program of the extended
+// machine that uses STOREX or READB may write anywhere.  When no reachable instruction can be written,
+// the code is read-only: the emulator gets the reachable instructions decoded once, and
+// an operand word that is never written (a DC constant, typically) becomes an immediate.
+class Classifier {
+
+public:
+	// What the classification found.
+	struct Report {
+		size_t m_codeWords = 0;				// Words Pass II generated from machine instructions
+		size_t m_constantWords = 0;			// Words Pass II generated from DC
+		size_t m_reachableInstructions = 0;	// Instructions reachable from location 100
+		size_t m_writtenWords = 0;			// Words the reachable STORE and READ instructions write
+		size_t m_dataExecuted = 0;			// Reachable words that Pass II did not generate from machine instructions
+		size_t m_immediateOperands = 0;		// Reachable instructions whose operand word is never written
+		bool m_readOnlyCodeFl = false;		// No reachable instruction is ever written
+	};
+
+	explicit Classifier(Emulator& a_emul) noexcept : m_emul(a_emul), m_config(a_emul.GetConfig()) { }
+	~Classifier() = default;
+
+	// Classifies the image and, if its code is read-only, installs the decoded instructions in the emulator.
+	Report Classify();
+
+	// Marks the instructions reachable from location 100 and collects the locations the reachable
+	// STORE and READ instructions write to.  a_extent is set to one past the highest reachable location.
+	// Returns false if a reachable instruction writes to a location computed at run time.
+	[[nodiscard]] static bool FindReachable(const Emulator& a_emul, std::vector<char>& a_reachable, std::vector<int>& a_written, int& a_extent);
+
+private:
+	Emulator& m_emul;
+	MachineConfig m_config;
+};
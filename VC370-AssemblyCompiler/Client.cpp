@@ -0,0 +1,61 @@
+#include "Client.h"
+#include "stdafx.h"
+#include "Protocol.h"
+#include "ObjectModule.h"
+#include <fstream>
+#include <iterator>
+
+/// <summary>
+/// Sends one request to the daemon and prints the response the way the assembler prints
+/// its own results: the listing, then the errors or the output of the program.
+/// Files that start with the object file header are sent as object modules to be linked;
+/// any other file is sent as source.  Standard input is read to its end and sent as the
+/// input of the program.
+/// </summary>
+/// <param name="a_fileNames">The files to be sent</param>
+/// <param name="a_config">The machine a source is assembled for</param>
+/// <returns>0 if the program was run, 1 otherwise</returns>
+int Client::Run(const std::vector<std::string>& a_fileNames, const MachineConfig& a_config)
+{
+	Message request;
+	if (a_config.GetOperandDigits() != MachineConfig::ClassicOperandDigits) {
+		request.Add("WIDTH", std::to_string(a_config.GetOperandDigits()));
+	}
+	if (a_config.IsExtended()) {
+		request.Add("PROFILE", "EXTENDED");
+	}
+
+	for (const std::string& fileName : a_fileNames) {
+		std::ifstream file(fileName, std::ios::in | std::ios::binary);
+		if (!file) {
+			std::cerr << "File could not be opened: " << fileName << '\n';
+			return 1;
+		}
+		std::string text{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+		const bool objectFl = text.starts_with(std::string(ObjectModule::ObjectFileHeader) + '\n');
+		request.Add(objectFl ? "OBJECT" : "SOURCE", std::move(text));
+	}
+
+	std::string input{ std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>() };
+	request.Add("INPUT", std::move(input));
+
+	const Socket server = Socket::Connect(m_socketPath);
+	Message response;
+	if (!server.IsValid() || !request.Send(server) || !response.Receive(server)) {
+		std::cerr << "No response from the daemon at " << m_socketPath << '\n';
+		return 1;
+	}
+
+	const std::string* status = response.Find("STATUS");
+	if (status == nullptr || (*status != "OK" && *status != "ERRORS")) {
+		std::cerr << "Request refused: " << (status != nullptr ? *status : "no status") << '\n';
+		return 1;
+	}
+
+	for (const std::string_view section : { "LISTING", "ERRORS", "OUTPUT" }) {
+		if (const std::string* data = response.Find(section)) {
+			std::cout << *data;
+		}
+	}
+	return *status == "OK" ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+//
+//		Client class - sends programs to the assembler daemon and prints what it returns.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "MachineConfig.h"
+
+class Client {
+
+public:
+	explicit Client(std::string a_socketPath) : m_socketPath(std::move(a_socketPath)) { }
+	~Client() = default;
+
+	// Sends the files to the daemon with standard input as the program input.  Returns the exit code.
+	int Run(const std::vector<std::string>& a_fileNames, const MachineConfig& a_config);
+
+private:
+	std::string m_socketPath;
+};
@@ -0,0 +1,320 @@
+#include "Debugger.h"
+#include "stdafx.h"
+
+/// <summary>
+/// Starts debugging an instance of a program image.  The first snapshot is the state
+/// before the first instruction.
+/// </summary>
+/// <param name="a_image">The assembled program; it must not have errors</param>
+/// <param name="a_input">The input of the program</param>
+/// <param name="a_out">Where the program writes</param>
+/// <param name="a_interval">The instructions between two snapshots</param>
+Debugger::Debugger(std::shared_ptr<const Emulator> a_image, std::istream& a_input, std::ostream& a_out, unsigned long long a_interval)
+	: m_emul(std::move(a_image))
+	, m_input(a_input)
+	, m_out(a_out)
+	, m_interval(std::max(a_interval, 1ULL))
+{
+	// Every instruction is executed, so the times are those of the program as written
+	m_emul.m_successors.reset();
+	m_emul.m_instructionLimit = 0;
+	m_emul.m_instructionCount = 0;
+
+	m_history.resize(m_emul.m_memory.GetPageCount());
+	m_snapshots.push_back({ m_loc, 0, 0, 0, {}, {} });
+}
+
+/// <summary>
+/// Goes to the state after a_time instructions.  Going back, or forward past a snapshot,
+/// restores the last snapshot before a_time first, so only the instructions after it
+/// are executed again.
+/// </summary>
+/// <param name="a_time">The number of instructions executed</param>
+void Debugger::GoTo(unsigned long long a_time)
+{
+	const size_t snapshot = static_cast<size_t>(std::min<unsigned long long>(a_time / m_interval, m_snapshots.size() - 1));
+	if (a_time < GetTime() || snapshot * m_interval > GetTime()) {
+		Restore(snapshot);
+	}
+	Advance(a_time);
+}
+
+/// <summary>
+/// Finds the last instruction before the current time that wrote a word, by STORE or READ
+/// (or by the index register and block READ instructions of the extended machine).
+/// The intervals between snapshots are searched from the latest back; an interval is only
+/// executed again if the page of the word was written in it.
+/// </summary>
+/// <param name="a_addr">The address of the word</param>
+/// <returns>True if the debugger went back to just before the write</returns>
+bool Debugger::RunBackToWrite(int a_addr)
+{
+	const unsigned long long start = GetTime();
+	if (start == 0) {
+		return false;
+	}
+
+	const int pageNum = a_addr >> GuestMemory::PAGEBITS;
+	unsigned long long end = start;
+	for (size_t i = static_cast<size_t>((start - 1) / m_interval); ; --i) {
+		// The next snapshot lists every page written since this one
+		const bool writtenFl = i + 1 >= m_snapshots.size()
+			|| std::ranges::binary_search(m_snapshots[i + 1].m_pages, pageNum);
+
+		if (writtenFl) {
+			Restore(i);
+			unsigned long long found = 0;
+			while (GetTime() < end && !m_finishedFl) {
+				const int opCode = m_emul.m_config.GetOpCode(m_emul.m_memory.Read(m_loc));
+				const bool writesFl = m_emul.WritesTo(m_loc, a_addr);
+				const unsigned long long time = GetTime();
+				Advance(time + 1);
+				// A READ without valid input stops the program without writing
+				if (writesFl && GetTime() == time + 1 && !((opCode == 7 || opCode == 26) && m_finishedFl)) {
+					found = GetTime();
+				}
+			}
+			if (found != 0) {
+				GoTo(found - 1);
+				return true;
+			}
+		}
+
+		end = i * m_interval;
+		if (i == 0) {
+			break;
+		}
+	}
+
+	GoTo(start);
+	return false;
+}
+
+/// <summary>
+/// Runs forward until a_time instructions have been executed or the program stops.
+/// Execution stops at every multiple of the interval for the snapshots.  The output of
+/// WRITE and the input errors are only shown when the run gets past the furthest time
+/// reached before.
+/// </summary>
+/// <param name="a_time">The number of instructions to reach</param>
+void Debugger::Advance(unsigned long long a_time)
+{
+	while (!m_finishedFl && GetTime() < a_time) {
+		const unsigned long long nextSnapshot = (GetTime() / m_interval + 1) * m_interval;
+		m_emul.m_instructionLimit = std::min(a_time, nextSnapshot);
+
+		switch (m_emul.Execute(m_loc))
+		{
+			case Emulator::StopReason::READ:
+				if (!ReadInput()) {
+					if (GetTime() > m_frontier) {
+						m_out << Emulator::InvalidInputMessage;
+					}
+					m_finishedFl = true;
+					break;
+				}
+				++m_loc;
+				break;
+			case Emulator::StopReason::WRITE:
+				if (GetTime() > m_frontier) {
+					for (int i = 0; i < m_emul.TransferCount(m_loc); ++i) {
+						m_out << m_emul.m_memory.Read(m_emul.TransferAddress(m_loc, i)) << '\n';
+					}
+				}
+				++m_loc;
+				break;
+			case Emulator::StopReason::INSTRUCTION_LIMIT:
+				break;
+			case Emulator::StopReason::DIVISION_BY_ZERO:
+				if (GetTime() > m_frontier) {
+					m_out << Emulator::DivisionByZeroMessage;
+				}
+				m_finishedFl = true;
+				break;
+			default:
+				m_finishedFl = true;
+				break;
+		}
+
+		m_frontier = std::max(m_frontier, GetTime());
+		if (!m_finishedFl && GetTime() % m_interval == 0) {
+			MarkSnapshot(static_cast<size_t>(GetTime() / m_interval));
+		}
+	}
+	m_emul.m_instructionLimit = 0;
+}
+
+/// <summary>
+/// Records the state at a multiple of the interval.  The first time it is reached the
+/// pages written since the previous snapshot are saved.  When it is reached again by
+/// running forward from an earlier snapshot, the state is the one already saved, so the
+/// changes are only tracked from it from now on.
+/// </summary>
+/// <param name="a_index">The index of the snapshot</param>
+void Debugger::MarkSnapshot(size_t a_index)
+{
+	if (a_index < m_snapshots.size()) {
+		std::vector<int> pages;
+		m_emul.m_memory.TakeDirtyPages(pages);
+		m_base = a_index;
+		return;
+	}
+
+	Snapshot snapshot{ m_loc, m_emul.m_accum, m_emul.m_index, m_inputPos, {}, {} };
+	m_emul.m_memory.TakeDirtyPages(snapshot.m_pages);
+	std::ranges::sort(snapshot.m_pages);
+	snapshot.m_words.resize(snapshot.m_pages.size() * GuestMemory::PAGESZ);
+	for (size_t i = 0; i < snapshot.m_pages.size(); ++i) {
+		const size_t offset = i * GuestMemory::PAGESZ;
+		m_emul.m_memory.ReadPage(snapshot.m_pages[i], snapshot.m_words.data() + offset);
+		m_history[snapshot.m_pages[i]].push_back({ a_index, offset });
+	}
+	m_snapshots.push_back(std::move(snapshot));
+	m_base = a_index;
+}
+
+/// <summary>
+/// Puts the run back to a snapshot.  Only the pages that can differ are copied: those
+/// written since the snapshot the memory is tracked from, and those saved by the
+/// snapshots between that one and the target.
+/// </summary>
+/// <param name="a_index">The index of the snapshot</param>
+void Debugger::Restore(size_t a_index)
+{
+	std::vector<int> pages;
+	m_emul.m_memory.TakeDirtyPages(pages);
+	for (size_t i = std::min(a_index, m_base) + 1; i <= std::max(a_index, m_base); ++i) {
+		pages.insert(pages.end(), m_snapshots[i].m_pages.begin(), m_snapshots[i].m_pages.end());
+	}
+	std::ranges::sort(pages);
+	pages.erase(std::ranges::unique(pages).begin(), pages.end());
+
+	for (const int pageNum : pages) {
+		m_emul.m_memory.WritePage(pageNum, PageAt(pageNum, a_index));
+	}
+	m_emul.m_memory.TakeDirtyPages(pages);
+	m_base = a_index;
+
+	const Snapshot& snapshot = m_snapshots[a_index];
+	m_loc = snapshot.m_loc;
+	m_emul.m_accum = snapshot.m_accum;
+	m_emul.m_index = snapshot.m_index;
+	m_inputPos = snapshot.m_inputPos;
+	m_emul.m_instructionCount = a_index * m_interval;
+	m_finishedFl = false;
+}
+
+/// <summary>
+/// Finds the words of a page at a snapshot: those saved by the last snapshot up to it
+/// that saved the page.
+/// </summary>
+/// <param name="a_pageNum">The number of the page</param>
+/// <param name="a_snapshot">The index of the snapshot</param>
+/// <returns>The PAGESZ words, or null if no snapshot saved the page, so it is that of the image</returns>
+const int* Debugger::PageAt(int a_pageNum, size_t a_snapshot) const
+{
+	const auto& versions = m_history[a_pageNum];
+	const auto it = std::ranges::upper_bound(versions, a_snapshot, {}, &PageVersion::m_snapshot);
+	if (it == versions.begin()) {
+		return nullptr;
+	}
+	const PageVersion& version = *std::prev(it);
+	return m_snapshots[version.m_snapshot].m_words.data() + version.m_offset;
+}
+
+/// <summary>
+/// Completes the READ at the current location with the next values of the input tape,
+/// one for each word it reads.  The tape is extended from the input the first time a
+/// value is needed, so the run reads the same values when it is repeated.
+/// </summary>
+/// <returns>False if the input ran out or a value is not an integer</returns>
+bool Debugger::ReadInput()
+{
+	const int count = m_emul.TransferCount(m_loc);
+	for (int i = 0; i < count; ++i) {
+		if (m_inputPos == m_tape.size()) {
+			std::string value;
+			if (!(m_input >> value)) {
+				return false;
+			}
+			m_tape.push_back(std::move(value));
+			if (GetTime() > m_frontier) {
+				m_out << "? " << m_tape.back() << '\n';
+			}
+		}
+		if (!m_emul.StoreInput(m_emul.TransferAddress(m_loc, i), m_tape[m_inputPos++])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Reads debugger commands, one per line:
+///		s [n]	steps n instructions forward (1 if n is missing)
+///		b [n]	steps n instructions back
+///		g t		goes to the state after t instructions
+///		w a		goes back to just before the last write of address a
+///		c		continues until the program stops
+///		p a		prints the word at address a
+///		i		shows the state
+///		q		quits
+/// The state is shown after every command.
+/// </summary>
+/// <param name="a_commands">The commands</param>
+/// <param name="a_out">Where the state and the answers go</param>
+void Debugger::Interact(std::istream& a_commands, std::ostream& a_out)
+{
+	ShowState(a_out);
+
+	std::string line;
+	while (std::getline(a_commands, line)) {
+		std::istringstream words(line);
+		std::string command;
+		long long value = 0;
+		words >> command;
+		const bool valueFl = static_cast<bool>(words >> value) && value >= 0;
+
+		if (command == "q") {
+			break;
+		}
+		if (command == "s") {
+			StepForward(valueFl ? value : 1);
+		}
+		else if (command == "b") {
+			StepBack(valueFl ? value : 1);
+		}
+		else if (command == "g" && valueFl) {
+			GoTo(value);
+		}
+		else if (command == "w" && valueFl && value < m_emul.m_config.GetMemorySize()) {
+			if (!RunBackToWrite(static_cast<int>(value))) {
+				a_out << std::format("No write to {} before this point\n", value);
+			}
+		}
+		else if (command == "c") {
+			Continue();
+		}
+		else if (command == "p" && valueFl && value < m_emul.m_config.GetMemorySize()) {
+			a_out << std::format("[{}] = {}\n", value, GetWord(static_cast<int>(value)));
+			continue;
+		}
+		else if (command != "i") {
+			a_out << "Commands: s [n], b [n], g <time>, w <address>, c, p <address>, i, q\n";
+			continue;
+		}
+		ShowState(a_out);
+	}
+}
+
+/// <summary>
+/// Prints the time, the location, the accumulator (and the index register of the extended
+/// machine) and the next instruction.
+/// </summary>
+/// <param name="a_out">The stream</param>
+void Debugger::ShowState(std::ostream& a_out) const
+{
+	const std::string next = m_loc < m_emul.m_config.GetMemorySize() ? m_emul.GetMemoryContent(m_loc) : "";
+	const std::string index = m_emul.m_config.IsExtended() ? std::format(" idx {}", m_emul.m_index) : "";
+	a_out << std::format("time {} loc {} acc {}{} next {}{}\n", GetTime(), m_loc, GetAccumulator(), index, next, m_finishedFl ? " (stopped)" : "");
+}
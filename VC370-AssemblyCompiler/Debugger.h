@@ -0,0 +1,110 @@
+//
+//		Debugger class - time-travel debugging of a VC370 program by snapshots and re-execution.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Emulator.h"
+#include <limits>
+#include <memory>
+
+// The debugger runs an instance of a program image and takes a snapshot every m_interval
+// instructions: the location, the accumulator, the position on the input tape and the
+// memory pages written since the previous snapshot.  The input the program reads is kept
+// on a tape, so running forward from a snapshot repeats the original run exactly.  Going
+// back restores the nearest snapshot before the target and runs forward from it, so it
+// takes time proportional to the interval rather than to the length of the run.
+class Debugger {
+
+public:
+	static constexpr unsigned long long DefaultInterval = 100'000;
+
+	// Debugs an instance of a_image that reads a_input and writes to a_out.
+	Debugger(std::shared_ptr<const Emulator> a_image, std::istream& a_input, std::ostream& a_out, unsigned long long a_interval = DefaultInterval);
+
+	// Prevent copying
+	Debugger(const Debugger&) = delete;
+	Debugger& operator=(const Debugger&) = delete;
+
+	// Goes to the state after a_time instructions, or to the end of the program if it stops before.
+	void GoTo(unsigned long long a_time);
+
+	// Goes a_count instructions forward or back.
+	void StepForward(unsigned long long a_count) { GoTo(GetTime() + a_count); }
+	void StepBack(unsigned long long a_count) { GoTo(GetTime() - std::min(a_count, GetTime())); }
+
+	// Runs until the program stops.
+	void Continue() { GoTo(std::numeric_limits<unsigned long long>::max()); }
+
+	// Goes back to just before the last instruction that wrote a_addr.  Returns false, without moving, if none did.
+	bool RunBackToWrite(int a_addr);
+
+	// The number of instructions executed.
+	[[nodiscard]] unsigned long long GetTime() const noexcept { return m_emul.m_instructionCount; }
+
+	// The location of the next instruction.
+	[[nodiscard]] int GetLocation() const noexcept { return m_loc; }
+
+	// The accumulator.
+	[[nodiscard]] int GetAccumulator() const noexcept { return m_emul.m_accum; }
+
+	// The word stored at a location.
+	[[nodiscard]] int GetWord(int a_addr) const noexcept { return m_emul.GetWord(a_addr); }
+
+	// Returns true if the program has stopped at the current time.
+	[[nodiscard]] bool IsFinished() const noexcept { return m_finishedFl; }
+
+	// The number of snapshots taken.
+	[[nodiscard]] size_t GetSnapshotCount() const noexcept { return m_snapshots.size(); }
+
+	// Reads commands until the end of a_commands or "q", reporting the state after each one.
+	void Interact(std::istream& a_commands, std::ostream& a_out);
+
+private:
+	// The state of the run after m_interval * (its index) instructions.
+	struct Snapshot {
+		int m_loc;
+		int m_accum;
+		int m_index;				// The index register of the extended machine
+		size_t m_inputPos;			// The input values read
+		std::vector<int> m_pages;	// The pages written since the previous snapshot, in ascending order
+		std::vector<int> m_words;	// Their words, PAGESZ per page
+	};
+
+	// A page stored by a snapshot.
+	struct PageVersion {
+		size_t m_snapshot;			// The index of the snapshot
+		size_t m_offset;			// Where the page starts in the words of the snapshot
+	};
+
+	// Runs forward until a_time or until the program stops, taking the snapshots on the way.
+	void Advance(unsigned long long a_time);
+
+	// Called every m_interval instructions: takes a snapshot, or starts tracking the changes from the existing one.
+	void MarkSnapshot(size_t a_index);
+
+	// Goes back (or forward) to a snapshot.
+	void Restore(size_t a_index);
+
+	// The words of a page at a snapshot, or null if it is still the page of the image.
+	[[nodiscard]] const int* PageAt(int a_pageNum, size_t a_snapshot) const;
+
+	// Completes a READ (every word of a READB) from the input tape.  Returns false if the input ran out or is not an integer.
+	[[nodiscard]] bool ReadInput();
+
+	// Prints the state: time, location, accumulator and the next instruction.
+	void ShowState(std::ostream& a_out) const;
+
+	Emulator m_emul;							// The instance being debugged
+	std::istream& m_input;						// Where the input tape is read from
+	std::ostream& m_out;						// Where the program writes
+	unsigned long long m_interval;				// The instructions between two snapshots
+	int m_loc = Emulator::EntryLocation;		// The location of the next instruction
+	bool m_finishedFl = false;					// True if the program stopped
+	size_t m_inputPos = 0;						// The next value on the input tape
+	std::vector<std::string> m_tape;			// The input read so far
+	unsigned long long m_frontier = 0;			// The furthest time reached; output is only shown the first time
+	std::vector<Snapshot> m_snapshots;
+	std::vector<std::vector<PageVersion>> m_history;	// The snapshots that stored each page, in order
+	size_t m_base = 0;							// The snapshot the dirty pages of the memory are relative to
+};
@@ -1,56 +1,241 @@
 #include "Emulator.h"
 #include "Error.h"
+#include "HardwareProfile.h"
+#include "Metrics.h"
+#include "Probes.h"
 #include "stdafx.h"
+#include <limits>
+#include <optional>
 
 /// <summary>
 /// The default constructor for the Emulator class.
 /// </summary>
 /// <author>Hristo Denev</author>
 /// <date>11/19/2023</date>
-Emulator::Emulator()
-	: m_memory{}
-	, m_memoryContents{}
+Emulator::Emulator(const MachineConfig& a_config)
+	: m_config(a_config)
+	, m_memory(a_config.GetMemorySize())
+	, m_invalidParts{}
 	, m_accum(0)
 {
 }
 
+/// <summary>
+/// Creates an instance of a shared program image.  The instance reads the memory of the
+/// image until it writes to a page, so starting it costs a page table instead of a copy of
+/// the memory.  The image must not change while its instances exist.
+/// </summary>
+/// <param name="a_image">The emulator holding the assembled program</param>
+Emulator::Emulator(std::shared_ptr<const Emulator> a_image)
+	: m_config(a_image->m_config)
+	, m_memory(std::shared_ptr<const GuestMemory>(a_image, &a_image->m_memory))
+	, m_invalidParts(a_image->m_invalidParts)
+	, m_wordKinds(a_image->m_wordKinds)
+	, m_accum(0)
+	, m_instructionLimit(a_image->m_instructionLimit)
+	, m_successors(a_image->m_successors)
+	, m_decoded(a_image->m_decoded)
+	, m_loops(a_image->m_loops)
+{
+}
+
+/// <summary>
+/// Creates a classic machine whose memory is a complete image, such as one assembled at
+/// compile time by StaticAssembler.  The words are copied as they are; nothing is parsed.
+/// </summary>
+/// <param name="a_image">The words of the memory</param>
+/// <param name="a_extendedFl">True if the image uses the extended instruction set</param>
+Emulator::Emulator(const std::array<int, MEMSZ>& a_image, bool a_extendedFl)
+	: Emulator(MachineConfig(MachineConfig::ClassicOperandDigits, a_extendedFl))
+{
+	for (int loc = 0; loc < MEMSZ; ++loc) {
+		if (a_image[loc] != 0) {
+			m_memory.Write(loc, a_image[loc]);
+		}
+	}
+}
+
 /// <summary>
 /// Inserts a memory location and contents into the emulator's memory.
 /// </summary>
 /// <param name="a_location">The location of the memory</param>
 /// <param name="opCode">The operation code</param>
 /// <param name="operand">The operand value</param>
+/// <param name="a_kind">What Pass II generated the word from</param>
 /// <returns>True if the memory was inserted successfully</returns>
 /// <author>Hristo Denev</author>
 /// <date>11/19/2023</date>
-bool Emulator::InsertMemory(int a_location, int opCode, int operand)
+bool Emulator::InsertMemory(int a_location, int opCode, int operand, WordKind a_kind)
 {
-	if (a_location >= MEMSZ || a_location < 0) {
+	if (a_location >= m_config.GetMemorySize() || a_location < 0) {
 		Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MEMORY_OVERFLOW, a_location));
 		return false;
 	}
 
-	// If the opCode is -1, the operand is invalid and, therefore, the memory location is empty
-	if (opCode == -1) {
-		m_memoryContents[a_location] = "??";
-		opCode = 0;
+	// An invalid part of the word is stored as zero and remembered for the listing
+	const unsigned char invalidParts = (opCode == -1 ? 1 : 0) | (operand == -1 ? 2 : 0);
+	if (invalidParts != 0) {
+		m_invalidParts[a_location] = invalidParts;
+		opCode = std::max(opCode, 0);
+		operand = std::max(operand, 0);
 	}
 	else {
-		m_memoryContents[a_location] = std::format("{:02d}", opCode);
+		m_invalidParts.erase(a_location);
+	}
+
+	m_memory.Write(a_location, m_config.MakeWord(opCode, operand));
+
+	if (a_kind != WordKind::UNKNOWN && static_cast<size_t>(a_location) >= m_wordKinds.size()) {
+		m_wordKinds.resize(static_cast<size_t>(a_location) + 1, WordKind::UNKNOWN);
+	}
+	if (static_cast<size_t>(a_location) < m_wordKinds.size()) {
+		m_wordKinds[a_location] = a_kind;
+	}
+
+	// The successors, the decoded instructions and the loops were worked out for the old contents of the memory
+	m_successors.reset();
+	m_decoded.reset();
+	m_loops.reset();
+	
+	return true;
+}
+
+/// <summary>
+/// Puts an instance of an image back to the state it was created in, ready for another
+/// run.  Only the memory pages written since the last reset are restored, so running a
+/// program many times on one instance costs the pages it writes rather than the whole
+/// memory.  The memory of an emulator that owns its program is its only copy of the
+/// program, so it is left as it is.
+/// </summary>
+void Emulator::Reset()
+{
+	if (m_memory.HasImage()) {
+		m_memory.Reset();
+	}
+	ResetRegisters();
+}
+
+/// <summary>
+/// Sets the registers and the counts of the last run to zero.
+/// </summary>
+void Emulator::ResetRegisters() noexcept
+{
+	m_accum = 0;
+	m_index = 0;
+	m_instructionCount = 0;
+	m_instructionsSaved = 0;
+	m_iterationsAccelerated = 0;
+}
+
+/// <summary>
+/// Empties the machine so that the assembler can insert another program.  The words
+/// written are zeroed, and a paged memory keeps its pages, so assembling many programs
+/// on one emulator does not allocate their memory again.  Watchpoints are removed too.
+/// </summary>
+void Emulator::Clear()
+{
+	m_memory.Reset();
+	ResetRegisters();
+	m_invalidParts.clear();
+	m_wordKinds.clear();
+	m_successors.reset();
+	m_decoded.reset();
+	m_loops.reset();
+	m_watchpoints.clear();
+}
+
+/// <summary>
+/// Installs the successors found by the Optimizer.  Instances of the image share them.
+/// </summary>
+/// <param name="a_successors">The successors of the locations below a_successors.size()</param>
+void Emulator::SetSuccessors(std::vector<Successor> a_successors)
+{
+	m_successors = std::make_shared<const std::vector<Successor>>(std::move(a_successors));
+}
+
+/// <summary>
+/// Installs the instructions decoded by the Classifier.  Instances of the image share them.
+/// </summary>
+/// <param name="a_decoded">The decoded instructions of the locations below a_decoded.size()</param>
+void Emulator::SetDecodedInstructions(std::vector<DecodedInstruction> a_decoded)
+{
+	m_decoded = std::make_shared<const std::vector<DecodedInstruction>>(std::move(a_decoded));
+}
+
+/// <summary>
+/// Installs the loops found by the LoopAccelerator.  Instances of the image share them.
+/// An iteration is followed once the way the emulator runs it, through the successors,
+/// to count the instructions it executes and saves; a loop whose path leaves it is dropped.
+/// </summary>
+/// <param name="a_loops">The loops</param>
+/// <returns>The number of loops installed</returns>
+size_t Emulator::SetLoops(std::vector<Loop> a_loops)
+{
+	const auto successor = [this](int a_loc) -> const Successor* {
+		return m_successors && static_cast<size_t>(a_loc) < m_successors->size() ? &(*m_successors)[a_loc] : nullptr;
+	};
+
+	auto table = std::make_shared<LoopTable>();
+	for (Loop& loop : a_loops) {
+		int loc = loop.m_head;
+		loop.m_executed = 1;	// The branch
+		loop.m_saved = 0;
+		if (const Successor* branch = successor(loop.m_branch); branch != nullptr && branch->m_target >= 0) {
+			loc = branch->m_target;
+			loop.m_saved = branch->m_targetSaved;
+		}
+		while (loc >= loop.m_head && loc < loop.m_branch) {
+			++loop.m_executed;
+			if (const Successor* next = successor(loc); next != nullptr) {
+				loop.m_saved += next->m_nextSaved;
+				loc = next->m_next;
+			}
+			else {
+				++loc;
+			}
+		}
+		if (loc != loop.m_branch) {
+			continue;
+		}
+
+		if (static_cast<size_t>(loop.m_branch) >= table->m_at.size()) {
+			table->m_at.resize(static_cast<size_t>(loop.m_branch) + 1, -1);
+		}
+		table->m_at[loop.m_branch] = static_cast<int>(table->m_loops.size());
+		table->m_loops.push_back(std::move(loop));
 	}
 
+	const size_t installed = table->m_loops.size();
+	m_loops = std::move(table);
+	return installed;
+}
+
+/// <summary>
+/// Formats a word the way it is shown in the listing.
+/// </summary>
+/// <param name="opCode">The operation code, -1 if it is invalid</param>
+/// <param name="operand">The operand value, -1 if it is invalid</param>
+/// <param name="operandDigits">The number of digits of an operand</param>
+/// <returns>The digits of the word with "?" for the invalid parts</returns>
+std::string Emulator::FormatMemoryContent(int opCode, int operand, int operandDigits)
+{
+	// If the opCode is -1, the operand is invalid and, therefore, the memory location is empty
+	std::string contents = opCode == -1 ? "??" : std::format("{:02d}", opCode);
+
 	// If the operand is -1, the operand is invalid and, therefore, the memory location is empty
 	if (operand == -1) {
-		m_memoryContents[a_location] += "????";
-		operand = 0;
+		contents.append(operandDigits, '?');
+	}
+	else if (operandDigits == MachineConfig::ClassicOperandDigits) {
+		contents += std::format("{:04d}", operand);
 	}
 	else {
-		m_memoryContents[a_location] += std::format("{:04d}", operand);
+		const std::string digits = std::to_string(operand);
+		contents.append(std::max(0, operandDigits - static_cast<int>(digits.size())), '0');
+		contents += digits;
 	}
 
-	m_memory[a_location] = opCode * 10000 + operand;
-	
-	return true;
+	return contents;
 }
 
 /// <summary>
@@ -62,112 +247,747 @@ bool Emulator::InsertMemory(int a_location, int opCode, int operand)
 /// <date>11/17/2023</date>
 std::string Emulator::GetMemoryContent(int a_location) const
 {
-	if (a_location >= MEMSZ || a_location < 0) {
+	if (a_location >= m_config.GetMemorySize() || a_location < 0) {
 		Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MEMORY_OVERFLOW, a_location));
-		return "??????";
+		return std::string(m_config.GetWordDigits(), '?');
 	}
 
-	return m_memoryContents[a_location];
+	const int word = m_memory.Read(a_location);
+	const auto invalid = m_invalidParts.find(a_location);
+	const unsigned char invalidParts = invalid == m_invalidParts.end() ? 0 : invalid->second;
+
+	return FormatMemoryContent((invalidParts & 1) ? -1 : m_config.GetOpCode(word),
+		(invalidParts & 2) ? -1 : m_config.GetOperand(word), m_config.GetOperandDigits());
 }
 
 /// <summary>
 /// The function that runs the VC370 program recorded in memory.
+/// A program with errors is not run; the errors are displayed instead.
 /// </summary>
+/// <param name="a_in">The stream READ takes its input from</param>
+/// <param name="a_out">The stream WRITE and the prompts go to</param>
 /// <returns>Return true if the program was run successfully</returns>
 /// <author>Hristo Denev</author>
 /// <date>NOT IMPLEMENTED YET</date>
-bool Emulator::RunProgram()
+bool Emulator::RunProgram(std::istream& a_in, std::ostream& a_out)
 {
+	m_instructionCount = 0;
+	m_instructionsSaved = 0;
+	m_iterationsAccelerated = 0;
+
 	if (Error::WasThereErrors()) {
-		Error::DisplayErrors();
-		exit(-1);
+		Error::DisplayErrors(a_out);
+		return false;
+	}
+
+	const Io io{
+		[&](std::string& a_line) {
+			a_out << "? ";
+			a_in >> a_line;
+			return static_cast<bool>(a_in);
+		},
+		[&](int a_value) { a_out << a_value << '\n'; }
+	};
+	switch (Run(io)) {
+		case RunStatus::HALTED:
+			return true;
+		case RunStatus::INVALID_INPUT:
+			a_out << InvalidInputMessage;
+			break;
+		case RunStatus::INSTRUCTION_LIMIT:
+			a_out << InstructionLimitMessage;
+			break;
+		case RunStatus::DIVISION_BY_ZERO:
+			a_out << DivisionByZeroMessage;
+			break;
+		default:
+			break;
 	}
+	return false;
+}
+
+/// <summary>
+/// Runs the program from location 100 with input and output supplied by the caller,
+/// e.g. a service that embeds the emulator.  Input that is missing or not an integer
+/// ends the run, as does a division by zero; running off the end of memory ends it silently.
+/// </summary>
+/// <param name="a_io">The functions READ and WRITE call</param>
+/// <returns>How the run ended</returns>
+Emulator::RunStatus Emulator::Run(const Io& a_io)
+{
+	m_instructionCount = 0;
+	m_instructionsSaved = 0;
+	m_iterationsAccelerated = 0;
+
+	Metrics::ScopedTimer timer(Metrics::Phase::EMULATION);
 
-	int loc = 100;
+	int loc = EntryLocation;
 	std::string line;
 	m_accum = 0;
+	m_index = 0;
+
+	// The pages of the watched words stay read-only while the program runs
+	std::optional<PageGuard> guard;
+	if (!m_watchpoints.empty()) {
+		std::vector<std::pair<PageGuard::Region, int>> watched;
+		for (const int addr : m_watchpoints) {
+			watched.emplace_back(m_memory.GetRegion(addr), addr);
+		}
+		m_guard = &guard.emplace(watched);
+	}
+
+	// The counters only count the run, with the reads and writes of the program
+	if (m_profile != nullptr) {
+		m_profile->Start();
+	}
+
+	VC370_PROBE1(run__start, loc);
+	std::optional<RunStatus> status;
+	while (!status) {
+		const StopReason reason = Execute(loc);
+		VC370_PROBE3(run__block, loc, static_cast<int>(reason), m_instructionCount);
+		switch (reason)
+		{
+			case StopReason::READ: {
+				const int count = TransferCount(loc);
+				for (int i = 0; i < count && !status; ++i) {
+					const int addr = TransferAddress(loc, i);
+					// If the input is not an integer, the run ends with an error
+					if (!a_io.m_read(line) || !StoreInput(addr, line)) {
+						status = RunStatus::INVALID_INPUT;
+					}
+					else {
+						VC370_PROBE3(read, loc, addr, m_memory.Read(addr));
+						if (m_guard != nullptr) {
+							CheckWatchpoints(loc);
+						}
+					}
+				}
+				if (!status) {
+					loc = FallThrough(loc);
+				}
+				break;
+			}
+			case StopReason::WRITE: {
+				const int count = TransferCount(loc);
+				for (int i = 0; i < count; ++i) {
+					const int addr = TransferAddress(loc, i);
+					VC370_PROBE3(write, loc, addr, m_memory.Read(addr));
+					a_io.m_write(m_memory.Read(addr));
+				}
+				loc = FallThrough(loc);
+				break;
+			}
+			case StopReason::HALT:
+				VC370_PROBE2(halt, loc, m_instructionCount);
+				status = RunStatus::HALTED;
+				break;
+			case StopReason::INSTRUCTION_LIMIT:
+				status = RunStatus::INSTRUCTION_LIMIT;
+				break;
+			case StopReason::DIVISION_BY_ZERO:
+				status = RunStatus::DIVISION_BY_ZERO;
+				break;
+			default:
+				status = RunStatus::END_OF_MEMORY;
+				break;
+		}
+	}
+
+	m_guard = nullptr;
+	if (m_profile != nullptr) {
+		m_profile->Stop();
+	}
+	VC370_PROBE2(run__done, *status == RunStatus::HALTED, m_instructionCount);
+
+	Metrics::Count(Metrics::Counter::INSTRUCTIONS_RETIRED, m_instructionCount);
+	Metrics::Count(Metrics::Counter::INSTRUCTIONS_SAVED, m_instructionsSaved);
+	Metrics::Count(Metrics::Counter::ITERATIONS_ACCELERATED, m_iterationsAccelerated);
+	return *status;
+}
+
+/// <summary>
+/// Runs a copy of a program as a coroutine.  The session suspends on READ until the
+/// driver provides a line of input and on WRITE until the driver has taken the value,
+/// so one thread can interleave any number of interactive sessions.  The image is held
+/// by the coroutine frame, so a waiting session costs only its memory and the frame.
+/// Unlike RunProgram it does not check for assembly errors; an image with errors
+/// should not be started.
+/// </summary>
+/// <param name="a_image">The emulator holding the program; the session runs on its own copy</param>
+/// <returns>The session, suspended before the first instruction</returns>
+EmulatorSession Emulator::StartSession(Emulator a_image)
+{
+	a_image.m_instructionCount = 0;
+	a_image.m_instructionsSaved = 0;
+	a_image.m_iterationsAccelerated = 0;
+	a_image.m_accum = 0;
+	a_image.m_index = 0;
+	a_image.m_profile = nullptr;	// The session may be resumed on another thread
+	int loc = EntryLocation;
+
+	std::string_view error;		// Stays empty if the program halts
+	bool runningFl = true;
+	while (runningFl) {
+		switch (a_image.Execute(loc))
+		{
+			case StopReason::READ: {
+				const int count = a_image.TransferCount(loc);
+				for (int i = 0; i < count && runningFl; ++i) {
+					const std::string line = co_await EmulatorSession::Input{};
+					if (!a_image.StoreInput(a_image.TransferAddress(loc, i), line)) {
+						error = InvalidInputMessage;
+						runningFl = false;
+					}
+				}
+				if (runningFl) {
+					loc = a_image.FallThrough(loc);
+				}
+				break;
+			}
+			case StopReason::WRITE: {
+				const int count = a_image.TransferCount(loc);
+				for (int i = 0; i < count; ++i) {
+					co_yield a_image.m_memory.Read(a_image.TransferAddress(loc, i));
+				}
+				loc = a_image.FallThrough(loc);
+				break;
+			}
+			case StopReason::HALT:
+				runningFl = false;
+				break;
+			case StopReason::INSTRUCTION_LIMIT:
+				error = InstructionLimitMessage;
+				runningFl = false;
+				break;
+			case StopReason::DIVISION_BY_ZERO:
+				error = DivisionByZeroMessage;
+				runningFl = false;
+				break;
+			default:
+				error = EndOfMemoryMessage;
+				runningFl = false;
+				break;
+		}
+	}
+
+	Metrics::Count(Metrics::Counter::INSTRUCTIONS_RETIRED, a_image.m_instructionCount);
+	Metrics::Count(Metrics::Counter::INSTRUCTIONS_SAVED, a_image.m_instructionsSaved);
+	Metrics::Count(Metrics::Counter::ITERATIONS_ACCELERATED, a_image.m_iterationsAccelerated);
+	co_return error;
+}
+
+/// <summary>
+/// Executes instructions from a_loc until one needs the outside world (READ or WRITE)
+/// or the program stops.  READ and WRITE are left for the caller to complete, with
+/// a_loc still at the instruction.
+/// </summary>
+/// <param name="a_loc">The location of the next instruction; updated as the program runs</param>
+/// <returns>Why execution stopped</returns>
+Emulator::StopReason Emulator::Execute(int& a_loc)
+{
+	// Only a run with watchpoints checks for writes to them after each instruction
+	if (m_guard != nullptr) {
+		return ExecuteInstructions<false, false, true>(a_loc);
+	}
+
+	// Only a profiled run tells the profile which instruction runs
+	if (m_profile != nullptr) {
+		if (m_decoded) {
+			return m_successors ? ExecuteInstructions<true, true, false, true>(a_loc) : ExecuteInstructions<false, true, false, true>(a_loc);
+		}
+		return m_successors ? ExecuteInstructions<true, false, false, true>(a_loc) : ExecuteInstructions<false, false, false, true>(a_loc);
+	}
+
+	// The plain loop does not pay for the successor lookups or the decoded instructions
+	if (m_decoded) {
+		return m_successors ? ExecuteInstructions<true, true>(a_loc) : ExecuteInstructions<false, true>(a_loc);
+	}
+	return m_successors ? ExecuteInstructions<true, false>(a_loc) : ExecuteInstructions<false, false>(a_loc);
+}
+
+/// <summary>
+/// The instruction loop of Execute.  The optimized loop takes the successors set up
+/// by the Optimizer instead of the next location and the branch operands.  The decoded
+/// loop takes the opcode and operand of the instructions decoded by the Classifier,
+/// and the value of an operand word that is never written, instead of reading memory.
+/// The watched loop reports the writes to watched words after each instruction; the
+/// others run ahead the loops found by the LoopAccelerator.  The profiled loop tells the
+/// HardwareProfile where it is before each instruction.
+/// </summary>
+/// <param name="a_loc">The location of the next instruction; updated as the program runs</param>
+/// <returns>Why execution stopped</returns>
+template <bool OptimizedFl, bool DecodedFl, bool WatchedFl, bool ProfiledFl>
+Emulator::StopReason Emulator::ExecuteInstructions(int& a_loc)
+{
+	const int memorySize = m_config.GetMemorySize();	// Also separates the opcode from the operand
+	const int wordLimit = m_config.GetWordLimit();		// The accumulator wraps around at this value
+	const bool extendedFl = m_config.IsExtended();		// The opcodes above 13 are invalid on the classic machine
+
+	int loc = a_loc;
+	int lastLoc = loc;		// The instruction executed last, for the watched loop
+	StopReason reason = StopReason::END_OF_MEMORY;
+
+	// The location after the instruction at a_from when it does not branch
+	const auto next = [this](int a_from) noexcept {
+		if constexpr (OptimizedFl) {
+			return FallThrough(a_from);
+		}
+		else {
+			return a_from + 1;
+		}
+	};
 
-	while (loc < MEMSZ) {
-		const int opcode = m_memory[loc] / 10000;
-		const int operand = m_memory[loc] % 10000;
+	// The location a branch at a_from to a_operand goes to
+	const auto target = [this](int a_from, int a_operand) noexcept {
+		if constexpr (OptimizedFl) {
+			const auto& successors = *m_successors;
+			if (static_cast<size_t>(a_from) < successors.size() && successors[a_from].m_target >= 0) {
+				m_instructionsSaved += successors[a_from].m_targetSaved;
+				return successors[a_from].m_target;
+			}
+		}
+		return a_operand;
+	};
+
+	// The location a conditional branch at a_from goes to when it is taken.  A branch back
+	// to the head of a loop the LoopAccelerator found runs ahead the iterations it can.
+	const auto taken = [&](int a_from, int a_operand) {
+		const int to = target(a_from, a_operand);
+		if constexpr (!WatchedFl) {
+			if (m_loops && to <= a_from) {
+				AccelerateLoop(a_from);
+			}
+		}
+		return to;
+	};
+
+	while (loc < memorySize) {
+		if constexpr (WatchedFl) {
+			CheckWatchpoints(lastLoc);
+			lastLoc = loc;
+		}
+
+		// Stop a program that runs longer than it is allowed to
+		if (m_instructionLimit != 0 && m_instructionCount >= m_instructionLimit) {
+			reason = StopReason::INSTRUCTION_LIMIT;
+			break;
+		}
+		++m_instructionCount;
+
+		int opcode = 0;
+		int operand = 0;
+		const DecodedInstruction* decoded = nullptr;
+		if constexpr (DecodedFl) {
+			if (static_cast<size_t>(loc) < m_decoded->size() && (*m_decoded)[loc].m_opCode != 0) {
+				decoded = &(*m_decoded)[loc];
+				opcode = decoded->m_opCode;
+				operand = decoded->m_operand;
+			}
+		}
+		if (decoded == nullptr) {
+			const int word = m_memory.Read(loc);
+			opcode = word / memorySize;
+			operand = word % memorySize;
+		}
+		if constexpr (ProfiledFl) {
+			m_profile->Enter(loc, extendedFl || opcode <= 13 ? opcode : 0);
+		}
+
+		// The word at the operand
+		const auto value = [&]() noexcept {
+			if constexpr (DecodedFl) {
+				if (decoded != nullptr && decoded->m_immediateFl) {
+					return decoded->m_value;
+				}
+			}
+			return m_memory.Read(operand);
+		};
+
+		// The word at the operand plus the index register
+		const auto indexed = [&]() noexcept { return (operand + m_index) % memorySize; };
 
-		switch (opcode)
+		switch (extendedFl || opcode <= 13 ? opcode : 0)
 		{
 			case 1: // ADD
-				m_accum += m_memory[operand];
-				m_accum %= 1000000;
-				loc++;
+				m_accum += value();
+				m_accum %= wordLimit;
+				loc = next(loc);
 				break;
 			case 2: // SUB
-				m_accum -= m_memory[operand];
-				m_accum %= 1000000;
-				loc++;
+				m_accum -= value();
+				m_accum %= wordLimit;
+				loc = next(loc);
 				break;
 			case 3: // MULT
-				m_accum *= m_memory[operand];
-				m_accum %= 1000000;
-				loc++;
+				m_accum = static_cast<int>(static_cast<long long>(m_accum) * value() % wordLimit);
+				loc = next(loc);
 				break;
-			case 4: // DIV
-				m_accum /= m_memory[operand];
-				m_accum %= 1000000;
-				loc++;
+			case 4: { // DIV
+				// A zero divisor ends the run rather than trapping the host
+				const int divisor = value();
+				if (divisor == 0) {
+					a_loc = loc;
+					return StopReason::DIVISION_BY_ZERO;
+				}
+				m_accum /= divisor;
+				m_accum %= wordLimit;
+				loc = next(loc);
 				break;
+			}
 			case 5: // LOAD
-				m_accum = m_memory[operand];
-				loc++;
+				m_accum = value();
+				loc = next(loc);
 				break;
 			case 6: // STORE
-				m_memory[operand] = m_accum;
-				loc++;
+				m_memory.Write(operand, m_accum);
+				loc = next(loc);
 				break;
 			case 7: // READ
-				std::cout << "? ";
-				std::cin >> line;
-				// If the input is not an integer, output an error and terminate
-				if (!isInteger(line)) {
-					std::cout << "Error: Invalid input\n";
-					return false;
-				}
-				m_memory[operand] = std::stoi(line[0] == '-' ? line.substr(0, 7) : line.substr(0, 6));
-				loc++;
-				break;
+				a_loc = loc;
+				return StopReason::READ;
 			case 8: // WRITE
-				std::cout << m_memory[operand] << '\n';
-				loc++;
-				break;
+				a_loc = loc;
+				return StopReason::WRITE;
 			case 9: // BRANCH
-				loc = operand;
+				loc = target(loc, operand);
 				continue;
 			case 10: // BRANCH MINUS
 				if (m_accum < 0) {
-					loc = operand;
+					loc = taken(loc, operand);
 					continue;
 				}
-				loc++;
+				loc = next(loc);
 				break;
 			case 11: // BRANCH ZERO
 				if (m_accum == 0) {
-					loc = operand;
+					loc = taken(loc, operand);
 					continue;
 				}
-				loc++;
+				loc = next(loc);
 				break;
 			case 12: // BRANCH PLUS
 				if (m_accum > 0) {
-					loc = operand;
+					loc = taken(loc, operand);
 					continue;
 				}
-				loc++;
+				loc = next(loc);
 				break;
 			case 13: // HALT
-				return true;
+				a_loc = loc;
+				return StopReason::HALT;
+			case 14: // LOAD INDEX
+				m_index = (m_memory.Read(operand) % memorySize + memorySize) % memorySize;
+				loc = next(loc);
+				break;
+			case 15: // STORE INDEX
+				m_memory.Write(operand, m_index);
+				loc = next(loc);
+				break;
+			case 16: // LOAD INDEX IMMEDIATE
+				m_index = operand;
+				loc = next(loc);
+				break;
+			case 17: // ADD TO INDEX IMMEDIATE
+				m_index = (m_index + operand) % memorySize;
+				loc = next(loc);
+				break;
+			case 18: // LOAD INDEXED
+				m_accum = m_memory.Read(indexed());
+				loc = next(loc);
+				break;
+			case 19: // STORE INDEXED
+				m_memory.Write(indexed(), m_accum);
+				loc = next(loc);
+				break;
+			case 20: // ADD INDEXED
+				m_accum += m_memory.Read(indexed());
+				m_accum %= wordLimit;
+				loc = next(loc);
+				break;
+			case 21: // ADD IMMEDIATE
+				m_accum += operand;
+				m_accum %= wordLimit;
+				loc = next(loc);
+				break;
+			case 22: // SUB IMMEDIATE
+				m_accum -= operand;
+				m_accum %= wordLimit;
+				loc = next(loc);
+				break;
+			case 23: // MULT IMMEDIATE
+				m_accum = static_cast<int>(static_cast<long long>(m_accum) * operand % wordLimit);
+				loc = next(loc);
+				break;
+			case 24: // DIV IMMEDIATE
+				if (operand == 0) {
+					a_loc = loc;
+					return StopReason::DIVISION_BY_ZERO;
+				}
+				m_accum /= operand;
+				m_accum %= wordLimit;
+				loc = next(loc);
+				break;
+			case 25: // LOAD IMMEDIATE
+				m_accum = operand;
+				loc = next(loc);
+				break;
+			case 26: // READ BLOCK
+				a_loc = loc;
+				return StopReason::READ;
+			case 27: // WRITE BLOCK
+				a_loc = loc;
+				return StopReason::WRITE;
 			default:
 				break;
 		}
 	}
 
-	return false;
+	if constexpr (WatchedFl) {
+		CheckWatchpoints(lastLoc);
+	}
+	a_loc = loc;
+	return reason;
+}
+
+/// <summary>
+/// Watches a word in the runs of RunProgram.  A write to it is caught by the protection of
+/// its host page, so the run only slows down on writes to that page.
+/// </summary>
+/// <param name="a_addr">The address of the word</param>
+/// <returns>False if the address is outside the memory or the memory cannot be protected</returns>
+bool Emulator::AddWatchpoint(int a_addr)
+{
+	if (a_addr < 0 || a_addr >= m_config.GetMemorySize() || !m_memory.CanProtect()) {
+		return false;
+	}
+	const auto it = std::ranges::lower_bound(m_watchpoints, a_addr);
+	if (it == m_watchpoints.end() || *it != a_addr) {
+		m_watchpoints.insert(it, a_addr);
+	}
+	return true;
+}
+
+/// <summary>
+/// Called after each instruction of a run with watchpoints.  If the instruction wrote to a
+/// protected page, the page is protected again and a write to a watched word is reported.
+/// Writes to the other words of the page are not.
+/// </summary>
+/// <param name="a_loc">The location of the instruction</param>
+void Emulator::CheckWatchpoints(int a_loc)
+{
+	int addr = 0;
+	int oldValue = 0;
+	if (m_guard->TakeFault(addr, oldValue) && std::ranges::binary_search(m_watchpoints, addr) && m_watchHandler) {
+		m_watchHandler({ a_loc, addr, oldValue, m_memory.Read(addr) });
+	}
+}
+
+/// <summary>
+/// Returns how many iterations, from the first and at most a_max, keep a value that
+/// changes by a_step each iteration strictly between a_low and a_high.
+/// </summary>
+/// <param name="a_first">The value in the first iteration</param>
+/// <param name="a_step">What each iteration adds to it</param>
+/// <param name="a_low">The bound below</param>
+/// <param name="a_high">The bound above</param>
+/// <param name="a_max">The most iterations wanted</param>
+/// <returns>The number of iterations</returns>
+static unsigned long long IterationsBetween(long long a_first, long long a_step, long long a_low, long long a_high, unsigned long long a_max) noexcept
+{
+	if (a_first <= a_low || a_first >= a_high) {
+		return 0;
+	}
+	if (a_step == 0) {
+		return a_max;
+	}
+	const long long room = a_step > 0 ? a_high - a_first : a_first - a_low;
+	const long long step = a_step > 0 ? a_step : -a_step;
+	return std::min(a_max, static_cast<unsigned long long>((room + step - 1) / step));
+}
+
+/// <summary>
+/// Called when the branch at the end of a loop found by the LoopAccelerator has gone back
+/// to its head.  Every value an iteration computes is a variable that changes by the same
+/// amount each iteration, plus words that do not change, so the values of any iteration
+/// follow from those of the first.  The loop runs ahead by the iterations in which no
+/// addition or subtraction wraps around, the branch is taken and the instruction limit is
+/// not reached.  The emulator runs the iteration that wraps around or leaves the loop.
+/// </summary>
+/// <param name="a_branch">The location of the branch</param>
+void Emulator::AccelerateLoop(int a_branch)
+{
+	// The most iterations run ahead at once, which keeps the products below in range
+	static constexpr unsigned long long MaxIterations = 1ULL << 32;
+	// A bound that no value reaches
+	static constexpr long long Unbounded = std::numeric_limits<long long>::max() / 4;
+
+	const LoopTable& table = *m_loops;
+	if (static_cast<size_t>(a_branch) >= table.m_at.size() || table.m_at[a_branch] < 0) {
+		return;
+	}
+	const Loop& loop = table.m_loops[table.m_at[a_branch]];
+
+	// A store outside the loop may have changed its code
+	for (size_t i = 0; i < loop.m_code.size(); ++i) {
+		if (m_memory.Read(loop.m_head + static_cast<int>(i)) != loop.m_code[i]) {
+			return;
+		}
+	}
+
+	// The words the loop does not store, the variables in the first iteration, and what each iteration adds to them
+	const auto invariant = [this](const LoopValue& a_value) {
+		long long sum = a_value.m_const;
+		for (const LoopTerm& term : a_value.m_terms) {
+			sum += static_cast<long long>(term.m_coeff) * m_memory.Read(term.m_addr);
+		}
+		return sum;
+	};
+	const size_t varCount = loop.m_vars.size();
+	std::array<long long, MaxLoopVariables> first{};
+	std::array<long long, MaxLoopVariables> step{};
+	for (size_t var = 0; var < varCount; ++var) {
+		first[var] = loop.m_vars[var] < 0 ? m_accum : m_memory.Read(loop.m_vars[var]);
+		step[var] = loop.m_next[var].m_var == static_cast<int>(var) ? invariant(loop.m_next[var]) : 0;
+	}
+	const auto valueIn = [&](const LoopValue& a_value, long long a_iteration) {
+		const long long sum = invariant(a_value);
+		return a_value.m_var < 0 ? sum : sum + first[a_value.m_var] + a_iteration * step[a_value.m_var];
+	};
+	const auto stepOf = [&](const LoopValue& a_value) { return a_value.m_var < 0 ? 0 : step[a_value.m_var]; };
+
+	unsigned long long count = MaxIterations;
+	if (m_instructionLimit != 0) {
+		count = std::min(count, (m_instructionLimit - m_instructionCount) / static_cast<unsigned long long>(loop.m_executed));
+	}
+	const long long wordLimit = m_config.GetWordLimit();
+	for (const LoopValue& sum : loop.m_sums) {
+		count = IterationsBetween(valueIn(sum, 0), stepOf(sum), -wordLimit, wordLimit, count);
+	}
+	const LoopValue& tested = loop.m_next[0];
+	const long long testedFirst = valueIn(tested, 0);
+	switch (loop.m_branchOpCode) {
+		case 10:	// BRANCH MINUS
+			count = IterationsBetween(testedFirst, stepOf(tested), -Unbounded, 0, count);
+			break;
+		case 11:	// BRANCH ZERO
+			count = testedFirst != 0 ? 0 : stepOf(tested) != 0 ? std::min(count, 1ULL) : count;
+			break;
+		default:	// BRANCH PLUS
+			count = IterationsBetween(testedFirst, stepOf(tested), 0, Unbounded, count);
+			break;
+	}
+	if (count == 0) {
+		return;
+	}
+
+	// A variable that drifts has moved count steps; any other is what the last iteration left in it
+	std::array<long long, MaxLoopVariables> last{};
+	for (size_t var = 0; var < varCount; ++var) {
+		const LoopValue& next = loop.m_next[var];
+		last[var] = next.m_var == static_cast<int>(var) ? first[var] + static_cast<long long>(count) * step[var]
+			: valueIn(next, static_cast<long long>(count) - 1);
+	}
+	for (size_t var = 0; var < varCount; ++var) {
+		if (loop.m_vars[var] < 0) {
+			m_accum = static_cast<int>(last[var]);
+		}
+		else {
+			m_memory.Write(loop.m_vars[var], static_cast<int>(last[var]));
+		}
+	}
+
+	m_instructionCount += count * static_cast<unsigned long long>(loop.m_executed);
+	m_instructionsSaved += count * static_cast<unsigned long long>(loop.m_saved);
+	m_iterationsAccelerated += count;
+}
+
+/// <summary>
+/// Returns the location executed after the instruction at a_loc when it does not branch,
+/// counting the instructions the Optimizer found could be skipped.
+/// </summary>
+/// <param name="a_loc">The location of the instruction</param>
+/// <returns>The next location</returns>
+int Emulator::FallThrough(int a_loc) noexcept
+{
+	if (m_successors && static_cast<size_t>(a_loc) < m_successors->size()) {
+		m_instructionsSaved += (*m_successors)[a_loc].m_nextSaved;
+		return (*m_successors)[a_loc].m_next;
+	}
+	return a_loc + 1;
+}
+
+/// <summary>
+/// Returns the number of words the READ or WRITE at a_loc transfers.  READB and WRITEB
+/// transfer as many words as the accumulator says, at most the whole memory.
+/// </summary>
+/// <param name="a_loc">The location of the READ or WRITE instruction</param>
+/// <returns>The number of words</returns>
+int Emulator::TransferCount(int a_loc) const noexcept
+{
+	const int opcode = m_config.GetOpCode(m_memory.Read(a_loc));
+	if (opcode == 26 || opcode == 27) {
+		return std::clamp(m_accum, 0, m_config.GetMemorySize());
+	}
+	return 1;
+}
+
+/// <summary>
+/// Returns the address of a word of the transfer of the READ or WRITE at a_loc.  The
+/// words of a block follow the operand and wrap around the end of the memory.
+/// </summary>
+/// <param name="a_loc">The location of the READ or WRITE instruction</param>
+/// <param name="a_index">The number of the word in the transfer</param>
+/// <returns>The address of the word</returns>
+int Emulator::TransferAddress(int a_loc, int a_index) const noexcept
+{
+	return (m_config.GetOperand(m_memory.Read(a_loc)) + a_index) % m_config.GetMemorySize();
+}
+
+/// <summary>
+/// Returns true if the instruction at a_loc writes the word at a_addr when it is executed
+/// with the current accumulator and index register.
+/// </summary>
+/// <param name="a_loc">The location of the instruction</param>
+/// <param name="a_addr">The address of the word</param>
+/// <returns>True if the instruction writes the word</returns>
+bool Emulator::WritesTo(int a_loc, int a_addr) const noexcept
+{
+	const int word = m_memory.Read(a_loc);
+	const int opcode = m_config.GetOpCode(word);
+	const int operand = m_config.GetOperand(word);
+	const int memorySize = m_config.GetMemorySize();
+
+	switch (m_config.IsExtended() || opcode <= 13 ? opcode : 0) {
+		case 6: // STORE
+		case 7: // READ
+		case 15: // STORE INDEX
+			return operand == a_addr;
+		case 19: // STORE INDEXED
+			return (operand + m_index) % memorySize == a_addr;
+		case 26: // READ BLOCK
+			return (a_addr - operand + memorySize) % memorySize < TransferCount(a_loc);
+		default:
+			return false;
+	}
+}
+
+/// <summary>
+/// Completes a word of a READ: stores the input at a_addr.
+/// Input longer than a word keeps its leading digits.
+/// </summary>
+/// <param name="a_addr">The address the word is read into</param>
+/// <param name="a_line">The input</param>
+/// <returns>False if the input is not an integer</returns>
+bool Emulator::StoreInput(int a_addr, const std::string& a_line)
+{
+	if (!isInteger(a_line)) {
+		return false;
+	}
+
+	const size_t wordDigits = static_cast<size_t>(m_config.GetWordDigits());
+	m_memory.Write(a_addr, std::stoi(a_line[0] == '-' ? a_line.substr(0, wordDigits + 1) : a_line.substr(0, wordDigits)));
+	return true;
 }
 
 /// <summary>
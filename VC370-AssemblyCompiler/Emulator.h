@@ -5,36 +5,264 @@
 #define _EMULATOR_H
 
 #include "stdafx.h"
+#include "MachineConfig.h"
+#include "GuestMemory.h"
+#include "EmulatorSession.h"
 #include <array>
+#include <functional>
+#include <unordered_map>
+
+class HardwareProfile;
 
 class Emulator {
 
 public:
 
-	static constexpr int MEMSZ = 10'000;	// The size of the memory of the VC370.
+	static constexpr int MEMSZ = 10'000;	// The size of the memory of the classic VC370.
+	static constexpr int EntryLocation = 100;	// Where every run of a program starts.
 	
 	// Default constructor.  Will set the accumulator to zero.
-	Emulator();
+	explicit Emulator(const MachineConfig& a_config = MachineConfig());
+
+	// An instance of a shared program image.  The memory of the image is copied on write.
+	explicit Emulator(std::shared_ptr<const Emulator> a_image);
+
+	// A classic machine loaded with a memory image, e.g. one made by StaticAssembler at compile time.
+	explicit Emulator(const std::array<int, MEMSZ>& a_image, bool a_extendedFl = false);
+
+	// What Pass II generated a word from.
+	enum class WordKind : unsigned char {
+		UNKNOWN,	// Not generated by Pass II (DS, linked or never written)
+		CODE,		// A machine instruction
+		CONSTANT	// A DC directive
+	};
 
 	// Records instructions and data into VC370 memory.
-	bool InsertMemory(int a_location, int opCode, int operand);
+	bool InsertMemory(int a_location, int opCode, int operand, WordKind a_kind = WordKind::UNKNOWN);
+
+	// One past the highest word with a known kind.
+	[[nodiscard]] int GetClassifiedExtent() const noexcept { return static_cast<int>(m_wordKinds.size()); }
+
+	// What the word at a location was generated from.
+	[[nodiscard]] WordKind GetWordKind(int a_location) const noexcept {
+		return static_cast<size_t>(a_location) < m_wordKinds.size() ? m_wordKinds[a_location] : WordKind::UNKNOWN;
+	}
 
 	// Get the contents of the memory location specified by a_location.
 	[[nodiscard]] std::string GetMemoryContent(int a_location) const;
 
+	// Formats a word as it is shown in the listing. -1 marks an invalid part.
+	[[nodiscard]] static std::string FormatMemoryContent(int opCode, int operand, int operandDigits = MachineConfig::ClassicOperandDigits);
+
+	// The dimensions of the emulated machine.
+	[[nodiscard]] const MachineConfig& GetConfig() const noexcept { return m_config; }
+
+	// The number of words of guest memory backed by host memory.
+	[[nodiscard]] size_t GetAllocatedWords() const noexcept { return m_memory.GetAllocatedWords(); }
+
 	// Runs the VC370 program recorded in memory.
-	bool RunProgram();
+	bool RunProgram(std::istream& a_in = std::cin, std::ostream& a_out = std::cout);
+
+	// Where a run takes its input and puts its output.
+	struct Io {
+		std::function<bool(std::string&)> m_read;	// Sets the line a READ takes; returns false at the end of the input
+		std::function<void(int)> m_write;			// Takes the word a WRITE outputs
+	};
+
+	// How a run ended.
+	enum class RunStatus { HALTED, INVALID_INPUT, INSTRUCTION_LIMIT, DIVISION_BY_ZERO, END_OF_MEMORY };
+
+	// Runs the program with the caller's input and output.  Unlike RunProgram it does not
+	// check for assembly errors or print anything; an image with errors should not be run.
+	RunStatus Run(const Io& a_io);
+
+	// Runs a copy of the program as a coroutine that suspends on READ and WRITE.
+	[[nodiscard]] static EmulatorSession StartSession(Emulator a_image);
+
+	// Limits the number of instructions a run may execute.  Zero means no limit.
+	void SetInstructionLimit(unsigned long long a_limit) noexcept { m_instructionLimit = a_limit; }
+
+	// The number of instructions executed by the last run.
+	[[nodiscard]] unsigned long long GetInstructionCount() const noexcept { return m_instructionCount; }
+
+	// Puts an instance of an image back to the state of the image, for another run.  An emulator
+	// that owns its program has nothing to restore it from, so it keeps its memory and only its
+	// registers and counts are reset.
+	void Reset();
+
+	// Forgets the program, for another one to be inserted.  The memory keeps its pages.
+	void Clear();
+
+	// The number of memory pages written since the emulator was created or reset.
+	[[nodiscard]] size_t GetDirtyPageCount() const noexcept { return m_memory.GetDirtyPageCount(); }
+
+	// The word stored at a location.
+	[[nodiscard]] int GetWord(int a_location) const noexcept { return m_memory.Read(a_location); }
+
+	// Where execution continues after an instruction; set up by the Optimizer.
+	struct Successor {
+		int m_next;			// The location after the instruction when it does not branch
+		int m_nextSaved;	// The instructions skipped on the way to m_next
+		int m_target;		// The branch target, or -1 to use the operand of the instruction
+		int m_targetSaved;	// The instructions skipped on the way to m_target
+	};
+
+	// Installs the successors of the locations below a_successors.size().  Changing the memory removes them.
+	void SetSuccessors(std::vector<Successor> a_successors);
+
+	// An instruction decoded before the run, for a program that never writes its code.
+	struct DecodedInstruction {
+		int m_opCode;			// 0 if the location was not decoded
+		int m_operand;
+		int m_value;			// The word at the operand, if m_immediateFl
+		bool m_immediateFl;		// The word at the operand is never written, so m_value is used instead of memory
+	};
+
+	// Installs the decoded instructions of the locations below a_decoded.size(); set up by the Classifier.
+	// Changing the memory removes them.
+	void SetDecodedInstructions(std::vector<DecodedInstruction> a_decoded);
+
+	// The instructions the last run did not have to execute thanks to the successors.
+	[[nodiscard]] unsigned long long GetInstructionsSaved() const noexcept { return m_instructionsSaved; }
+
+	// The most variables a loop run in closed form may have.
+	static constexpr size_t MaxLoopVariables = 8;
+
+	// A word that a loop reads but never stores, times the number of times it is added.
+	struct LoopTerm {
+		int m_addr;
+		int m_coeff;
+	};
+
+	// A value an iteration of a loop computes: one variable of the loop at the start of the
+	// iteration (or none), plus words the loop never stores, plus a constant.
+	struct LoopValue {
+		int m_var = -1;					// An index into Loop::m_vars, or -1
+		std::vector<LoopTerm> m_terms;
+		long long m_const = 0;
+	};
+
+	// A loop whose iterations can be run in closed form; set up by the LoopAccelerator.  It is
+	// the straight code from m_head to the conditional branch at m_branch, which goes back to m_head.
+	struct Loop {
+		int m_head;
+		int m_branch;
+		int m_branchOpCode;				// BM, BZ or BP; it tests the value of the accumulator
+		std::vector<int> m_code;		// The words from m_head to m_branch, which must not have changed
+		std::vector<int> m_vars;		// The accumulator (-1), first, and the words the loop stores
+		std::vector<LoopValue> m_next;	// The value of each variable at the end of an iteration
+		std::vector<LoopValue> m_sums;	// The results of the additions and subtractions, which must not wrap around
+		int m_executed = 0;				// The instructions an iteration executes and saves; worked out by SetLoops
+		int m_saved = 0;
+	};
+
+	// Installs the loops, after the successors, which they follow.  Returns the number installed.
+	// Changing the memory removes them.
+	size_t SetLoops(std::vector<Loop> a_loops);
+
+	// The loop iterations the last run did in closed form.
+	[[nodiscard]] unsigned long long GetIterationsAccelerated() const noexcept { return m_iterationsAccelerated; }
+
+	// A write to a watched word.
+	struct WatchHit {
+		int m_loc;			// The instruction that wrote the word
+		int m_addr;			// The address of the word
+		int m_oldValue;
+		int m_newValue;
+	};
+
+	// Watches the word at a_addr in the runs of RunProgram.  Returns false if it cannot be watched.
+	bool AddWatchpoint(int a_addr);
+
+	// Attributes the host events of the runs of Run to their instructions, until it is set to null.
+	// The profile belongs to the thread that runs the emulator; sessions and watched runs are not profiled.
+	void SetProfile(HardwareProfile* a_profile) noexcept { m_profile = a_profile; }
+
+	// Sets the function called after each write to a watched word, before the run resumes.
+	void SetWatchHandler(std::function<void(const WatchHit&)> a_handler) { m_watchHandler = std::move(a_handler); }
 
 private:
+	// The debugger drives Execute itself to take snapshots and to run again from them.
+	friend class Debugger;
+
+	// Why Execute stopped.
+	enum class StopReason { READ, WRITE, HALT, INSTRUCTION_LIMIT, DIVISION_BY_ZERO, END_OF_MEMORY };
+
+	// Why a run failed.  RunProgram prints the first three; running off the end of memory is silent.
+	static constexpr std::string_view InvalidInputMessage = "Error: Invalid input\n";
+	static constexpr std::string_view InstructionLimitMessage = "Error: Instruction limit exceeded\n";
+	static constexpr std::string_view DivisionByZeroMessage = "Error: Division by zero\n";
+	static constexpr std::string_view EndOfMemoryMessage = "Error: Program ran past the end of memory\n";
+
+	// Sets the accumulator, the index and the counts of the last run to zero.
+	void ResetRegisters() noexcept;
+
+	// Executes instructions until READ, WRITE or the end of the program.
+	[[nodiscard]] StopReason Execute(int& a_loc);
+	template <bool OptimizedFl, bool DecodedFl, bool WatchedFl = false, bool ProfiledFl = false>
+	[[nodiscard]] StopReason ExecuteInstructions(int& a_loc);
+
+	// Runs ahead the iterations of the loop ending at a_branch that neither wrap around nor leave the loop.
+	void AccelerateLoop(int a_branch);
+
+	// Reports the write of the instruction at a_loc if it was to a watched word.
+	void CheckWatchpoints(int a_loc);
+
+	// The location executed after the instruction at a_loc when it does not branch.
+	[[nodiscard]] int FallThrough(int a_loc) noexcept;
+
+	// The number of words the READ or WRITE at a_loc transfers: one, or the accumulator for READB and WRITEB.
+	[[nodiscard]] int TransferCount(int a_loc) const noexcept;
+
+	// The address of word a_index of the transfer of the READ or WRITE at a_loc.
+	[[nodiscard]] int TransferAddress(int a_loc, int a_index) const noexcept;
+
+	// Returns true if the instruction at a_loc, executed now, writes the word at a_addr.
+	[[nodiscard]] bool WritesTo(int a_loc, int a_addr) const noexcept;
+
+	// Stores an input word at a_addr.  Returns false if the input is not an integer.
+	[[nodiscard]] bool StoreInput(int a_addr, const std::string& a_line);
+
 	// Check if a string is a valid integer
 	[[nodiscard]] static bool isInteger(std::string_view s) noexcept;
 
-	// The VC370 has 10,000 words of memory.  Each word contains 6 decimal
-	std::array<int, MEMSZ> m_memory{};
-	// The string contents of the memory of the VC370
-	std::array<std::string, MEMSZ> m_memoryContents{};
+	// The dimensions of the machine
+	MachineConfig m_config;
+	// The VC370 has 10,000 words of memory (more in the extended configurations).  Each word contains 6 decimal
+	GuestMemory m_memory;
+	// The words whose opcode (bit 0) or operand (bit 1) was invalid when they were inserted
+	std::unordered_map<int, unsigned char> m_invalidParts;
+	// What each word up to the highest one inserted was generated from
+	std::vector<WordKind> m_wordKinds;
 	// The accumulator for the VC370
 	int m_accum = 0;
+	// The index register of the extended machine; always an address
+	int m_index = 0;
+	// The number of instructions a run may execute (zero for no limit)
+	unsigned long long m_instructionLimit = 0;
+	// The number of instructions executed by the last run
+	unsigned long long m_instructionCount = 0;
+	// The successors found by the Optimizer (null if the program was not optimized); shared with the instances of an image
+	std::shared_ptr<const std::vector<Successor>> m_successors;
+	// The instructions decoded by the Classifier (null if the code was not proven read-only); shared like the successors
+	std::shared_ptr<const std::vector<DecodedInstruction>> m_decoded;
+	// The number of instructions the successors saved in the last run
+	unsigned long long m_instructionsSaved = 0;
+	// The loops found by the LoopAccelerator, and the index of the loop that ends at each location (or -1)
+	struct LoopTable {
+		std::vector<Loop> m_loops;
+		std::vector<int> m_at;
+	};
+	std::shared_ptr<const LoopTable> m_loops;
+	// The number of loop iterations run in closed form in the last run
+	unsigned long long m_iterationsAccelerated = 0;
+	// The watched words, in address order, and what to call when one is written
+	std::vector<int> m_watchpoints;
+	std::function<void(const WatchHit&)> m_watchHandler;
+	// Protects the pages of the watched words while RunProgram runs (null otherwise)
+	PageGuard* m_guard = nullptr;
+	// Counts the host events of the runs (null if they are not profiled)
+	HardwareProfile* m_profile = nullptr;
 };
 
 #endif
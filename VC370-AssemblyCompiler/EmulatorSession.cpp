@@ -0,0 +1,52 @@
+#include "EmulatorSession.h"
+#include "stdafx.h"
+
+/// <summary>
+/// Move assignment; the session that was held before is destroyed.
+/// </summary>
+/// <param name="a_other">The session to be moved</param>
+/// <returns>This session</returns>
+EmulatorSession& EmulatorSession::operator=(EmulatorSession&& a_other) noexcept
+{
+	if (this != &a_other) {
+		if (m_handle) m_handle.destroy();
+		m_handle = std::exchange(a_other.m_handle, nullptr);
+	}
+	return *this;
+}
+
+/// <summary>
+/// Destroys the coroutine frame, and with it the memory image of the program.
+/// </summary>
+EmulatorSession::~EmulatorSession()
+{
+	if (m_handle) m_handle.destroy();
+}
+
+/// <summary>
+/// Runs the program until its next READ or WRITE, or until it ends.
+/// A session that has ended stays in its final state.
+/// </summary>
+/// <returns>The state the program stopped in</returns>
+EmulatorSession::State EmulatorSession::Resume()
+{
+	if (!m_handle.done()) {
+		m_handle.resume();
+
+		promise_type& promise = m_handle.promise();
+		if (promise.m_exception) {
+			promise.m_state = State::FAILED;
+			std::rethrow_exception(std::exchange(promise.m_exception, nullptr));
+		}
+	}
+	return GetState();
+}
+
+/// <summary>
+/// Provides the line the waiting READ receives when the session is resumed.
+/// </summary>
+/// <param name="a_line">The line of input</param>
+void EmulatorSession::SetInput(std::string a_line)
+{
+	m_handle.promise().m_input = std::move(a_line);
+}
@@ -0,0 +1,96 @@
+//
+//		EmulatorSession class - a VC370 program run as a coroutine that suspends on READ and WRITE.
+//
+#pragma once
+
+#include "stdafx.h"
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+class EmulatorSession {
+
+public:
+	// Where the program stopped.
+	enum class State {
+		NOT_STARTED,		// Resume has not been called yet
+		WAITING_FOR_INPUT,	// READ was executed; call SetInput and Resume
+		OUTPUT_READY,		// WRITE was executed; the value is in GetOutput
+		HALTED,				// HALT was executed
+		FAILED				// The program ended without HALT; the reason is in GetError
+	};
+
+	// Suspends the program until the driver provides a line of input.
+	struct Input { };
+
+	struct promise_type {
+		State m_state = State::NOT_STARTED;
+		std::string m_input;
+		int m_output = 0;
+		std::string m_error;
+		std::exception_ptr m_exception;
+
+		EmulatorSession get_return_object() noexcept { return EmulatorSession(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+
+		// WRITE: hand the value to the driver
+		std::suspend_always yield_value(int a_value) noexcept
+		{
+			m_output = a_value;
+			m_state = State::OUTPUT_READY;
+			return {};
+		}
+
+		// READ: wait for the driver to provide the input
+		auto await_transform(Input) noexcept
+		{
+			struct Awaiter {
+				promise_type& m_promise;
+				bool await_ready() const noexcept { return false; }
+				void await_suspend(std::coroutine_handle<>) const noexcept { m_promise.m_state = State::WAITING_FOR_INPUT; }
+				std::string await_resume() const noexcept { return std::move(m_promise.m_input); }
+			};
+			return Awaiter{ *this };
+		}
+
+		// The program ended; an empty message means it halted
+		void return_value(std::string_view a_error)
+		{
+			m_error = a_error;
+			m_state = a_error.empty() ? State::HALTED : State::FAILED;
+		}
+
+		void unhandled_exception() noexcept { m_exception = std::current_exception(); }
+	};
+
+	EmulatorSession(EmulatorSession&& a_other) noexcept : m_handle(std::exchange(a_other.m_handle, nullptr)) { }
+	EmulatorSession& operator=(EmulatorSession&& a_other) noexcept;
+	~EmulatorSession();
+
+	// Prevent copying
+	EmulatorSession(const EmulatorSession&) = delete;
+	EmulatorSession& operator=(const EmulatorSession&) = delete;
+
+	// Runs the program until it reads, writes or ends.
+	State Resume();
+
+	// Provides the line a waiting READ receives.
+	void SetInput(std::string a_line);
+
+	[[nodiscard]] State GetState() const noexcept { return m_handle.promise().m_state; }
+
+	// The value of the last WRITE.
+	[[nodiscard]] int GetOutput() const noexcept { return m_handle.promise().m_output; }
+
+	// Why the program failed.
+	[[nodiscard]] const std::string& GetError() const noexcept { return m_handle.promise().m_error; }
+
+	// True once the program has halted or failed.
+	[[nodiscard]] bool IsDone() const noexcept { return m_handle.done(); }
+
+private:
+	explicit EmulatorSession(std::coroutine_handle<promise_type> a_handle) noexcept : m_handle(a_handle) { }
+
+	std::coroutine_handle<promise_type> m_handle;
+};
@@ -1,8 +1,13 @@
 #include "Error.h"
 #include "stdafx.h"
+#include "Probes.h"
 
-std::vector<Error::ErrorMsg> Error::m_ErrorMsgs;
-bool Error::m_WasErrorMessages = false;
+Error::Limits Error::m_Limits;
+thread_local std::vector<Error::ErrorMsg> Error::m_ErrorMsgs;
+thread_local std::array<size_t, Error::ErrorCodeCount> Error::m_CodeCounts{};
+thread_local size_t Error::m_ErrorCount = 0;
+thread_local std::array<Error::Dropped, Error::ErrorCodeCount> Error::m_Dropped{};
+thread_local bool Error::m_WasErrorMessages = false;
 
 /// <summary>
 /// Initializes the error reporting
@@ -12,17 +17,39 @@ bool Error::m_WasErrorMessages = false;
 void Error::InitErrorReporting()
 {
 	m_ErrorMsgs.clear();
+	m_CodeCounts.fill(0);
+	m_ErrorCount = 0;
+	m_Dropped.fill({});
 	m_WasErrorMessages = false;
 }
 
 /// <summary>
-/// Records an error message
+/// Records an error message.  Once its code or all codes together have reached their
+/// limit, the error is only counted, so a source that is wrong on every line does not
+/// fill the memory with messages.
 /// </summary>
 /// <param name="a_emsg">The error message to be recorded</param>
-void Error::RecordError(const ErrorMsg& a_emsg)
+/// <returns>True if the error was kept; false if it was only counted</returns>
+bool Error::RecordError(const ErrorMsg& a_emsg)
 {
-	m_ErrorMsgs.push_back(a_emsg);
+	const size_t code = static_cast<size_t>(a_emsg.m_emsg);
+	VC370_PROBE2(error__record, static_cast<int>(code), a_emsg.m_loc);
 	m_WasErrorMessages = true;
+	++m_ErrorCount;
+
+	if ((m_Limits.m_perCode == 0 || m_CodeCounts[code]++ < m_Limits.m_perCode)
+		&& (m_Limits.m_total == 0 || m_ErrorMsgs.size() < m_Limits.m_total)) {
+		m_ErrorMsgs.push_back(a_emsg);
+		return true;
+	}
+
+	Dropped& dropped = m_Dropped[code];
+	if (dropped.m_count++ == 0) {
+		dropped.m_firstLoc = dropped.m_lastLoc = a_emsg.m_loc;
+	}
+	dropped.m_firstLoc = std::min(dropped.m_firstLoc, a_emsg.m_loc);
+	dropped.m_lastLoc = std::max(dropped.m_lastLoc, a_emsg.m_loc);
+	return false;
 }
 
 /// <summary>
@@ -36,12 +63,25 @@ bool Error::WasThereErrors() noexcept
 
 /// <summary>
 ///	Displays the error messages
-/// ordered by the location of the error
+/// ordered by the location of the error,
+/// followed by the number of errors of each code that were not kept
 /// </summary>
-void Error::DisplayErrors()
+/// <param name="a_out">The stream the errors are written to</param>
+void Error::DisplayErrors(std::ostream& a_out)
 {
 	for (const auto& error : m_ErrorMsgs)
 	{
-		std::cout << std::format("{} {}\n", error.m_loc, GetErrorString(error.m_emsg));
+		a_out << std::format("{} {}\n", error.m_loc, GetErrorString(error.m_emsg));
+	}
+
+	for (size_t code = 0; code < ErrorCodeCount; ++code) {
+		const Dropped& dropped = m_Dropped[code];
+		if (dropped.m_count != 0) {
+			a_out << std::format("{} more: {} (locations {} to {})\n", dropped.m_count,
+				GetErrorString(static_cast<ErrorCode>(code)), dropped.m_firstLoc, dropped.m_lastLoc);
+		}
+	}
+	if (TooManyErrors()) {
+		a_out << std::format("Stopped after {} errors\n", m_ErrorCount);
 	}
 }
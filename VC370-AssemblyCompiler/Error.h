@@ -1,13 +1,18 @@
 //
 // Class to manage error reporting. Note: all members are static so we can access them anywhere.
 // What other choices do we have to accomplish the same thing?
+// The errors are kept per thread, so that separate assemblies can run on separate threads.
+// A broken source can have an error on every line, so only the first errors of each code
+// are kept; the rest are counted by code, with the range of their locations.
 //
 #ifndef _ERROR_H
 #define _ERROR_H
 
+#include <array>
 #include <string>
 #include <string_view>
 #include <vector>
+#include <iostream>
 
 class Error {
 
@@ -27,8 +32,13 @@ public:
         ERR_INVALID_OPERAND,
         ERR_MEMORY_OVERFLOW,
         ERR_MACHINE_CODE_AFTER_HALT,
-        ERR_ASSEMBLY_CODE_BEFORE_HALT
+        ERR_ASSEMBLY_CODE_BEFORE_HALT,
+        ERR_UNRESOLVED_EXTERNAL,
+        ERR_MULTIPLY_DEFINED_EXTERNAL,
+        ERR_INCOMPATIBLE_MODULE,
+        ERR_DIVISION_BY_ZERO
     };
+    static constexpr size_t ErrorCodeCount = static_cast<size_t>(ErrorCode::ERR_DIVISION_BY_ZERO) + 1;
 
     // Structure to hold information
     struct ErrorMsg {
@@ -38,19 +48,38 @@ public:
         constexpr ErrorMsg(ErrorCode emsg, int loc) noexcept : m_emsg(emsg), m_loc(loc) { }
     };
 
+    // How many errors are kept and when Pass II gives up.  Zero means no limit.
+    struct Limits {
+        size_t m_perCode = 1000;        // Errors kept of each code
+        size_t m_total = 5000;          // Errors kept in all
+        size_t m_stopAfter = 50'000;    // Errors after which Pass II stops
+    };
+
     Error() { InitErrorReporting(); }
 
+    // Sets the limits of all threads.  Call before assembling.
+    static void SetLimits(const Limits& a_limits) noexcept { m_Limits = a_limits; }
+
     // Initializes error reports
     static void InitErrorReporting();
 
-    // Records an error message
-    static void RecordError(const ErrorMsg& a_emsg);
+    // Records an error message.  Returns false if it was only counted because a limit was reached.
+    static bool RecordError(const ErrorMsg& a_emsg);
 
     // Returns true if there were any error messages recorded
     [[nodiscard]] static bool WasThereErrors() noexcept;
 
+    // The errors kept, in the order they were recorded.
+    [[nodiscard]] static const std::vector<ErrorMsg>& GetErrors() noexcept { return m_ErrorMsgs; }
+
+    // The number of errors recorded, kept or not.
+    [[nodiscard]] static size_t GetErrorCount() noexcept { return m_ErrorCount; }
+
+    // Returns true if there were so many errors that Pass II should stop.
+    [[nodiscard]] static bool TooManyErrors() noexcept { return m_Limits.m_stopAfter != 0 && m_ErrorCount >= m_Limits.m_stopAfter; }
+
     // Displays the collected error message.
-    static void DisplayErrors();
+    static void DisplayErrors(std::ostream& a_out = std::cout);
 
     // Get error message string for an error code
     [[nodiscard]] static constexpr std::string_view GetErrorString(ErrorCode code) noexcept {
@@ -69,14 +98,54 @@ public:
             case ErrorCode::ERR_MACHINE_CODE_AFTER_HALT: return "Machine code after HALT";
             case ErrorCode::ERR_ASSEMBLY_CODE_BEFORE_HALT: return "Assembly code before HALT";
             case ErrorCode::ERR_INVALID_LABEL: return "Invalid label";
+            case ErrorCode::ERR_UNRESOLVED_EXTERNAL: return "Unresolved external symbol";
+            case ErrorCode::ERR_MULTIPLY_DEFINED_EXTERNAL: return "Multiply defined external symbol";
+            case ErrorCode::ERR_INCOMPATIBLE_MODULE: return "Module assembled for a different address space";
+            case ErrorCode::ERR_DIVISION_BY_ZERO: return "Division by zero";
             default: return "Unknown error";
         }
     }
 
+    // Get the message shown under the line of the listing that has the error
+    [[nodiscard]] static constexpr std::string_view GetListingString(ErrorCode code) noexcept {
+        switch (code) {
+            case ErrorCode::ERR_INVALID_OPCODE: return "Error: Invalid opcode";
+            case ErrorCode::ERR_OPERAND_OVERFLOW: return "Error: Operand overflow";
+            case ErrorCode::ERR_DUPLICATE_LABEL: return "Error: Duplicate label";
+            case ErrorCode::ERR_END_STATEMENT_NOT_LAST: return "Error: END statement not last";
+            case ErrorCode::ERR_EXTRA_ELEMENTS: return "Error: Extra elements on line";
+            case ErrorCode::ERR_MISSING_OPERAND: return "Error: Missing operand";
+            case ErrorCode::ERR_MISSING_END_STATEMENT: return "Error: Missing END statement";
+            case ErrorCode::ERR_SYNTAX_ERROR: return "Error: Syntax Error";
+            case ErrorCode::ERR_UNDEFINED_LABEL: return "Error: Undefined label operand";
+            case ErrorCode::ERR_INVALID_OPERAND: return "Error: Invalid operand";
+            case ErrorCode::ERR_MEMORY_OVERFLOW: return "Error: Memory overflow";
+            case ErrorCode::ERR_MACHINE_CODE_AFTER_HALT: return "Error: Machine Code After HALT";
+            case ErrorCode::ERR_ASSEMBLY_CODE_BEFORE_HALT: return "Error: Assembly code before HALT";
+            case ErrorCode::ERR_INVALID_LABEL: return "Error: Invalid label";
+            case ErrorCode::ERR_DIVISION_BY_ZERO: return "Error: Division by zero";
+            default: return "Error: Unknown error";
+        }
+    }
+
 private:
+    // The errors of a code that were counted but not kept.
+    struct Dropped {
+        size_t m_count = 0;
+        int m_firstLoc = 0;     // The lowest and highest locations of the errors
+        int m_lastLoc = 0;
+    };
+
+    // The limits of all threads
+    static Limits m_Limits;
     // List of error messages
-    static std::vector<ErrorMsg> m_ErrorMsgs;
+    static thread_local std::vector<ErrorMsg> m_ErrorMsgs;
+    // The number of errors of each code and in all, kept or not
+    static thread_local std::array<size_t, ErrorCodeCount> m_CodeCounts;
+    static thread_local size_t m_ErrorCount;
+    // The errors of each code that were not kept
+    static thread_local std::array<Dropped, ErrorCodeCount> m_Dropped;
     // Variable to keep track of whether there were any error messages
-    static bool m_WasErrorMessages;
+    static thread_local bool m_WasErrorMessages;
 };
 #endif
\ No newline at end of file
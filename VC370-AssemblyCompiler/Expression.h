@@ -0,0 +1,301 @@
+//
+//		Expression class - evaluates operand expressions such as TABLE+3 at assembly time.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Error.h"
+#include "Instruction.h"
+#include <optional>
+
+// An operand may be an expression instead of a single label or number.  Operands are
+// whitespace separated, so an expression has no spaces:
+//
+//		LOAD	TABLE+3				the fourth word of TABLE
+//		LOAD	TABLE+LEN(TABLE)-1	its last word
+//		DS		4*25
+//
+// The terms are numbers, labels and LEN(<label>), the number of words the statement of the
+// label takes (the operand of a DS, one for other statements).  They are combined with + - * /
+// and parentheses; * and / bind tighter and / truncates.  There is no unary minus.
+//
+// As in other assemblers, a value is absolute or an address.  A label is an address, and so is
+// an address plus or minus an absolute value; the difference of two addresses is absolute, and
+// * and / only take absolute values.  An address moves when the module is relocated, so the
+// value records how many labels of the module it holds.  A label declared with EXTRN can be
+// added once; the linker adds its location to the rest of the value.
+//
+// Everything is constexpr, so that StaticAssembler evaluates operands with the same rules.
+class Expression {
+
+public:
+	// What a label stands for.
+	struct Symbol {
+		int m_loc = 0;
+		int m_length = 1;				// The words of the statement the label is on
+		bool m_externalFl = false;		// Declared with EXTRN; its location is not known
+		bool m_multiplyDefinedFl = false;
+	};
+
+	// The value of an expression.
+	struct Value {
+		long long m_value = 0;			// The locations of the labels of this module are included
+		int m_relocations = 0;			// The labels of this module added, less those subtracted
+		std::string_view m_external;	// The EXTRN label added, if any
+		bool m_symbolicFl = false;		// A label or LEN was used
+		std::optional<Error::ErrorCode> m_error;
+
+		[[nodiscard]] constexpr bool IsAbsolute() const noexcept { return m_relocations == 0 && m_external.empty(); }
+	};
+
+	// The largest magnitude of a value or of a part of one: that of a number of nine digits.
+	static constexpr long long MaxMagnitude = 999'999'999;
+
+	// Returns true if an operand is an expression rather than a single label or number.
+	[[nodiscard]] static constexpr bool IsExpression(std::string_view a_operand) noexcept {
+		return a_operand.find_first_of("+-*/()") != std::string_view::npos;
+	}
+
+	// Evaluates an operand.  a_lookup takes the name of a label and returns its Symbol, or
+	// std::nullopt if it is not defined.
+	template <typename Lookup>
+	[[nodiscard]] static constexpr Value Evaluate(std::string_view a_operand, const Lookup& a_lookup);
+
+	// The value of an operand made of numbers only, e.g. 10 or 4*25, or -1 if it is negative,
+	// has labels or has an error.  This is the operand of ORG and DS, which Pass I needs before
+	// the labels are known.
+	[[nodiscard]] static constexpr long long EvaluateConstant(std::string_view a_operand) noexcept;
+
+private:
+	// A recursive descent parser over the operand.
+	template <typename Lookup>
+	struct Parser {
+		std::string_view m_text;
+		size_t m_pos;
+		const Lookup& m_lookup;
+		Value m_result;
+
+		constexpr bool Fail(Error::ErrorCode a_code) noexcept {
+			if (!m_result.m_error) {
+				m_result.m_error = a_code;
+			}
+			return false;
+		}
+		[[nodiscard]] constexpr bool AtEnd() const noexcept { return m_pos >= m_text.size(); }
+		[[nodiscard]] constexpr char Peek() const noexcept { return AtEnd() ? '\0' : m_text[m_pos]; }
+
+		constexpr bool ParseSum(Value& a_value);
+		constexpr bool ParseProduct(Value& a_value);
+		constexpr bool ParseTerm(Value& a_value);
+		constexpr bool ParseLabel(std::string_view& a_name);
+		constexpr bool Check(const Value& a_value) noexcept;
+	};
+
+	[[nodiscard]] static constexpr bool IsLetter(char a_c) noexcept { return (a_c >= 'A' && a_c <= 'Z') || (a_c >= 'a' && a_c <= 'z'); }
+	[[nodiscard]] static constexpr bool IsDigit(char a_c) noexcept { return a_c >= '0' && a_c <= '9'; }
+};
+
+/// <summary>
+/// Evaluates an operand expression.
+/// </summary>
+/// <param name="a_operand">The operand</param>
+/// <param name="a_lookup">Finds the Symbol of a label</param>
+/// <returns>The value; m_error is set if the operand is not a valid expression</returns>
+template <typename Lookup>
+constexpr Expression::Value Expression::Evaluate(std::string_view a_operand, const Lookup& a_lookup)
+{
+	Parser<Lookup> parser{ a_operand, 0, a_lookup, {} };
+	Value value;
+	if (parser.ParseSum(value) && !parser.AtEnd()) {
+		parser.Fail(Error::ErrorCode::ERR_SYNTAX_ERROR);
+	}
+	value.m_error = parser.m_result.m_error;
+	value.m_symbolicFl = parser.m_result.m_symbolicFl;
+	return value;
+}
+
+/// <summary>
+/// Evaluates an operand that may only have numbers.
+/// </summary>
+/// <param name="a_operand">The operand</param>
+/// <returns>The value, or -1 if it is negative, has labels or has an error</returns>
+constexpr long long Expression::EvaluateConstant(std::string_view a_operand) noexcept
+{
+	// A label stands for an address of its own, so that it is seen but does not fail the evaluation
+	const auto placeholder = [](std::string_view) { return std::optional<Symbol>(Symbol{}); };
+	const Value value = Evaluate(a_operand, placeholder);
+	return value.m_error || value.m_symbolicFl || value.m_value < 0 ? -1 : value.m_value;
+}
+
+/// <summary>
+/// sum := product { (+|-) product }
+/// </summary>
+/// <param name="a_value">Set to the value</param>
+/// <returns>False if there was an error</returns>
+template <typename Lookup>
+constexpr bool Expression::Parser<Lookup>::ParseSum(Value& a_value)
+{
+	if (!ParseProduct(a_value)) {
+		return false;
+	}
+	while (Peek() == '+' || Peek() == '-') {
+		const int sign = m_text[m_pos++] == '+' ? 1 : -1;
+		Value right;
+		if (!ParseProduct(right)) {
+			return false;
+		}
+		if (!right.m_external.empty() && (sign < 0 || !a_value.m_external.empty())) {
+			return Fail(Error::ErrorCode::ERR_INVALID_OPERAND);
+		}
+		a_value.m_value += sign * right.m_value;
+		a_value.m_relocations += sign * right.m_relocations;
+		if (!right.m_external.empty()) {
+			a_value.m_external = right.m_external;
+		}
+		if (!Check(a_value)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// product := term { (*|/) term }; both sides must be absolute.
+/// </summary>
+/// <param name="a_value">Set to the value</param>
+/// <returns>False if there was an error</returns>
+template <typename Lookup>
+constexpr bool Expression::Parser<Lookup>::ParseProduct(Value& a_value)
+{
+	if (!ParseTerm(a_value)) {
+		return false;
+	}
+	while (Peek() == '*' || Peek() == '/') {
+		const bool multiplyFl = m_text[m_pos++] == '*';
+		Value right;
+		if (!ParseTerm(right)) {
+			return false;
+		}
+		if (!a_value.IsAbsolute() || !right.IsAbsolute()) {
+			return Fail(Error::ErrorCode::ERR_INVALID_OPERAND);
+		}
+		if (!multiplyFl && right.m_value == 0) {
+			return Fail(Error::ErrorCode::ERR_DIVISION_BY_ZERO);
+		}
+		// Both sides are within MaxMagnitude, so the product fits in a long long
+		a_value.m_value = multiplyFl ? a_value.m_value * right.m_value : a_value.m_value / right.m_value;
+		if (!Check(a_value)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// term := number | label | LEN(label) | (sum)
+/// </summary>
+/// <param name="a_value">Set to the value</param>
+/// <returns>False if there was an error</returns>
+template <typename Lookup>
+constexpr bool Expression::Parser<Lookup>::ParseTerm(Value& a_value)
+{
+	a_value = Value();
+
+	if (Peek() == '(') {
+		++m_pos;
+		if (!ParseSum(a_value)) {
+			return false;
+		}
+		if (Peek() != ')') {
+			return Fail(Error::ErrorCode::ERR_SYNTAX_ERROR);
+		}
+		++m_pos;
+		return true;
+	}
+
+	if (IsDigit(Peek())) {
+		const size_t begin = m_pos;
+		while (IsDigit(Peek())) {
+			a_value.m_value = a_value.m_value * 10 + (m_text[m_pos++] - '0');
+			if (m_pos - begin >= 10) {
+				return Fail(Error::ErrorCode::ERR_OPERAND_OVERFLOW);
+			}
+		}
+		return true;
+	}
+
+	std::string_view name;
+	if (!ParseLabel(name)) {
+		return false;
+	}
+	m_result.m_symbolicFl = true;
+
+	// LEN(label) is the length of the label's statement; a label named LEN is still a label
+	const bool lengthFl = Instruction::MatchesOpCode(name, "LEN") && Peek() == '(';
+	if (lengthFl) {
+		++m_pos;
+		if (!ParseLabel(name)) {
+			return false;
+		}
+		if (Peek() != ')') {
+			return Fail(Error::ErrorCode::ERR_SYNTAX_ERROR);
+		}
+		++m_pos;
+	}
+
+	const std::optional<Symbol> symbol = m_lookup(name);
+	if (!symbol) {
+		return Fail(Error::ErrorCode::ERR_UNDEFINED_LABEL);
+	}
+	if (symbol->m_multiplyDefinedFl || (lengthFl && symbol->m_externalFl)) {
+		return Fail(Error::ErrorCode::ERR_INVALID_OPERAND);
+	}
+
+	if (lengthFl) {
+		a_value.m_value = symbol->m_length;
+	}
+	else if (symbol->m_externalFl) {
+		a_value.m_external = name;
+	}
+	else {
+		a_value.m_value = symbol->m_loc;
+		a_value.m_relocations = 1;
+	}
+	return true;
+}
+
+/// <summary>
+/// Reads a label: a letter followed by letters and digits, at most ten characters as in the label field.
+/// </summary>
+/// <param name="a_name">Set to the label</param>
+/// <returns>False if there was an error</returns>
+template <typename Lookup>
+constexpr bool Expression::Parser<Lookup>::ParseLabel(std::string_view& a_name)
+{
+	const size_t begin = m_pos;
+	if (!IsLetter(Peek())) {
+		return Fail(Error::ErrorCode::ERR_SYNTAX_ERROR);
+	}
+	while (IsLetter(Peek()) || IsDigit(Peek())) {
+		++m_pos;
+	}
+	a_name = m_text.substr(begin, m_pos - begin);
+	if (a_name.size() > 10) {
+		return Fail(Error::ErrorCode::ERR_INVALID_OPERAND);
+	}
+	return true;
+}
+
+/// <summary>
+/// Checks that a value has not grown beyond MaxMagnitude.
+/// </summary>
+/// <param name="a_value">The value so far</param>
+/// <returns>False if it has</returns>
+template <typename Lookup>
+constexpr bool Expression::Parser<Lookup>::Check(const Value& a_value) noexcept
+{
+	if (a_value.m_value > MaxMagnitude || a_value.m_value < -MaxMagnitude) {
+		return Fail(Error::ErrorCode::ERR_OPERAND_OVERFLOW);
+	}
+	return true;
+}
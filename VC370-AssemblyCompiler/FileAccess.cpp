@@ -1,32 +1,40 @@
 #include "FileAccess.h"
 #include "stdafx.h"
+#include "Metrics.h"
 
 /// <summary>
-/// Constructor for the file access class.
-/// It checks if the argument count is exactly 2.
-/// If not, it prints an error message and terminates the program.
-/// If it is, it opens the file.
-/// Then checks if the file is correctly opened.
-/// If not, it prints an error message and terminates the program.
+/// Constructor for the file access class that opens the file with the given name.
+/// If the file cannot be opened there are no lines, and IsOpen returns false; the
+/// caller decides what to report.
 /// </summary>
-/// <param name="argc">Number of program arguments</param>
-/// <param name="argv">Program arguments</param>
-FileAccess::FileAccess(int argc, char* argv[])
+/// <param name="a_fileName">The name of the source file</param>
+FileAccess::FileAccess(const std::string& a_fileName)
+    : m_sfile(std::make_unique<std::ifstream>(a_fileName, std::ios::in))
+    , m_openFl(static_cast<bool>(*m_sfile))
 {
-    // Check that there is exactly one run time parameter.
-    if (argc != 2) {
-        std::cerr << "Usage: Assem <FileName>\n";
-        std::exit(1);
-    }
+}
 
-    // Open the file.
-    m_sfile.open(argv[1], std::ios::in);
+/// <summary>
+/// Constructor for the file access class that reads the source from a stream.
+/// The stream must be seekable so that it can be rewound between the passes.
+/// </summary>
+/// <param name="a_stream">The stream holding the source</param>
+FileAccess::FileAccess(std::unique_ptr<std::istream> a_stream)
+    : m_sfile(std::move(a_stream))
+{
+}
 
-    // If the open failed, report the error and terminate.
-    if (!m_sfile) {
-        std::cerr << "Source file could not be opened, assembler terminated.\n";
-        std::exit(1);
-    }
+/// <summary>
+/// Reads the source from a buffer, e.g. one held by a program that embeds the assembler.
+/// The buffer is not copied; it must outlive the reading of the source.
+/// </summary>
+/// <param name="a_source">The text of the source</param>
+void FileAccess::SetSource(std::string_view a_source) noexcept
+{
+    m_sfile.reset();
+    m_source = a_source;
+    m_next = 0;
+    m_openFl = true;
 }
 
 /// <summary>
@@ -34,10 +42,8 @@ FileAccess::FileAccess(int argc, char* argv[])
 /// </summary>
 FileAccess::~FileAccess()
 {
-    // ifstream automatically closes in destructor, but explicit close is fine
-    if (m_sfile.is_open()) {
-        m_sfile.close();
-    }
+    // The stream closes itself when it is destroyed
+    m_sfile.reset();
 }
 
 /// <summary>
@@ -52,8 +58,23 @@ FileAccess::~FileAccess()
 /// </returns>
 bool FileAccess::GetNextLine(std::string& a_buff)
 {
+    Metrics::ScopedTimer timer(Metrics::Phase::FILE_IO);
+
+    // A buffer is split at the newlines, like getline does
+    if (m_sfile == nullptr) {
+        if (m_next >= m_source.size()) {
+            return false;
+        }
+        const size_t end = std::min(m_source.find('\n', m_next), m_source.size());
+        a_buff.assign(m_source, m_next, end - m_next);
+        m_next = end + 1;
+    }
 	// Read and return in one step; if there is no more data, the getline will fail and return false
-    return static_cast<bool>(std::getline(m_sfile, a_buff));
+    else if (!std::getline(*m_sfile, a_buff)) {
+        return false;
+    }
+    Metrics::Count(Metrics::Counter::BYTES_READ, a_buff.size() + 1);
+    return true;
 }
 
 /// <summary>
@@ -61,7 +82,12 @@ bool FileAccess::GetNextLine(std::string& a_buff)
 /// </summary>
 void FileAccess::Rewind()
 {
+    if (m_sfile == nullptr) {
+        m_next = 0;
+        return;
+    }
+
     // Clean the file and set the pointer to the beginning
-    m_sfile.clear();
-    m_sfile.seekg(0, std::ios::beg);
+    m_sfile->clear();
+    m_sfile->seekg(0, std::ios::beg);
 }
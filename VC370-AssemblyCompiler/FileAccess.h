@@ -5,16 +5,23 @@
 #define _FILEACCESS_H // We use pramas in Visual Studio.  See other include files
 
 #include <fstream>
+#include <istream>
+#include <memory>
 #include <string>
 #include <string_view>
-#include <cstdlib>
 
 class FileAccess {
 
 public:
 
-    // Opens the file.
-    FileAccess(int argc, char* argv[]);
+    // No source; SetSource provides one.
+    FileAccess() = default;
+
+    // Opens the file with the given name.  IsOpen tells whether it could be opened.
+    explicit FileAccess(const std::string& a_fileName);
+
+    // Reads the source from the given stream, e.g. text received over a socket.
+    explicit FileAccess(std::unique_ptr<std::istream> a_stream);
 
     // Closes the file.
     ~FileAccess();
@@ -23,6 +30,12 @@ public:
     FileAccess(const FileAccess&) = delete;
     FileAccess& operator=(const FileAccess&) = delete;
 
+    // Reads the source from a buffer the caller keeps until it is done with the source.
+    void SetSource(std::string_view a_source) noexcept;
+
+    // Returns false if the source file could not be opened.
+    [[nodiscard]] bool IsOpen() const noexcept { return m_openFl; }
+
     // Get the next line from the source file.
     [[nodiscard]] bool GetNextLine(std::string& a_buff);
 
@@ -30,7 +43,14 @@ public:
     void Rewind();
 
 private:
-    // Source file object.
-    std::ifstream m_sfile;
+    // Source stream object; a file unless the source was handed over as a stream.  Null
+    // when the source is a buffer.
+    std::unique_ptr<std::istream> m_sfile;
+
+    // The source buffer and the start of the next line in it.
+    std::string_view m_source;
+    size_t m_next = 0;
+
+    bool m_openFl = true;   // False if the source file could not be opened
 };
 #endif
@@ -0,0 +1,240 @@
+#include "GuestMemory.h"
+#include "MachineConfig.h"
+#include "stdafx.h"
+
+const GuestMemory::Page GuestMemory::ZeroPage{};
+
+/// <summary>
+/// Creates a memory of the given size. The classic machine gets a dense array,
+/// larger machines an empty page table.
+/// </summary>
+/// <param name="a_size">The number of words</param>
+GuestMemory::GuestMemory(int a_size)
+	: m_size(a_size)
+{
+	if (a_size <= MachineConfig(MachineConfig::ClassicOperandDigits).GetMemorySize()) {
+		m_dense.assign(a_size, 0);
+	}
+	else {
+		const size_t pageCount = (static_cast<size_t>(a_size) + PAGESZ - 1) / PAGESZ;
+		m_pages.resize(pageCount);
+		m_dirty.resize(pageCount);
+		BuildViews();
+	}
+}
+
+/// <summary>
+/// Creates a memory that starts as a copy of an image. The pages of the image are read
+/// in place until they are written, so a new memory costs only its page table. The image
+/// must not change while memories started from it exist.
+/// </summary>
+/// <param name="a_image">The image; a dense or a paged memory of any size</param>
+GuestMemory::GuestMemory(std::shared_ptr<const GuestMemory> a_image)
+	: m_size(a_image->m_size)
+	, m_image(std::move(a_image))
+{
+	const size_t pageCount = (static_cast<size_t>(m_size) + PAGESZ - 1) / PAGESZ;
+	m_pages.resize(pageCount);
+	m_dirty.resize(pageCount);
+	BuildViews();
+}
+
+/// <summary>
+/// Copy constructor that duplicates the private pages. The image is shared.
+/// </summary>
+/// <param name="a_other">The memory to be copied</param>
+GuestMemory::GuestMemory(const GuestMemory& a_other)
+	: m_size(a_other.m_size)
+	, m_dense(a_other.m_dense)
+	, m_image(a_other.m_image)
+	, m_dirty(a_other.m_dirty)
+	, m_dirtyPages(a_other.m_dirtyPages)
+{
+	m_pages.resize(a_other.m_pages.size());
+	for (size_t i = 0; i < m_pages.size(); ++i) {
+		if (a_other.m_pages[i]) {
+			m_pages[i] = std::make_unique<Page>(*a_other.m_pages[i]);
+		}
+	}
+	if (m_dense.empty()) {
+		BuildViews();
+	}
+}
+
+/// <summary>
+/// Copy assignment that duplicates the private pages.
+/// </summary>
+/// <param name="a_other">The memory to be copied</param>
+/// <returns>This memory</returns>
+GuestMemory& GuestMemory::operator=(const GuestMemory& a_other)
+{
+	if (this != &a_other) {
+		GuestMemory copy(a_other);
+		*this = std::move(copy);
+	}
+	return *this;
+}
+
+/// <summary>
+/// Sets every word to zero. The pages of a paged memory are released and the
+/// image, if any, is no longer used.
+/// </summary>
+void GuestMemory::Clear()
+{
+	std::ranges::fill(m_dense, 0);
+	for (auto& page : m_pages) {
+		page.reset();
+	}
+	m_image.reset();
+	std::ranges::fill(m_dirty, 0);
+	m_dirtyPages.clear();
+	if (m_dense.empty()) {
+		BuildViews();
+	}
+}
+
+/// <summary>
+/// Restores the pages written since the last reset from the image (or to zero), so the
+/// cost follows the pages a run wrote rather than the size of the memory. The private
+/// pages are kept, so the next run writes to them without copying again. A dense memory
+/// is never started from an image and keeps no dirty list, so it is cleared.
+/// </summary>
+void GuestMemory::Reset()
+{
+	if (!m_dense.empty()) {
+		std::ranges::fill(m_dense, 0);
+		return;
+	}
+	for (const int pageNum : m_dirtyPages) {
+		const size_t words = std::min<size_t>(PAGESZ, static_cast<size_t>(m_size) - static_cast<size_t>(pageNum) * PAGESZ);
+		std::copy_n(ImagePage(pageNum), words, m_pages[pageNum]->begin());
+		m_dirty[pageNum] = 0;
+	}
+	m_dirtyPages.clear();
+}
+
+/// <summary>
+/// Returns true if the words can be write-protected one host page at a time without
+/// protecting anything else.  The dense array owns whole host pages; a page of a paged
+/// memory is one host page on most systems, but not on those with larger host pages.
+/// </summary>
+/// <returns>True if PageGuard can protect the words</returns>
+bool GuestMemory::CanProtect() const noexcept
+{
+	return !m_dense.empty() || sizeof(Page) % PageGuard::GetHostPageSize() == 0;
+}
+
+/// <summary>
+/// Returns the host memory that holds a word: the dense array, or the private copy of
+/// its page.
+/// </summary>
+/// <param name="a_addr">The address of the word</param>
+/// <returns>The region that holds the word</returns>
+PageGuard::Region GuestMemory::GetRegion(int a_addr)
+{
+	if (!m_dense.empty()) {
+		return { m_dense.data(), PageAllocator<int>::Bytes(m_dense.capacity()), 0 };
+	}
+	const size_t pageNum = static_cast<size_t>(a_addr >> PAGEBITS);
+	if (!m_dirty[pageNum]) {
+		TouchPage(pageNum);
+	}
+	return { m_pages[pageNum]->data(), sizeof(Page), static_cast<int>(pageNum) * PAGESZ };
+}
+
+/// <summary>
+/// Hands over the pages written since the last reset or the last call, e.g. to record the
+/// changes between two snapshots.  The pages keep their contents.
+/// </summary>
+/// <param name="a_pages">Receives the numbers of the dirty pages</param>
+void GuestMemory::TakeDirtyPages(std::vector<int>& a_pages)
+{
+	for (const int pageNum : m_dirtyPages) {
+		m_dirty[pageNum] = 0;
+	}
+	a_pages = std::move(m_dirtyPages);
+	m_dirtyPages.clear();
+}
+
+/// <summary>
+/// Copies the words of a page.
+/// </summary>
+/// <param name="a_pageNum">The number of the page</param>
+/// <param name="a_words">Receives PAGESZ words</param>
+void GuestMemory::ReadPage(size_t a_pageNum, int* a_words) const
+{
+	const size_t words = std::min<size_t>(PAGESZ, static_cast<size_t>(m_size) - a_pageNum * PAGESZ);
+	std::copy_n(m_view[a_pageNum], words, a_words);
+	std::fill_n(a_words + words, PAGESZ - words, 0);
+}
+
+/// <summary>
+/// Replaces the words of a page, e.g. to go back to a snapshot.
+/// </summary>
+/// <param name="a_pageNum">The number of the page</param>
+/// <param name="a_words">PAGESZ words, or null for the words of the image</param>
+void GuestMemory::WritePage(size_t a_pageNum, const int* a_words)
+{
+	if (!m_dirty[a_pageNum]) {
+		TouchPage(a_pageNum);
+	}
+	const size_t words = std::min<size_t>(PAGESZ, static_cast<size_t>(m_size) - a_pageNum * PAGESZ);
+	std::copy_n(a_words != nullptr ? a_words : ImagePage(a_pageNum), words, m_pages[a_pageNum]->begin());
+}
+
+/// <summary>
+/// Counts the words that are backed by host memory.
+/// </summary>
+/// <returns>The size of the dense array or the words of the private pages</returns>
+size_t GuestMemory::GetAllocatedWords() const noexcept
+{
+	if (!m_dense.empty()) {
+		return m_dense.size();
+	}
+	return PAGESZ * static_cast<size_t>(std::ranges::count_if(m_pages, [](const auto& page) { return page != nullptr; }));
+}
+
+/// <summary>
+/// Finds the words a page has before it is written: those of the image, or zero.
+/// </summary>
+/// <param name="a_pageNum">The number of the page</param>
+/// <returns>The words of the page; only the words below the size of the memory are meaningful</returns>
+const int* GuestMemory::ImagePage(size_t a_pageNum) const noexcept
+{
+	if (!m_image) {
+		return ZeroPage.data();
+	}
+	if (!m_image->m_dense.empty()) {
+		return m_image->m_dense.data() + a_pageNum * PAGESZ;
+	}
+	return m_image->m_view[a_pageNum];
+}
+
+/// <summary>
+/// Called on the first write to a page since the last reset. Copies the page from the
+/// image if it has no private copy yet, and adds it to the dirty list.
+/// </summary>
+/// <param name="a_pageNum">The number of the page</param>
+void GuestMemory::TouchPage(size_t a_pageNum)
+{
+	auto& page = m_pages[a_pageNum];
+	if (!page) {
+		page = std::make_unique<Page>(Page{});
+		const size_t words = std::min<size_t>(PAGESZ, static_cast<size_t>(m_size) - a_pageNum * PAGESZ);
+		std::copy_n(ImagePage(a_pageNum), words, page->begin());
+		m_view[a_pageNum] = page->data();
+	}
+	m_dirty[a_pageNum] = 1;
+	m_dirtyPages.push_back(static_cast<int>(a_pageNum));
+}
+
+/// <summary>
+/// Points the view of every page at its private copy, or at the words of the image.
+/// </summary>
+void GuestMemory::BuildViews()
+{
+	m_view.resize(m_pages.size());
+	for (size_t i = 0; i < m_pages.size(); ++i) {
+		m_view[i] = m_pages[i] ? m_pages[i]->data() : ImagePage(i);
+	}
+}
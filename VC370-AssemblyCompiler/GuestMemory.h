@@ -0,0 +1,141 @@
+//
+//		GuestMemory class - the memory of the emulated VC370.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "PageGuard.h"
+#include <memory>
+
+// The classic 10,000 word machine keeps its memory in one dense array.  Larger address
+// spaces are divided into pages of PAGESZ words that are allocated when they are first
+// written, so the host memory follows the words a program actually uses.
+//
+// A memory can also be started from a shared image: it reads the pages of the image
+// until it writes to them, and then works on a private copy (copy on write).  The pages
+// written since the last Reset are kept in a dirty list, so Reset only copies those
+// pages back from the image.
+//
+// The dense array and the private pages start on host pages, so that PageGuard can
+// write-protect the pages that hold watched words.
+class GuestMemory {
+
+public:
+	static constexpr int PAGEBITS = 10;
+	static constexpr int PAGESZ = 1 << PAGEBITS;	// Words per page (4 KB of host memory)
+
+	// Memory of a_size words, all zero.
+	explicit GuestMemory(int a_size);
+
+	// Memory that starts as a copy of a_image and shares its pages until they are written.
+	explicit GuestMemory(std::shared_ptr<const GuestMemory> a_image);
+
+	// Copying duplicates the private pages; the image is shared.
+	GuestMemory(const GuestMemory& a_other);
+	GuestMemory& operator=(const GuestMemory& a_other);
+	GuestMemory(GuestMemory&&) noexcept = default;
+	GuestMemory& operator=(GuestMemory&&) noexcept = default;
+	~GuestMemory() = default;
+
+	// Reads a word.  Words that were never written are zero.
+	[[nodiscard]] int Read(int a_addr) const noexcept {
+		if (!m_dense.empty()) {
+			return m_dense[a_addr];
+		}
+		return m_view[a_addr >> PAGEBITS][a_addr & (PAGESZ - 1)];
+	}
+
+	// Writes a word, copying or allocating its page if needed.
+	void Write(int a_addr, int a_value) {
+		if (!m_dense.empty()) {
+			m_dense[a_addr] = a_value;
+			return;
+		}
+		const size_t pageNum = static_cast<size_t>(a_addr >> PAGEBITS);
+		if (!m_dirty[pageNum]) {
+			TouchPage(pageNum);
+		}
+		(*m_pages[pageNum])[a_addr & (PAGESZ - 1)] = a_value;
+	}
+
+	// Sets every word to zero, releases the pages and lets go of the image.
+	void Clear();
+
+	// Makes the memory equal to its image again by restoring the pages written since the last reset.
+	// A memory without an image is set to zero, a dense one entirely.
+	void Reset();
+
+	// Returns true if the memory was started from an image.
+	[[nodiscard]] bool HasImage() const noexcept { return m_image != nullptr; }
+
+	// The number of words of the address space.
+	[[nodiscard]] int GetSize() const noexcept { return m_size; }
+
+	// Returns true if the memory is a dense array.
+	[[nodiscard]] bool IsDense() const noexcept { return !m_dense.empty(); }
+
+	// The number of words backed by host memory.  The pages of a shared image are not counted.
+	[[nodiscard]] size_t GetAllocatedWords() const noexcept;
+
+	// The number of pages written since the last reset.
+	[[nodiscard]] size_t GetDirtyPageCount() const noexcept { return m_dirtyPages.size(); }
+
+	// The number of pages of a paged memory; a dense memory has none.
+	[[nodiscard]] size_t GetPageCount() const noexcept { return m_view.size(); }
+
+	// Returns true if the words of the memory can be watched: the host pages are no larger than the pages of the memory.
+	[[nodiscard]] bool CanProtect() const noexcept;
+
+	// The host memory that holds the word at a_addr, for PageGuard.  A page of a paged memory
+	// gets its private copy and stays dirty, so a run does not copy it while it is protected.
+	[[nodiscard]] PageGuard::Region GetRegion(int a_addr);
+
+	// Moves the list of dirty pages to a_pages and clears their dirty bits.  A later Reset
+	// only restores the pages written after this.
+	void TakeDirtyPages(std::vector<int>& a_pages);
+
+	// Copies the PAGESZ words of a page to a_words.  The words past the end of memory are zero.
+	void ReadPage(size_t a_pageNum, int* a_words) const;
+
+	// Sets the words of a page from a_words, or from the image if a_words is null, and marks it dirty.
+	void WritePage(size_t a_pageNum, const int* a_words);
+
+private:
+	// A page starts on a host page of the same size.
+	struct alignas(PAGESZ * sizeof(int)) Page : std::array<int, PAGESZ> { };
+
+	// Allocates the dense array on whole host pages of its own.
+	template <class T>
+	struct PageAllocator {
+		using value_type = T;
+		PageAllocator() = default;
+		template <class U> PageAllocator(const PageAllocator<U>&) noexcept { }
+		[[nodiscard]] T* allocate(size_t a_count) { return static_cast<T*>(PageGuard::AllocatePages(Bytes(a_count))); }
+		void deallocate(T* a_words, size_t a_count) noexcept { PageGuard::FreePages(a_words, Bytes(a_count)); }
+		[[nodiscard]] static size_t Bytes(size_t a_count) noexcept {
+			const size_t pageSize = PageGuard::GetHostPageSize();
+			return (a_count * sizeof(T) + pageSize - 1) / pageSize * pageSize;
+		}
+		friend bool operator==(const PageAllocator&, const PageAllocator&) noexcept { return true; }
+	};
+
+	// The page the views of unwritten pages point to.
+	static const Page ZeroPage;
+
+	// The words of page a_pageNum of the image (or of zero memory).
+	[[nodiscard]] const int* ImagePage(size_t a_pageNum) const noexcept;
+
+	// Gives a page its private copy and marks it dirty.
+	void TouchPage(size_t a_pageNum);
+
+	// Points the views at the private pages, and the others at the image.
+	void BuildViews();
+
+	int m_size;
+	std::vector<int, PageAllocator<int>> m_dense;	// The dense memory of the classic machine
+	std::shared_ptr<const GuestMemory> m_image;		// The image the memory was started from (may be null)
+	std::vector<const int*> m_view;					// The words of each page: private, from the image, or ZeroPage
+	std::vector<std::unique_ptr<Page>> m_pages;		// The private pages
+	std::vector<unsigned char> m_dirty;				// The dirty bitmap: 1 if the page was written since the last reset
+	std::vector<int> m_dirtyPages;					// The pages whose dirty bit is set
+};
@@ -0,0 +1,338 @@
+#include "HardwareProfile.h"
+#include "stdafx.h"
+#include "Emulator.h"
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// The profile of each thread; the counters interrupt the thread they count.
+static thread_local HardwareProfile* t_profile = nullptr;
+
+#ifdef __linux__
+
+/// <summary>
+/// Passes the overflow of a counter to the profile of the thread.
+/// </summary>
+/// <param name="a_info">The file descriptor of the counter</param>
+static void OnSignal(int, siginfo_t* a_info, void*)
+{
+	if (t_profile != nullptr) {
+		t_profile->OnOverflow(a_info->si_fd);
+	}
+}
+
+#endif
+
+/// <summary>
+/// Opens the counters and finds the basic blocks of the program: the entry location, an
+/// instruction that a branch goes to, and one that follows a branch or HALT start a block.
+/// </summary>
+/// <param name="a_emul">The emulator whose runs are profiled</param>
+HardwareProfile::HardwareProfile(const Emulator& a_emul)
+{
+	const int memorySize = a_emul.GetConfig().GetMemorySize();
+	const int extent = a_emul.GetClassifiedExtent();
+	m_locationCount = extent > 0 ? static_cast<size_t>(extent) : std::min(static_cast<size_t>(memorySize), MaxLocations);
+	m_executed.assign(m_locationCount + 1, 0);
+
+	// Location 0 starts a block too, so that every profiled location is in one
+	m_blockStarts = { 0, Emulator::EntryLocation };
+	for (int loc = 0; loc < static_cast<int>(m_locationCount); ++loc) {
+		if (extent > 0 && a_emul.GetWordKind(loc) != Emulator::WordKind::CODE) {
+			continue;
+		}
+		const int opCode = a_emul.GetWord(loc) / memorySize;
+		const int operand = a_emul.GetWord(loc) % memorySize;
+		if (opCode >= 9 && opCode <= 12) {
+			m_blockStarts.push_back(operand);
+		}
+		if (opCode >= 9 && opCode <= 13) {
+			m_blockStarts.push_back(loc + 1);
+		}
+	}
+	std::erase_if(m_blockStarts, [this](int a_loc) { return static_cast<size_t>(a_loc) >= m_locationCount; });
+	std::ranges::sort(m_blockStarts);
+	const auto duplicates = std::ranges::unique(m_blockStarts);
+	m_blockStarts.erase(duplicates.begin(), duplicates.end());
+
+	for (size_t event = 0; event < EventCount; ++event) {
+		Open(static_cast<Event>(event));
+	}
+}
+
+/// <summary>
+/// Closes the counters.
+/// </summary>
+HardwareProfile::~HardwareProfile()
+{
+	Stop();
+#ifdef __linux__
+	for (const Counter& counter : m_counters) {
+		if (counter.m_fd >= 0) {
+			close(counter.m_fd);
+		}
+	}
+#endif
+}
+
+/// <summary>
+/// Opens the counter of an event for the calling thread, disabled, with its overflow signal
+/// sent to this thread.  The periods give a few thousand samples a second.
+/// </summary>
+/// <param name="a_event">The event</param>
+void HardwareProfile::Open(Event a_event)
+{
+	Counter& counter = m_counters[static_cast<size_t>(a_event)];
+#ifdef __linux__
+	perf_event_attr attr{};
+	attr.size = sizeof(attr);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.wakeup_events = 1;
+
+	// Prime periods, so that the samples do not fall into step with the loops of the program
+	switch (a_event) {
+		case Event::TASK_CLOCK:
+			attr.type = PERF_TYPE_SOFTWARE;
+			attr.config = PERF_COUNT_SW_TASK_CLOCK;
+			counter.m_period = 100'003;
+			break;
+		case Event::CYCLES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			counter.m_period = 1'000'003;
+			break;
+		case Event::INSTRUCTIONS:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			counter.m_period = 1'000'003;
+			break;
+		case Event::BRANCH_MISSES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+			counter.m_period = 10'007;
+			break;
+		default:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			counter.m_period = 10'007;
+			break;
+	}
+	attr.sample_period = counter.m_period;
+
+	const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+	if (fd < 0) {
+		counter.m_error = std::strerror(errno);
+		return;
+	}
+
+	// Each overflow sends SIGIO, with the descriptor, to this thread
+	f_owner_ex owner{ F_OWNER_TID, static_cast<pid_t>(syscall(SYS_gettid)) };
+	if (fcntl(fd, F_SETFL, O_ASYNC) < 0 || fcntl(fd, F_SETSIG, SIGIO) < 0 || fcntl(fd, F_SETOWN_EX, &owner) < 0) {
+		counter.m_error = std::strerror(errno);
+		close(fd);
+		return;
+	}
+
+	InstallHandler();
+	counter.m_fd = fd;
+	counter.m_locations.assign(m_locationCount + 1, 0);
+#else
+	static_cast<void>(a_event);
+	counter.m_error = "needs the perf_event_open of Linux";
+#endif
+}
+
+/// <summary>
+/// Enables the counters.  Each one stops at its next overflow until the handler enables it again.
+/// </summary>
+void HardwareProfile::Start() noexcept
+{
+	t_profile = this;
+	m_runningFl = 1;
+#ifdef __linux__
+	for (const Counter& counter : m_counters) {
+		if (counter.m_fd >= 0) {
+			ioctl(counter.m_fd, PERF_EVENT_IOC_REFRESH, 1);
+		}
+	}
+#endif
+}
+
+/// <summary>
+/// Disables the counters and reads their totals.
+/// </summary>
+void HardwareProfile::Stop() noexcept
+{
+	if (m_runningFl == 0) {
+		return;
+	}
+	m_runningFl = 0;
+#ifdef __linux__
+	for (Counter& counter : m_counters) {
+		if (counter.m_fd < 0) {
+			continue;
+		}
+		ioctl(counter.m_fd, PERF_EVENT_IOC_DISABLE, 0);
+
+		// The count, and the times the counter was enabled and was running on the PMU
+		std::uint64_t values[3] = {};
+		if (read(counter.m_fd, values, sizeof(values)) == static_cast<ssize_t>(sizeof(values)) && values[2] > 0) {
+			counter.m_total = values[2] < values[1]
+				? static_cast<std::uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]) : values[0];
+		}
+	}
+#endif
+	t_profile = nullptr;
+}
+
+/// <summary>
+/// Attributes a period of the counter on a_fd to the instruction that runs, and enables it
+/// again.  Runs in the signal handler, so it only does arithmetic and system calls.
+/// </summary>
+/// <param name="a_fd">The file descriptor of the counter</param>
+void HardwareProfile::OnOverflow(int a_fd) noexcept
+{
+#ifdef __linux__
+	for (Counter& counter : m_counters) {
+		if (counter.m_fd != a_fd || counter.m_fd < 0) {
+			continue;
+		}
+		const int current = m_current;
+		counter.m_locations[static_cast<size_t>(current / Instruction::OpCodeLimit)] += counter.m_period;
+		counter.m_opCodes[static_cast<size_t>(current % Instruction::OpCodeLimit)] += counter.m_period;
+		if (m_runningFl != 0) {
+			ioctl(a_fd, PERF_EVENT_IOC_REFRESH, 1);
+		}
+	}
+#else
+	static_cast<void>(a_fd);
+#endif
+}
+
+/// <summary>
+/// Installs the SIGIO handler of the process, once.
+/// </summary>
+void HardwareProfile::InstallHandler()
+{
+#ifdef __linux__
+	static std::once_flag installed;
+	std::call_once(installed, [] {
+		struct sigaction action {};
+		action.sa_sigaction = OnSignal;
+		action.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGIO, &action, nullptr);
+	});
+#endif
+}
+
+/// <summary>
+/// Adds up the instructions and the samples of each basic block.
+/// </summary>
+/// <returns>The blocks in address order</returns>
+std::vector<HardwareProfile::Block> HardwareProfile::GetBlocks() const
+{
+	std::vector<Block> blocks;
+	blocks.reserve(m_blockStarts.size());
+	for (size_t i = 0; i < m_blockStarts.size(); ++i) {
+		const int last = i + 1 < m_blockStarts.size() ? m_blockStarts[i + 1] - 1 : static_cast<int>(m_locationCount) - 1;
+		Block block{ m_blockStarts[i], last };
+		for (int loc = block.m_first; loc <= block.m_last; ++loc) {
+			block.m_executed += m_executed[static_cast<size_t>(loc)];
+			for (size_t event = 0; event < EventCount; ++event) {
+				if (m_counters[event].m_fd >= 0) {
+					block.m_events[event] += m_counters[event].m_locations[static_cast<size_t>(loc)];
+				}
+			}
+		}
+		if (block.m_executed > 0) {
+			blocks.push_back(block);
+		}
+	}
+	return blocks;
+}
+
+/// <summary>
+/// Writes the profile.  The events of an opcode or a block are the periods of the samples
+/// taken while it ran, so small counts are rough.
+/// </summary>
+/// <param name="a_out">The stream the profile is written to</param>
+/// <param name="a_blockCount">The number of basic blocks listed</param>
+void HardwareProfile::WriteReport(std::ostream& a_out, size_t a_blockCount) const
+{
+	std::vector<size_t> events;
+	for (size_t event = 0; event < EventCount; ++event) {
+		const Counter& counter = m_counters[event];
+		if (counter.m_fd >= 0) {
+			events.push_back(event);
+		}
+		else {
+			a_out << std::format("Profile: {} not counted ({})\n", GetEventName(static_cast<Event>(event)), counter.m_error);
+		}
+	}
+
+	// The columns of the events that were counted
+	const auto header = [&](std::string_view a_first) {
+		a_out << std::format("{:<14}{:>16}", a_first, "guest-instr");
+		for (const size_t event : events) {
+			a_out << std::format("{:>16}", GetEventName(static_cast<Event>(event)));
+		}
+		a_out << '\n';
+	};
+	const auto row = [&](std::string_view a_first, std::uint64_t a_executed, const auto& a_eventOf) {
+		a_out << std::format("{:<14}{:>16}", a_first, a_executed);
+		for (const size_t event : events) {
+			a_out << std::format("{:>16}", a_eventOf(event));
+		}
+		a_out << '\n';
+	};
+
+	std::uint64_t executed = 0;
+	for (const std::uint64_t count : m_opCodeExecuted) {
+		executed += count;
+	}
+	a_out << "Profile by opcode:\n";
+	header("Opcode");
+	for (int opCode = 0; opCode < Instruction::OpCodeLimit; ++opCode) {
+		if (m_opCodeExecuted[static_cast<size_t>(opCode)] == 0) {
+			continue;
+		}
+		const std::string_view name = Instruction::GetOpCodeName(opCode);
+		row(name.empty() ? "invalid" : name, m_opCodeExecuted[static_cast<size_t>(opCode)],
+			[&](size_t a_event) { return m_counters[a_event].m_opCodes[static_cast<size_t>(opCode)]; });
+	}
+	row("total", executed, [&](size_t a_event) { return m_counters[a_event].m_total; });
+
+	// The blocks that took most of the first event counted, or that ran the most instructions
+	std::vector<Block> blocks = GetBlocks();
+	const size_t key = events.empty() ? EventCount : events.front();
+	std::ranges::sort(blocks, [key](const Block& a_left, const Block& a_right) {
+		if (key < EventCount && a_left.m_events[key] != a_right.m_events[key]) {
+			return a_left.m_events[key] > a_right.m_events[key];
+		}
+		return a_left.m_executed != a_right.m_executed ? a_left.m_executed > a_right.m_executed : a_left.m_first < a_right.m_first;
+	});
+	blocks.resize(std::min(blocks.size(), a_blockCount));
+
+	a_out << std::format("Profile by basic block ({} of the most {}):\n", blocks.size(),
+		key < EventCount ? GetEventName(static_cast<Event>(key)) : "guest-instr");
+	header("Block");
+	for (const Block& block : blocks) {
+		row(std::format("{}-{}", block.m_first, block.m_last), block.m_executed, [&](size_t a_event) { return block.m_events[a_event]; });
+	}
+	if (m_executed[m_locationCount] > 0) {
+		a_out << std::format("Profile: {} instructions beyond location {} are only in the totals by opcode\n",
+			m_executed[m_locationCount], m_locationCount - 1);
+	}
+}
@@ -0,0 +1,128 @@
+//
+//		HardwareProfile class - host performance counters attributed to the guest instructions that ran.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Instruction.h"
+#include <array>
+#include <cstdint>
+#include <csignal>
+
+class Emulator;
+
+// When we tune the emulator we need to know why a guest program is slow on the host, not
+// only how many guest instructions it ran.  A profile opens host counters with the Linux
+// perf_event_open: cycles, instructions, branch misses and L1 data cache read misses, and the
+// task clock, a software event that containers and virtual machines without a PMU usually
+// still have.  Each counter counts in the thread that runs the emulator and interrupts it
+// with SIGIO every m_period events.  A profiled run tells the profile, before each
+// instruction, where it is and what its opcode is, so the handler attributes the period to
+// that instruction.  Like any sampling profile the attribution is statistical; the totals
+// are exact, scaled if the kernel had to multiplex the counters.
+//
+// A counter that cannot be opened (no PMU, perf_event_paranoid, seccomp, another system) is
+// left out and its reason reported; the exact guest instruction counts by opcode and by basic
+// block are reported whatever counters there are.
+class HardwareProfile {
+
+public:
+	// The host events that are counted.
+	enum class Event {
+		TASK_CLOCK,			// Nanoseconds on the CPU
+		CYCLES,
+		INSTRUCTIONS,
+		BRANCH_MISSES,
+		L1D_MISSES,			// L1 data cache read misses
+		EVENT_COUNT
+	};
+
+	// Opens the counters for the runs of a_emul on the calling thread.  The basic blocks are
+	// found in its memory now, before the run; a program that writes its code keeps the old ones.
+	explicit HardwareProfile(const Emulator& a_emul);
+	~HardwareProfile();
+
+	// Prevent copying
+	HardwareProfile(const HardwareProfile&) = delete;
+	HardwareProfile& operator=(const HardwareProfile&) = delete;
+
+	// The counters count between Start and Stop, which a profiled run of the emulator calls.
+	void Start() noexcept;
+	void Stop() noexcept;
+
+	// Called by a profiled run before each instruction.
+	void Enter(int a_loc, int a_opCode) noexcept
+	{
+		const size_t slot = static_cast<size_t>(a_loc) < m_locationCount ? static_cast<size_t>(a_loc) : m_locationCount;
+		const int opCode = static_cast<unsigned>(a_opCode) < static_cast<unsigned>(Instruction::OpCodeLimit) ? a_opCode : 0;
+		++m_executed[slot];
+		++m_opCodeExecuted[opCode];
+		// One store, so the handler never sees the location of one instruction with the opcode of another
+		m_current = static_cast<int>(slot) * Instruction::OpCodeLimit + opCode;
+	}
+
+	// Returns true if the event is counted.
+	[[nodiscard]] bool IsAvailable(Event a_event) const noexcept { return m_counters[static_cast<size_t>(a_event)].m_fd >= 0; }
+
+	// Writes the totals, and the guest instructions and host events of each opcode and of
+	// the a_blockCount basic blocks with the most samples.
+	void WriteReport(std::ostream& a_out, size_t a_blockCount = DefaultBlockCount) const;
+
+	static constexpr size_t DefaultBlockCount = 10;
+
+	// Called by the signal handler when the counter on a_fd overflowed.
+	void OnOverflow(int a_fd) noexcept;
+
+private:
+	static constexpr size_t EventCount = static_cast<size_t>(Event::EVENT_COUNT);
+
+	// A program without the kinds of its words (e.g. a linked one) is profiled up to here;
+	// the instructions beyond share the last slot.
+	static constexpr size_t MaxLocations = 1 << 16;
+
+	// One host counter.
+	struct Counter {
+		int m_fd = -1;
+		std::uint64_t m_period = 0;					// The events between two samples
+		std::string m_error;						// Why it could not be opened
+		std::uint64_t m_total = 0;					// The events, as of the last Stop
+		std::vector<std::uint64_t> m_locations;		// The events attributed to each location
+		std::array<std::uint64_t, Instruction::OpCodeLimit> m_opCodes{};	// And to each opcode
+	};
+
+	// The totals of a basic block, for the report.
+	struct Block {
+		int m_first;
+		int m_last;
+		std::uint64_t m_executed = 0;
+		std::array<std::uint64_t, EventCount> m_events{};
+	};
+
+	[[nodiscard]] static constexpr std::string_view GetEventName(Event a_event) noexcept {
+		switch (a_event) {
+			case Event::TASK_CLOCK: return "task-clock-ns";
+			case Event::CYCLES: return "cycles";
+			case Event::INSTRUCTIONS: return "instructions";
+			case Event::BRANCH_MISSES: return "branch-misses";
+			case Event::L1D_MISSES: return "L1D-misses";
+			default: return "unknown";
+		}
+	}
+
+	// Opens one counter; records the reason if it cannot.
+	void Open(Event a_event);
+
+	// Installs the SIGIO handler of the process once.
+	static void InstallHandler();
+
+	// The basic blocks, with the totals of the instructions in them.
+	[[nodiscard]] std::vector<Block> GetBlocks() const;
+
+	std::array<Counter, EventCount> m_counters;
+	size_t m_locationCount;								// The locations profiled one by one
+	std::vector<std::uint64_t> m_executed;				// The instructions executed at each location
+	std::array<std::uint64_t, Instruction::OpCodeLimit> m_opCodeExecuted{};
+	std::vector<int> m_blockStarts;						// The first location of each basic block, in order
+	volatile std::sig_atomic_t m_current = 0;			// The location and opcode that run now
+	volatile std::sig_atomic_t m_runningFl = 0;			// Between Start and Stop
+};
@@ -13,10 +13,10 @@
 Instruction::InstructionType Instruction::ParseInstruction(std::string_view a_buff)
 {
     // Remove the comments from the instruction
-    std::string line = RemoveComment(a_buff);
+    const std::string_view line = RemoveComment(a_buff);
 
     // If after the comments are removed, the line is empty, then line is not an instruction of any kind
-    if (line.find_first_not_of(" \t\n\r\f\v") == std::string::npos)
+    if (line.find_first_not_of(Whitespace) == std::string_view::npos)
         return InstructionType::ST_COMMENT_OR_BLANK;
     
     // Divide the instruction into label, opCode and operand
@@ -38,17 +38,16 @@ Instruction::InstructionType Instruction::ParseInstruction(std::string_view a_bu
 /// <returns>Returns the numeric value of the operand</returns>
 int Instruction::GetNumericOpCodeValue() const noexcept
 {
-    // Use a map for cleaner lookup
-    static const std::unordered_map<std::string_view, int> opcodeMap = {
-        {"ADD", 1}, {"SUB", 2}, {"MULT", 3}, {"DIV", 4},
-        {"LOAD", 5}, {"STORE", 6}, {"READ", 7}, {"WRITE", 8},
-        {"B", 9}, {"BM", 10}, {"BZ", 11}, {"BP", 12}, {"HALT", 13}
-    };
+    return LookupOpCode(m_opCode, m_extendedFl);
+}
 
-    if (auto it = opcodeMap.find(m_opCode); it != opcodeMap.end()) {
-        return it->second;
-    }
-    return -1;
+/// <summary>
+/// Returns true if the operand of the instruction is a value rather than an address
+/// </summary>
+/// <returns>Returns true for the immediate instructions of the extended machine</returns>
+bool Instruction::TakesImmediate() const noexcept
+{
+    return m_extendedFl && IsImmediateOpCode(m_opCode);
 }
 
 /// <summary>
@@ -62,47 +61,23 @@ bool Instruction::IsOperandNumeric() const noexcept
 }
 
 /// <summary>
-/// Divides the instruction into label, opCode and operand
+/// Divides the instruction into label, opCode and operand.
+/// The elements are copied into the buffers of the previous instruction,
+/// so parsing a line does not allocate once the buffers are large enough.
 /// </summary>
 /// <param name="a_buff">The current line that is in the buffer</param>
 void Instruction::DivideInstruction(std::string_view a_buff)
 {
-    std::istringstream inst{std::string(a_buff)};
-
-    m_extra.clear();
-    m_label.clear();
-    m_opCode.clear();
-    m_operand.clear();
-
-    // If the buffer is empty, there is nothing to divide
-    if (a_buff.empty())
-        return;
-
-    // If the first character is not a space or a tab, then the line has a label
-    if (a_buff[0] != ' ' && a_buff[0] != '\t')
-    {
-        inst >> m_label;
-    }
-
-    inst >> m_opCode >> m_operand >> m_extra;
+    const Elements elements = SplitLine(a_buff);
+    m_label.assign(elements.m_label);
+    m_opCode.assign(elements.m_opCode);
+    m_operand.assign(elements.m_operand);
+    m_extra.assign(elements.m_extra);
 
     // We make the opCode uppercase to make it case insensitive
     toUpper(m_opCode);
 }
 
-/// <summary>
-/// Removes the comment from the instruction
-/// </summary>
-/// <param name="a_buff">The current line that is in the buffer</param>
-/// <returns>String without comment</returns>
-std::string Instruction::RemoveComment(std::string_view a_buff)
-{
-    if (const auto pos = a_buff.find(';'); pos != std::string_view::npos)
-        return std::string(a_buff.substr(0, pos));
-
-    return std::string(a_buff);
-}
-
 /// <summary>
 /// Makes all the characters in the string uppercase
 /// </summary>
@@ -128,5 +103,6 @@ bool Instruction::isAssemblyCode() const noexcept
 /// <returns>If the instruction is a machine language instruction, then return true; false otherwise</returns>
 bool Instruction::isMachineCode() const noexcept
 {
-    return std::ranges::find(MachineLangInstructions, m_opCode) != MachineLangInstructions.end();
+    return std::ranges::find(MachineLangInstructions, m_opCode) != MachineLangInstructions.end()
+        || (m_extendedFl && std::ranges::find(ExtendedLangInstructions, m_opCode) != ExtendedLangInstructions.end());
 }
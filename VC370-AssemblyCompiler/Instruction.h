@@ -1,6 +1,7 @@
 #pragma once
 
 #include "stdafx.h"
+#include <algorithm>
 #include <array>
 #include <string_view>
 
@@ -8,6 +9,10 @@ class Instruction
 {
 public:
 	Instruction() = default;
+
+	// An instruction of the extended machine (MachineConfig::IsExtended) also recognizes
+	// the extended machine language instructions.
+	explicit Instruction(bool a_extendedFl) noexcept : m_extendedFl(a_extendedFl) { }
 	~Instruction() = default;
 
 	enum class InstructionType {
@@ -22,6 +27,41 @@ public:
 	// the type of instruction
 	[[nodiscard]] InstructionType ParseInstruction(std::string_view a_buff);
 
+	// The elements of a line, as views into the line
+	struct Elements {
+		std::string_view m_label;
+		std::string_view m_opCode;		// As written, not made uppercase
+		std::string_view m_operand;
+		std::string_view m_extra;
+	};
+
+	// The lexer, usable in constant evaluation: divides a line without its comment into its elements
+	[[nodiscard]] static constexpr Elements SplitLine(std::string_view a_buff) noexcept;
+
+	// Removes the comment from a line
+	[[nodiscard]] static constexpr std::string_view RemoveComment(std::string_view a_buff) noexcept {
+		return a_buff.substr(0, a_buff.find(';'));
+	}
+
+	// The numeric value of an operation code (in any case), or -1 if it is not a machine
+	// language instruction of the machine
+	[[nodiscard]] static constexpr int LookupOpCode(std::string_view a_opCode, bool a_extendedFl) noexcept;
+
+	// The name of a numeric operation code, or an empty string if it is not an instruction
+	[[nodiscard]] static constexpr std::string_view GetOpCodeName(int a_opCode) noexcept;
+
+	// One past the highest numeric operation code of the extended machine
+	static constexpr int OpCodeLimit = 28;
+
+	// Returns true if the operation code (in any case) is an assembly language instruction
+	[[nodiscard]] static constexpr bool IsAssemblyOpCode(std::string_view a_opCode) noexcept;
+
+	// Returns true if the operation code (in any case) is an immediate instruction of the extended machine
+	[[nodiscard]] static constexpr bool IsImmediateOpCode(std::string_view a_opCode) noexcept;
+
+	// Compares an operation code with a name in uppercase, ignoring the case of the operation code
+	[[nodiscard]] static constexpr bool MatchesOpCode(std::string_view a_opCode, std::string_view a_name) noexcept;
+
 	// Gets the memory location of the next instruction
 	[[nodiscard]] static constexpr int NextInstructionLocation(int a_loc) noexcept {
 		return a_loc + 1;
@@ -48,14 +88,24 @@ public:
 	// Returns true if the instruction has an operand
 	[[nodiscard]] bool IsOperandBlank() const noexcept { return m_operand.empty(); }
 
+	// Returns true if the operand is a value (a number or the address of a label) rather than
+	// the address of a word: the immediate and the index register instructions of the extended machine
+	[[nodiscard]] bool TakesImmediate() const noexcept;
+
 	// Returns true if the operand is numeric
 	[[nodiscard]] bool IsOperandNumeric() const noexcept;
 
+	// Returns true if the instruction is an ENTRY or EXTRN directive
+	[[nodiscard]] bool IsLinkageDirective() const noexcept { return m_opCode == "ENTRY" || m_opCode == "EXTRN"; }
+
 private:
 	void DivideInstruction(std::string_view a_buff);
-	[[nodiscard]] static std::string RemoveComment(std::string_view a_buff);
+	[[nodiscard]] static constexpr std::string_view NextToken(std::string_view a_buff, size_t& a_pos) noexcept;
 	static void toUpper(std::string& a_str) noexcept;
 
+	// The characters that separate the elements of an instruction
+	static constexpr std::string_view Whitespace = " \t\n\v\f\r";
+
 	[[nodiscard]] bool isAssemblyCode() const noexcept;
 	[[nodiscard]] bool isMachineCode() const noexcept;
 
@@ -67,14 +117,145 @@ private:
 	std::string m_instruction;
 	InstructionType m_type{};
 
+	// True if the extended machine language instructions are recognized
+	bool m_extendedFl = false;
+
 	// Machine language instructions using std::array and string_view
 	static constexpr std::array<std::string_view, 13> MachineLangInstructions = {
 		"ADD", "SUB", "MULT", "DIV", "LOAD", "STORE", "READ", "WRITE", "B", "BM", "BZ", "BP", "HALT"
 	};
 	
+	// The machine language instructions of the extended machine, numbered from 14
+	static constexpr std::array<std::string_view, 14> ExtendedLangInstructions = {
+		"LDX", "STX", "LDXI", "ADXI", "LOADX", "STOREX", "ADDX",
+		"ADDI", "SUBI", "MULTI", "DIVI", "LOADI", "READB", "WRITEB"
+	};
+	static_assert(OpCodeLimit == MachineLangInstructions.size() + ExtendedLangInstructions.size() + 1);
+
+	// The extended instructions whose operand is a value
+	static constexpr std::array<std::string_view, 7> ImmediateInstructions = {
+		"LDXI", "ADXI", "ADDI", "SUBI", "MULTI", "DIVI", "LOADI"
+	};
+
 	// Assembly language instructions using std::array and string_view
-	static constexpr std::array<std::string_view, 4> AssemblyLangInstructions = {
-		"DC", "DS", "ORG", "END"
+	static constexpr std::array<std::string_view, 6> AssemblyLangInstructions = {
+		"DC", "DS", "ORG", "END", "ENTRY", "EXTRN"
 	};
 };
 
+/// <summary>
+/// Divides a line without its comment into label, opcode, operand and the extra elements.
+/// </summary>
+/// <param name="a_buff">The line without its comment</param>
+/// <returns>The elements; the label is empty unless the line starts with it</returns>
+constexpr Instruction::Elements Instruction::SplitLine(std::string_view a_buff) noexcept
+{
+	Elements elements;
+	if (a_buff.empty()) {
+		return elements;
+	}
+
+	size_t pos = 0;
+
+	// If the first character is not a space or a tab, then the line has a label
+	if (a_buff[0] != ' ' && a_buff[0] != '\t') {
+		elements.m_label = NextToken(a_buff, pos);
+	}
+
+	elements.m_opCode = NextToken(a_buff, pos);
+	elements.m_operand = NextToken(a_buff, pos);
+	elements.m_extra = NextToken(a_buff, pos);
+	return elements;
+}
+
+/// <summary>
+/// Reads the next whitespace separated element of a line, like operator>> would.
+/// </summary>
+/// <param name="a_buff">The line</param>
+/// <param name="a_pos">The position to read from; moved past the element</param>
+/// <returns>The element, or an empty view if there is none</returns>
+constexpr std::string_view Instruction::NextToken(std::string_view a_buff, size_t& a_pos) noexcept
+{
+	const size_t begin = a_buff.find_first_not_of(Whitespace, a_pos);
+	if (begin == std::string_view::npos) {
+		a_pos = a_buff.size();
+		return {};
+	}
+
+	const size_t end = std::min(a_buff.find_first_of(Whitespace, begin), a_buff.size());
+	a_pos = end;
+	return a_buff.substr(begin, end - begin);
+}
+
+/// <summary>
+/// Compares an operation code with a name in uppercase, ignoring the case of the operation code.
+/// </summary>
+/// <param name="a_opCode">The operation code as written</param>
+/// <param name="a_name">The name in uppercase</param>
+/// <returns>True if they are the same name</returns>
+constexpr bool Instruction::MatchesOpCode(std::string_view a_opCode, std::string_view a_name) noexcept
+{
+	return std::ranges::equal(a_opCode, a_name, [](char a_left, char a_right) {
+		return (a_left >= 'a' && a_left <= 'z' ? static_cast<char>(a_left - 'a' + 'A') : a_left) == a_right;
+	});
+}
+
+/// <summary>
+/// Returns the numeric value of an operation code: 1 to 13 for the classic instructions and
+/// 14 onwards for the extended ones.
+/// </summary>
+/// <param name="a_opCode">The operation code as written</param>
+/// <param name="a_extendedFl">True if the extended instructions are recognized</param>
+/// <returns>The value, or -1 if it is not a machine language instruction</returns>
+constexpr int Instruction::LookupOpCode(std::string_view a_opCode, bool a_extendedFl) noexcept
+{
+	for (size_t i = 0; i < MachineLangInstructions.size(); ++i) {
+		if (MatchesOpCode(a_opCode, MachineLangInstructions[i])) {
+			return static_cast<int>(i) + 1;
+		}
+	}
+	for (size_t i = 0; a_extendedFl && i < ExtendedLangInstructions.size(); ++i) {
+		if (MatchesOpCode(a_opCode, ExtendedLangInstructions[i])) {
+			return static_cast<int>(MachineLangInstructions.size() + i) + 1;
+		}
+	}
+	return -1;
+}
+
+/// <summary>
+/// Returns the name of a numeric operation code, the inverse of LookupOpCode.
+/// </summary>
+/// <param name="a_opCode">The numeric operation code</param>
+/// <returns>The name in uppercase, or an empty string if it is not an instruction</returns>
+constexpr std::string_view Instruction::GetOpCodeName(int a_opCode) noexcept
+{
+	if (a_opCode >= 1 && a_opCode <= static_cast<int>(MachineLangInstructions.size())) {
+		return MachineLangInstructions[a_opCode - 1];
+	}
+	const int extended = a_opCode - static_cast<int>(MachineLangInstructions.size()) - 1;
+	if (extended >= 0 && extended < static_cast<int>(ExtendedLangInstructions.size())) {
+		return ExtendedLangInstructions[extended];
+	}
+	return {};
+}
+
+/// <summary>
+/// Returns true if the operation code is an assembly language instruction.
+/// </summary>
+/// <param name="a_opCode">The operation code as written</param>
+/// <returns>True for DC, DS, ORG, END, ENTRY and EXTRN</returns>
+constexpr bool Instruction::IsAssemblyOpCode(std::string_view a_opCode) noexcept
+{
+	return std::ranges::any_of(AssemblyLangInstructions, [&](std::string_view a_name) { return MatchesOpCode(a_opCode, a_name); });
+}
+
+/// <summary>
+/// Returns true if the operation code is an immediate instruction of the extended machine.
+/// </summary>
+/// <param name="a_opCode">The operation code as written</param>
+/// <returns>True if the operand of the instruction is a value</returns>
+constexpr bool Instruction::IsImmediateOpCode(std::string_view a_opCode) noexcept
+{
+	return std::ranges::any_of(ImmediateInstructions, [&](std::string_view a_name) { return MatchesOpCode(a_opCode, a_name); });
+}
+
@@ -0,0 +1,96 @@
+#include "Linker.h"
+#include "stdafx.h"
+#include "Error.h"
+
+/// <summary>
+/// Links the modules into the emulator's memory.
+/// The first module is loaded at the locations it was assembled for, since execution
+/// starts at location 100.  Every other module is moved right after the highest location
+/// used so far (including storage reserved with DS): the operands listed in its relocation
+/// entries and its exported symbols are shifted by the same amount.  Finally every external
+/// reference is patched with the final location of the exported symbol it names.
+/// </summary>
+/// <param name="a_emul">The emulator that receives the linked image</param>
+/// <returns>True if the modules were linked without errors</returns>
+bool Linker::Link(Emulator& a_emul)
+{
+	std::vector<int> offsets;				// The relocation offset of each module
+	std::map<std::string, int> globals;		// The final location of each exported symbol
+	int nextFree = 0;						// The first location after the modules placed so far
+	bool linkedFl = true;
+	const MachineConfig& config = a_emul.GetConfig();
+
+	// Place the modules and collect the exported symbols
+	for (const auto& module : m_modules) {
+		const auto& words = module.GetWords();
+		int offset = 0;
+
+		if (!words.empty()) {
+			if (!offsets.empty()) {
+				offset = nextFree - words.begin()->first;
+			}
+			const int end = std::max(words.rbegin()->first + 1, module.GetEnd());
+			nextFree = std::max(nextFree, end + offset);
+		}
+		offsets.push_back(offset);
+
+		// All the modules must be assembled for the machine they are linked for
+		if (module.GetConfig() != config) {
+			Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_INCOMPATIBLE_MODULE, nextFree));
+			return false;
+		}
+
+		if (nextFree > a_emul.GetConfig().GetMemorySize()) {
+			Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MEMORY_OVERFLOW, nextFree));
+			return false;
+		}
+
+		for (const auto& [symbol, loc] : module.GetExports()) {
+			if (!globals.emplace(symbol, loc + offset).second) {
+				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_MULTIPLY_DEFINED_EXTERNAL, loc + offset));
+				linkedFl = false;
+			}
+		}
+	}
+
+	// Relocate the words and resolve the external references
+	for (size_t i = 0; i < m_modules.size(); ++i) {
+		const auto& module = m_modules[i];
+		const int offset = offsets[i];
+		std::map<int, int> words;
+
+		for (const auto& [loc, word] : module.GetWords()) {
+			words[loc + offset] = word;
+		}
+
+		for (const int loc : module.GetRelocations()) {
+			if (auto it = words.find(loc + offset); it != words.end()) {
+				it->second += offset;
+			}
+		}
+
+		for (const auto& ref : module.GetExternalRefs()) {
+			auto global = globals.find(ref.m_symbol);
+			auto it = words.find(ref.m_loc + offset);
+			if (global == globals.end() || it == words.end()) {
+				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_UNRESOLVED_EXTERNAL, ref.m_loc + offset));
+				linkedFl = false;
+				continue;
+			}
+			// The operand holds what an expression such as TABLE+3 adds to the symbol
+			const int operand = global->second + config.GetOperand(it->second);
+			if (operand >= config.GetMemorySize()) {
+				Error::RecordError(Error::ErrorMsg(Error::ErrorCode::ERR_OPERAND_OVERFLOW, ref.m_loc + offset));
+				linkedFl = false;
+				continue;
+			}
+			it->second = config.MakeWord(config.GetOpCode(it->second), operand);
+		}
+
+		for (const auto& [loc, word] : words) {
+			a_emul.InsertMemory(loc, config.GetOpCode(word), config.GetOperand(word));
+		}
+	}
+
+	return linkedFl;
+}
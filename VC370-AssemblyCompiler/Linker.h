@@ -0,0 +1,24 @@
+//
+//		Linker class - combines relocatable object modules into one emulator image.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "ObjectModule.h"
+#include "Emulator.h"
+
+class Linker {
+
+public:
+	Linker() = default;
+	~Linker() = default;
+
+	// Adds a module to be linked.  Modules are placed in the order they are added.
+	void AddModule(ObjectModule a_module) { m_modules.push_back(std::move(a_module)); }
+
+	// Places the modules, resolves the external references and loads the result into the emulator.
+	bool Link(Emulator& a_emul);
+
+private:
+	std::vector<ObjectModule> m_modules;
+};
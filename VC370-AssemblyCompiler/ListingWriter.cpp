@@ -0,0 +1,280 @@
+#include "ListingWriter.h"
+#include "stdafx.h"
+#include <bit>
+
+/// <summary>
+/// Starts the writer thread on a stream.
+/// </summary>
+/// <param name="a_out">The stream the listing goes to</param>
+/// <param name="a_operandDigits">The number of digits of an operand, for the words of the listing</param>
+void ListingWriter::Start(std::ostream& a_out, int a_operandDigits)
+{
+	Finish();
+
+	m_out = &a_out;
+	m_operandDigits = a_operandDigits;
+	if (m_ring.empty()) {
+		m_ring.resize(RingSize);
+		m_text.resize(TextSize);
+	}
+	m_buffer.reserve(BufferSize);
+	m_thread = std::thread(&ListingWriter::Run, this);
+}
+
+/// <summary>
+/// Writes the rest of the listing and stops the writer thread.
+/// </summary>
+void ListingWriter::Finish()
+{
+	if (!m_thread.joinable()) {
+		return;
+	}
+	SendCommand(Command::STOP);
+	m_thread.join();
+}
+
+/// <summary>
+/// Waits until the writer thread has written everything it was given to the stream,
+/// so that the caller can use the stream, e.g. before pausing.
+/// </summary>
+void ListingWriter::Flush()
+{
+	if (m_thread.joinable()) {
+		SendCommand(Command::FLUSH);
+	}
+}
+
+/// <summary>
+/// Adds a line of the translation, or text, to the listing.  The record is copied, so the
+/// line may change as soon as this returns.
+/// </summary>
+/// <param name="a_kind">What the line shows</param>
+/// <param name="a_loc">The location of the line</param>
+/// <param name="a_opCode">The opcode of the word generated, -1 if it is invalid</param>
+/// <param name="a_operand">The operand of the word generated, -1 if it is invalid</param>
+/// <param name="a_line">The source line, or the text</param>
+/// <param name="a_errors">The errors listed under the line</param>
+void ListingWriter::Write(Kind a_kind, int a_loc, int a_opCode, int a_operand, std::string_view a_line, std::span<const Error::ErrorMsg> a_errors)
+{
+	const size_t bytes = a_line.size() + a_errors.size();
+
+	// A record that does not fit in the text ring waits for the writer to go idle, so the ring can grow
+	if (bytes > m_text.size()) {
+		Flush();
+		m_text.resize(std::bit_ceil(bytes));
+	}
+
+	Record& record = Reserve(bytes);
+	record.m_command = Command::WRITE;
+	record.m_kind = a_kind;
+	record.m_loc = a_loc;
+	record.m_opCode = a_opCode;
+	record.m_operand = a_operand;
+	record.m_offset = m_textIn;
+	record.m_length = a_line.size();
+	record.m_errorCount = a_errors.size();
+	CopyIn(a_line.data(), a_line.size());
+	for (const auto& error : a_errors) {
+		const char code = static_cast<char>(error.m_emsg);
+		CopyIn(&code, 1);
+	}
+	Publish();
+}
+
+/// <summary>
+/// Waits until there is a free record in the ring and room for the text of the record.
+/// </summary>
+/// <param name="a_bytes">The bytes of text of the record; at most the size of the text ring</param>
+/// <returns>The record at the tail of the ring</returns>
+ListingWriter::Record& ListingWriter::Reserve(size_t a_bytes)
+{
+	const size_t tail = m_tail.load(std::memory_order_relaxed);
+	size_t head = m_head.load(std::memory_order_acquire);
+	// The writer thread gives back the text before the records, so a full text ring means a record is in flight
+	while (tail - head == m_ring.size() || m_textIn + a_bytes - m_textOut.load(std::memory_order_acquire) > m_text.size()) {
+		m_head.wait(head, std::memory_order_acquire);
+		head = m_head.load(std::memory_order_acquire);
+	}
+	return m_ring[tail & (m_ring.size() - 1)];
+}
+
+/// <summary>
+/// Copies bytes to the text ring, wrapping around at its end.
+/// </summary>
+/// <param name="a_data">The bytes</param>
+/// <param name="a_length">The number of bytes</param>
+void ListingWriter::CopyIn(const char* a_data, size_t a_length)
+{
+	const size_t start = m_textIn & (m_text.size() - 1);
+	const size_t first = std::min(a_length, m_text.size() - start);
+	std::copy_n(a_data, first, m_text.begin() + static_cast<std::ptrdiff_t>(start));
+	std::copy_n(a_data + first, a_length - first, m_text.begin());
+	m_textIn += a_length;
+}
+
+/// <summary>
+/// Makes the record at the tail visible to the writer thread.
+/// </summary>
+void ListingWriter::Publish()
+{
+	m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	m_tail.notify_one();
+}
+
+/// <summary>
+/// Sends FLUSH or STOP and waits until the writer thread has carried it out.
+/// </summary>
+/// <param name="a_command">The command</param>
+void ListingWriter::SendCommand(Command a_command)
+{
+	Record& record = Reserve(0);
+	record.m_command = a_command;
+	record.m_offset = m_textIn;
+	record.m_length = 0;
+	record.m_errorCount = 0;
+	Publish();
+
+	const size_t target = ++m_commandsSent;
+	size_t done = m_commandsDone.load(std::memory_order_acquire);
+	while (done < target) {
+		m_commandsDone.wait(done, std::memory_order_acquire);
+		done = m_commandsDone.load(std::memory_order_acquire);
+	}
+}
+
+/// <summary>
+/// The writer thread: renders the records in the order they were published until STOP.
+/// </summary>
+void ListingWriter::Run()
+{
+	size_t head = m_head.load(std::memory_order_relaxed);
+	while (true) {
+		size_t tail = m_tail.load(std::memory_order_acquire);
+		while (tail == head) {
+			m_tail.wait(tail, std::memory_order_acquire);
+			tail = m_tail.load(std::memory_order_acquire);
+		}
+
+		for (; head != tail; ++head) {
+			const Record& record = m_ring[head & (m_ring.size() - 1)];
+			if (record.m_command == Command::WRITE) {
+				Render(record);
+				m_textOut.store(record.m_offset + record.m_length + record.m_errorCount, std::memory_order_release);
+				if (m_buffer.size() >= BufferSize) {
+					WriteBuffer();
+				}
+				continue;
+			}
+
+			WriteBuffer();
+			const bool stopFl = record.m_command == Command::STOP;
+			m_head.store(head + 1, std::memory_order_release);
+			m_commandsDone.fetch_add(1, std::memory_order_release);
+			m_commandsDone.notify_one();
+			if (stopFl) {
+				return;
+			}
+		}
+
+		m_head.store(head, std::memory_order_release);
+		m_head.notify_one();
+	}
+}
+
+/// <summary>
+/// Appends the text of a record to the buffer.  The lines have the layout of
+/// "{:10}{:10}     {}" for a word, "{:10}{:15}{}" for a location and "{:20}     {}"
+/// for a statement, followed by one line per error.
+/// </summary>
+/// <param name="a_record">The record to be rendered</param>
+void ListingWriter::Render(const Record& a_record)
+{
+	switch (a_record.m_kind) {
+		case Kind::TEXT:
+			AppendText(a_record.m_offset, a_record.m_length);
+			return;
+		case Kind::STATEMENT:
+			m_buffer.append(25, ' ');
+			break;
+		case Kind::WORD: {
+			AppendNumber(a_record.m_loc, 10, ' ');
+			const size_t start = m_buffer.size();
+			if (a_record.m_opCode == -1) {
+				m_buffer += "??";
+			}
+			else {
+				AppendNumber(a_record.m_opCode, 2, '0');
+			}
+			if (a_record.m_operand == -1) {
+				m_buffer.append(m_operandDigits, '?');
+			}
+			else {
+				AppendNumber(a_record.m_operand, m_operandDigits, '0');
+			}
+			const size_t width = m_buffer.size() - start;
+			m_buffer.append((width < 10 ? 10 - width : 0) + 5, ' ');
+			break;
+		}
+		case Kind::LOCATION:
+			AppendNumber(a_record.m_loc, 10, ' ');
+			m_buffer.append(15, ' ');
+			break;
+	}
+	AppendText(a_record.m_offset, a_record.m_length);
+	m_buffer += '\n';
+
+	const size_t errorStart = a_record.m_offset + a_record.m_length;
+	for (size_t i = 0; i < a_record.m_errorCount; ++i) {
+		m_buffer += Error::GetListingString(static_cast<Error::ErrorCode>(ByteAt(errorStart + i)));
+		m_buffer += '\n';
+	}
+}
+
+/// <summary>
+/// Appends bytes of the text ring to the buffer, wrapping around at its end.
+/// </summary>
+/// <param name="a_offset">The running offset of the first byte</param>
+/// <param name="a_length">The number of bytes</param>
+void ListingWriter::AppendText(size_t a_offset, size_t a_length)
+{
+	const size_t start = a_offset & (m_text.size() - 1);
+	const size_t first = std::min(a_length, m_text.size() - start);
+	m_buffer.append(m_text.data() + start, first);
+	m_buffer.append(m_text.data(), a_length - first);
+}
+
+/// <summary>
+/// Appends a non-negative number, right-aligned in a field of a_width characters.
+/// A number wider than the field is appended in full.
+/// </summary>
+/// <param name="a_value">The number</param>
+/// <param name="a_width">The width of the field</param>
+/// <param name="a_fill">The character the field is padded with</param>
+void ListingWriter::AppendNumber(int a_value, int a_width, char a_fill)
+{
+	char digits[16];
+	int count = 0;
+	unsigned value = static_cast<unsigned>(a_value);
+	do {
+		digits[count++] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+
+	if (count < a_width) {
+		m_buffer.append(static_cast<size_t>(a_width - count), a_fill);
+	}
+	while (count > 0) {
+		m_buffer += digits[--count];
+	}
+}
+
+/// <summary>
+/// Writes the buffer to the stream and empties it.
+/// </summary>
+void ListingWriter::WriteBuffer()
+{
+	if (!m_buffer.empty()) {
+		m_out->write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+		m_buffer.clear();
+	}
+}
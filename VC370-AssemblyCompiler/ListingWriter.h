@@ -0,0 +1,113 @@
+//
+//		ListingWriter class - formats the listing of Pass II and writes it on a thread of its own.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Error.h"
+#include <atomic>
+#include <thread>
+
+// Pass II hands the writer compact records through a single-producer single-consumer
+// ring; the text of the records and their error codes go through a second ring of bytes,
+// so the writer allocates nothing once it has started.  The writer thread renders them
+// with its own fixed-width formatting into a large buffer and writes the buffer to the
+// stream when it fills up or on Flush, so formatting and I/O are off the critical path of
+// the translation.  The text is the same as the std::format listing it replaces.
+class ListingWriter {
+
+public:
+	// What a record adds to the listing.
+	enum class Kind {
+		TEXT,		// The text as it is
+		STATEMENT,	// A source line without a location
+		WORD,		// The location, the word generated and the source line
+		LOCATION	// The location and the source line
+	};
+
+	static constexpr size_t RingSize = 1024;			// Records in flight; a power of two
+	static constexpr size_t TextSize = 64 * 1024;		// Bytes of text in flight; a power of two
+	static constexpr size_t BufferSize = 64 * 1024;		// Bytes collected before they are written
+
+	ListingWriter() = default;
+	~ListingWriter() { Finish(); }
+
+	// Prevent copying
+	ListingWriter(const ListingWriter&) = delete;
+	ListingWriter& operator=(const ListingWriter&) = delete;
+
+	// Starts the writer thread.  Nothing else may write to a_out until Flush or Finish.
+	void Start(std::ostream& a_out, int a_operandDigits);
+
+	// Writes everything and stops the writer thread.  Does nothing if it is not running.
+	void Finish();
+
+	// Waits until everything written so far is in the stream.
+	void Flush();
+
+	// Adds text to the listing.
+	void WriteText(std::string_view a_text) { Write(Kind::TEXT, 0, 0, 0, a_text, {}); }
+
+	// Adds a line of the translation followed by its errors.  The word is formatted as
+	// by Emulator::FormatMemoryContent, with -1 for an invalid part.
+	void Write(Kind a_kind, int a_loc, int a_opCode, int a_operand, std::string_view a_line, std::span<const Error::ErrorMsg> a_errors);
+
+private:
+	// What the writer thread does with a record.
+	enum class Command { WRITE, FLUSH, STOP };
+
+	// An entry of the ring.  Its text is followed by one byte per error code in the text ring.
+	struct Record {
+		Command m_command = Command::WRITE;
+		Kind m_kind = Kind::TEXT;
+		int m_loc = 0;
+		int m_opCode = 0;
+		int m_operand = 0;
+		size_t m_offset = 0;		// Where the text starts, as a count of the bytes sent before it
+		size_t m_length = 0;		// The bytes of text
+		size_t m_errorCount = 0;	// The error codes after the text
+	};
+
+	// Waits for a free record at the tail of the ring and for a_bytes of room in the text ring.
+	[[nodiscard]] Record& Reserve(size_t a_bytes);
+
+	// Copies bytes to the text ring.
+	void CopyIn(const char* a_data, size_t a_length);
+
+	// The byte of the text ring at a running offset.
+	[[nodiscard]] char ByteAt(size_t a_offset) const noexcept { return m_text[a_offset & (m_text.size() - 1)]; }
+
+	// Hands the reserved record to the writer thread.
+	void Publish();
+
+	// Sends a command without text and returns after the writer thread has taken it.
+	void SendCommand(Command a_command);
+
+	// The writer thread.
+	void Run();
+
+	// Appends the text of a record to the buffer.
+	void Render(const Record& a_record);
+
+	// Appends bytes of the text ring to the buffer.
+	void AppendText(size_t a_offset, size_t a_length);
+
+	// Appends a number right-aligned, padded with a_fill to a_width characters.
+	void AppendNumber(int a_value, int a_width, char a_fill);
+
+	// Writes the buffer to the stream.
+	void WriteBuffer();
+
+	std::ostream* m_out = nullptr;
+	int m_operandDigits = 0;
+	std::vector<Record> m_ring;
+	std::vector<char> m_text;
+	alignas(64) std::atomic<size_t> m_head{ 0 };		// The next record the writer thread takes
+	std::atomic<size_t> m_textOut{ 0 };					// The bytes of text the writer thread is done with
+	alignas(64) std::atomic<size_t> m_tail{ 0 };		// The next record Pass II fills
+	alignas(64) std::atomic<size_t> m_commandsDone{ 0 };	// The FLUSH and STOP commands carried out
+	size_t m_textIn = 0;								// The bytes of text sent
+	size_t m_commandsSent = 0;
+	std::string m_buffer;
+	std::thread m_thread;
+};
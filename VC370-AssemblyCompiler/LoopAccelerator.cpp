@@ -0,0 +1,178 @@
+#include "LoopAccelerator.h"
+#include "Classifier.h"
+#include "stdafx.h"
+
+// The opcodes the accelerator looks at.
+static constexpr int OpAdd = 1;
+static constexpr int OpSub = 2;
+static constexpr int OpLoad = 5;
+static constexpr int OpStore = 6;
+static constexpr int OpBranchMinus = 10;
+static constexpr int OpBranchPlus = 12;
+static constexpr int OpAddImmediate = 21;
+static constexpr int OpSubImmediate = 22;
+static constexpr int OpLoadImmediate = 25;
+
+/// <summary>
+/// Finds the reachable conditional branches back to an earlier location, or to
+/// themselves, and keeps the loops they close that can be run in closed form.
+/// </summary>
+/// <returns>What the analysis found</returns>
+LoopAccelerator::Report LoopAccelerator::Accelerate()
+{
+	Report report;
+
+	std::vector<char> reachable;
+	std::vector<int> written;
+	int extent = 0;
+	static_cast<void>(Classifier::FindReachable(m_emul, reachable, written, extent));
+
+	std::vector<Emulator::Loop> loops;
+	for (int loc = 0; loc < extent; ++loc) {
+		const int word = m_emul.GetWord(loc);
+		const int opcode = m_config.GetOpCode(word);
+		const int operand = m_config.GetOperand(word);
+		if (!reachable[loc] || opcode < OpBranchMinus || opcode > OpBranchPlus || operand > loc) {
+			continue;
+		}
+
+		++report.m_backwardBranches;
+		Emulator::Loop loop;
+		if (Analyse(operand, loc, loop)) {
+			loops.push_back(std::move(loop));
+		}
+	}
+
+	report.m_loops = m_emul.SetLoops(std::move(loops));
+	return report;
+}
+
+/// <summary>
+/// Runs one iteration of a loop on symbolic values.  Each variable starts as itself; a word
+/// the loop never stores is a term of its own.  The results of the additions and
+/// subtractions are kept, as the emulator must check that none of them wraps around.
+/// </summary>
+/// <param name="a_head">The first location of the loop</param>
+/// <param name="a_branch">The location of the conditional branch that closes it</param>
+/// <param name="a_loop">Set to the loop</param>
+/// <returns>False if the loop cannot be run in closed form</returns>
+bool LoopAccelerator::Analyse(int a_head, int a_branch, Emulator::Loop& a_loop) const
+{
+	const bool extendedFl = m_config.IsExtended();
+
+	a_loop.m_head = a_head;
+	a_loop.m_branch = a_branch;
+	a_loop.m_branchOpCode = m_config.GetOpCode(m_emul.GetWord(a_branch));
+	a_loop.m_vars = { -1 };
+	for (int loc = a_head; loc <= a_branch; ++loc) {
+		const int word = m_emul.GetWord(loc);
+		a_loop.m_code.push_back(word);
+		if (loc == a_branch) {
+			break;
+		}
+
+		const int opcode = m_config.GetOpCode(word);
+		const int operand = m_config.GetOperand(word);
+		switch (opcode) {
+			case OpAdd:
+			case OpSub:
+			case OpLoad:
+				break;
+			case OpStore:
+				if (operand >= a_head && operand <= a_branch) {
+					return false;
+				}
+				if (std::ranges::find(a_loop.m_vars, operand) == a_loop.m_vars.end()) {
+					a_loop.m_vars.push_back(operand);
+				}
+				break;
+			case OpAddImmediate:
+			case OpSubImmediate:
+			case OpLoadImmediate:
+				if (!extendedFl) {
+					return false;
+				}
+				break;
+			default:
+				return false;
+		}
+	}
+	if (a_loop.m_vars.size() > Emulator::MaxLoopVariables) {
+		return false;
+	}
+
+	// The value of each variable as the iteration goes; the accumulator is the first
+	std::vector<Emulator::LoopValue> current(a_loop.m_vars.size());
+	for (size_t var = 0; var < current.size(); ++var) {
+		current[var].m_var = static_cast<int>(var);
+	}
+	const auto varOf = [&](int a_addr) {
+		const auto it = std::ranges::find(a_loop.m_vars.begin() + 1, a_loop.m_vars.end(), a_addr);
+		return it == a_loop.m_vars.end() ? -1 : static_cast<int>(it - a_loop.m_vars.begin());
+	};
+	const auto wordAt = [&](int a_addr) {
+		const int var = varOf(a_addr);
+		return var >= 0 ? current[var] : Emulator::LoopValue{ -1, { { a_addr, 1 } }, 0 };
+	};
+
+	Emulator::LoopValue& accum = current[0];
+	for (int loc = a_head; loc < a_branch; ++loc) {
+		const int word = m_emul.GetWord(loc);
+		const int opcode = m_config.GetOpCode(word);
+		const int operand = m_config.GetOperand(word);
+		switch (opcode) {
+			case OpLoad:
+				accum = wordAt(operand);
+				break;
+			case OpLoadImmediate:
+				accum = Emulator::LoopValue{ -1, {}, operand };
+				break;
+			case OpStore:
+				current[varOf(operand)] = accum;
+				break;
+			default: {
+				const Emulator::LoopValue value = opcode == OpAdd || opcode == OpSub ? wordAt(operand) : Emulator::LoopValue{ -1, {}, operand };
+				if (!Combine(accum, value, opcode == OpSub || opcode == OpSubImmediate ? -1 : 1)) {
+					return false;
+				}
+				a_loop.m_sums.push_back(accum);
+				break;
+			}
+		}
+	}
+	a_loop.m_next = std::move(current);
+
+	// A variable whose value is used must come back as itself plus what does not change
+	const auto drifts = [&](const Emulator::LoopValue& a_value) {
+		return a_value.m_var < 0 || a_loop.m_next[a_value.m_var].m_var == a_value.m_var;
+	};
+	return std::ranges::all_of(a_loop.m_next, drifts) && std::ranges::all_of(a_loop.m_sums, drifts);
+}
+
+/// <summary>
+/// Adds a symbolic value to a sum, or subtracts it.  The terms of the same word are merged.
+/// </summary>
+/// <param name="a_sum">The sum; updated</param>
+/// <param name="a_value">The value</param>
+/// <param name="a_sign">1 to add the value, -1 to subtract it</param>
+/// <returns>False if the result would hold two variables or a variable subtracted</returns>
+bool LoopAccelerator::Combine(Emulator::LoopValue& a_sum, const Emulator::LoopValue& a_value, int a_sign)
+{
+	if (a_value.m_var >= 0) {
+		if (a_sum.m_var >= 0 || a_sign < 0) {
+			return false;
+		}
+		a_sum.m_var = a_value.m_var;
+	}
+	for (const Emulator::LoopTerm& term : a_value.m_terms) {
+		const auto it = std::ranges::find(a_sum.m_terms, term.m_addr, &Emulator::LoopTerm::m_addr);
+		if (it != a_sum.m_terms.end()) {
+			it->m_coeff += a_sign * term.m_coeff;
+		}
+		else {
+			a_sum.m_terms.push_back({ term.m_addr, a_sign * term.m_coeff });
+		}
+	}
+	a_sum.m_const += a_sign * a_value.m_const;
+	return true;
+}
@@ -0,0 +1,46 @@
+//
+//		LoopAccelerator class - finds the loops of a VC370 image that the emulator can run in closed form.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Emulator.h"
+
+// Counting loops spend most of a run going round a few instructions: load a counter, add
+// or subtract a step, store it back and branch while it is positive.  The accelerator
+// looks for reachable loops made of straight LOAD, STORE, ADD and SUB (and LOADI, ADDI and
+// SUBI on the extended machine) that end in BM, BZ or BP back to their first instruction,
+// with no READ, WRITE or indexing and no store into the loop itself.  It works out one
+// iteration symbolically.  The loop is accepted when each value it computes is a variable
+// (the accumulator or a word the loop stores) plus words the loop only reads plus a constant,
+// and each variable whose value is used comes back as itself plus such an amount.  Then the
+// values of any iteration follow from those of the first, and the emulator can run ahead
+// all the iterations before the first one that wraps around the word size or leaves the
+// loop; the interpreter runs that one.
+class LoopAccelerator {
+
+public:
+	// What the analysis found.
+	struct Report {
+		size_t m_backwardBranches = 0;	// Reachable BM, BZ and BP instructions that branch back
+		size_t m_loops = 0;				// Loops the emulator can run in closed form
+	};
+
+	explicit LoopAccelerator(Emulator& a_emul) noexcept : m_emul(a_emul), m_config(a_emul.GetConfig()) { }
+	~LoopAccelerator() = default;
+
+	// Finds the loops and installs them in the emulator, after the successors of the Optimizer.
+	Report Accelerate();
+
+private:
+	// Works out one iteration of the loop from a_head to the branch at a_branch.  Returns
+	// false if the loop cannot be run in closed form.
+	[[nodiscard]] bool Analyse(int a_head, int a_branch, Emulator::Loop& a_loop) const;
+
+	// Adds a_value to, or subtracts it from, a_sum.  Returns false if the result would hold
+	// two variables or a variable subtracted.
+	[[nodiscard]] static bool Combine(Emulator::LoopValue& a_sum, const Emulator::LoopValue& a_value, int a_sign);
+
+	Emulator& m_emul;
+	MachineConfig m_config;
+};
@@ -0,0 +1,66 @@
+//
+//		MachineConfig class - the dimensions of the VC370 address space.
+//
+#pragma once
+
+#include <string>
+
+// The default operand width can be changed at build time, e.g. /DVC370_OPERAND_DIGITS=6.
+#ifndef VC370_OPERAND_DIGITS
+#define VC370_OPERAND_DIGITS 4
+#endif
+
+class MachineConfig {
+
+public:
+	static constexpr int ClassicOperandDigits = 4;	// The classic VC370 has 10,000 words of memory
+	static constexpr int MinOperandDigits = 4;
+	static constexpr int MaxOperandDigits = 7;		// The largest width whose words still fit in an int
+
+	// A machine whose operands have a_operandDigits decimal digits.  The extended machine
+	// also has the index register, the immediate and the block I/O instructions.
+	explicit constexpr MachineConfig(int a_operandDigits = VC370_OPERAND_DIGITS, bool a_extendedFl = false) noexcept
+		: m_operandDigits(a_operandDigits)
+		, m_memorySize(1)
+		, m_extendedFl(a_extendedFl)
+	{
+		for (int i = 0; i < a_operandDigits; ++i) {
+			m_memorySize *= 10;
+		}
+	}
+
+	// Returns true if the width is supported.
+	[[nodiscard]] static constexpr bool IsValidOperandDigits(int a_operandDigits) noexcept {
+		return a_operandDigits >= MinOperandDigits && a_operandDigits <= MaxOperandDigits;
+	}
+
+	// The number of digits of an operand (address).
+	[[nodiscard]] constexpr int GetOperandDigits() const noexcept { return m_operandDigits; }
+
+	// The number of digits of a word: a two digit opcode followed by the operand.
+	[[nodiscard]] constexpr int GetWordDigits() const noexcept { return m_operandDigits + 2; }
+
+	// The number of words of memory.  Also the factor that separates the opcode from the operand.
+	[[nodiscard]] constexpr int GetMemorySize() const noexcept { return m_memorySize; }
+
+	// One more than the largest value a word (and the accumulator) can hold.
+	[[nodiscard]] constexpr int GetWordLimit() const noexcept { return m_memorySize * 100; }
+
+	// Returns true for the classic 10,000 word machine.
+	[[nodiscard]] constexpr bool IsClassic() const noexcept { return m_operandDigits == ClassicOperandDigits; }
+
+	// Returns true if the machine has the extended instruction set.
+	[[nodiscard]] constexpr bool IsExtended() const noexcept { return m_extendedFl; }
+
+	// Splits and builds words.
+	[[nodiscard]] constexpr int MakeWord(int a_opCode, int a_operand) const noexcept { return a_opCode * m_memorySize + a_operand; }
+	[[nodiscard]] constexpr int GetOpCode(int a_word) const noexcept { return a_word / m_memorySize; }
+	[[nodiscard]] constexpr int GetOperand(int a_word) const noexcept { return a_word % m_memorySize; }
+
+	[[nodiscard]] constexpr bool operator==(const MachineConfig& a_other) const noexcept = default;
+
+private:
+	int m_operandDigits;
+	int m_memorySize;
+	bool m_extendedFl;
+};
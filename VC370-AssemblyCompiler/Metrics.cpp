@@ -0,0 +1,120 @@
+#include "Metrics.h"
+#include "stdafx.h"
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+std::atomic<bool> Metrics::m_enabledFl{ false };
+std::array<std::atomic<std::uint64_t>, Metrics::PhaseCount> Metrics::m_phaseNanoseconds{};
+std::array<std::atomic<std::uint64_t>, Metrics::PhaseCount> Metrics::m_phaseCalls{};
+std::array<std::atomic<std::uint64_t>, Metrics::CounterCount> Metrics::m_counters{};
+
+/// <summary>
+/// Starts timing a phase if the metrics are enabled.
+/// </summary>
+/// <param name="a_phase">The phase being timed</param>
+Metrics::ScopedTimer::ScopedTimer(Phase a_phase) noexcept
+	: m_phase(a_phase)
+	, m_activeFl(IsEnabled())
+{
+	if (m_activeFl) {
+		m_start = std::chrono::steady_clock::now();
+	}
+}
+
+/// <summary>
+/// Adds the elapsed time to the phase.
+/// </summary>
+Metrics::ScopedTimer::~ScopedTimer()
+{
+	if (!m_activeFl) return;
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start);
+	const size_t phase = static_cast<size_t>(m_phase);
+	m_phaseNanoseconds[phase].fetch_add(static_cast<std::uint64_t>(elapsed.count()), std::memory_order_relaxed);
+	m_phaseCalls[phase].fetch_add(1, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Clears all the timers and counters.
+/// </summary>
+void Metrics::Reset() noexcept
+{
+	for (size_t i = 0; i < PhaseCount; ++i) {
+		m_phaseNanoseconds[i].store(0, std::memory_order_relaxed);
+		m_phaseCalls[i].store(0, std::memory_order_relaxed);
+	}
+	for (auto& counter : m_counters) {
+		counter.store(0, std::memory_order_relaxed);
+	}
+}
+
+/// <summary>
+/// Writes the timers and counters as a JSON object, e.g.
+///   { "enabled": true, "phases": { "pass_i": { "calls": 1, "seconds": 0.000021 }, ... },
+///     "counters": { "lines_parsed": 18, ... } }
+/// </summary>
+/// <param name="a_out">The output stream</param>
+void Metrics::WriteJson(std::ostream& a_out)
+{
+	a_out << std::format("{{\n  \"enabled\": {},\n  \"phases\": {{\n", IsEnabled() ? "true" : "false");
+	for (size_t i = 0; i < PhaseCount; ++i) {
+		const double seconds = static_cast<double>(m_phaseNanoseconds[i].load(std::memory_order_relaxed)) / 1e9;
+		a_out << std::format("    \"{}\": {{ \"calls\": {}, \"seconds\": {:.9f} }}{}\n",
+			GetPhaseName(static_cast<Phase>(i)), m_phaseCalls[i].load(std::memory_order_relaxed), seconds,
+			i + 1 < PhaseCount ? "," : "");
+	}
+	a_out << "  },\n  \"counters\": {\n";
+	for (size_t i = 0; i < CounterCount; ++i) {
+		a_out << std::format("    \"{}\": {}{}\n", GetCounterName(static_cast<Counter>(i)),
+			m_counters[i].load(std::memory_order_relaxed), i + 1 < CounterCount ? "," : "");
+	}
+	a_out << "  }\n}\n";
+}
+
+/// <summary>
+/// Writes the timers and counters as JSON to a file.
+/// </summary>
+/// <param name="a_fileName">The file to be written</param>
+/// <returns>True if the file was written successfully</returns>
+bool Metrics::WriteJson(const std::string& a_fileName)
+{
+	std::ofstream ofile(a_fileName, std::ios::out | std::ios::trunc);
+	if (!ofile) {
+		std::cerr << "Metrics file could not be opened: " << a_fileName << '\n';
+		return false;
+	}
+	WriteJson(ofile);
+	return static_cast<bool>(ofile);
+}
+
+#if VC370_COUNT_ALLOCATIONS
+// The replaced allocation functions.  The array and nothrow forms call these.
+
+void* operator new(std::size_t a_size)
+{
+	Metrics::Count(Metrics::Counter::HEAP_ALLOCATIONS);
+	const std::size_t size = a_size != 0 ? a_size : 1;
+	while (true) {
+		if (void* memory = std::malloc(size)) {
+			return memory;
+		}
+		// As the standard operator new does, the new handler may free memory before the next try
+		const std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+void operator delete(void* a_memory) noexcept
+{
+	std::free(a_memory);
+}
+
+void operator delete(void* a_memory, std::size_t) noexcept
+{
+	std::free(a_memory);
+}
+#endif
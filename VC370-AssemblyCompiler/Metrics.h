@@ -0,0 +1,121 @@
+//
+//		Metrics class - host timers and counters of the assembler and the emulator.
+//
+#pragma once
+
+#include "stdafx.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Heap allocations are counted by replacing the global operator new.  That changes the allocator
+// of the whole program, so it is only done when the program asks for it at build time with
+// /DVC370_COUNT_ALLOCATIONS=1, as the CLI and the allocation test do; an embedder keeps its own.
+#ifndef VC370_COUNT_ALLOCATIONS
+#define VC370_COUNT_ALLOCATIONS 0
+#endif
+
+// Note: all members are static, like those of Error, so that any part of the program can record
+// metrics.  Nothing is recorded until the metrics are enabled, so a run that does not ask for
+// them only pays for one flag test per event.
+class Metrics {
+
+public:
+	// Timed phases.  The phases nest: the passes include the symbol table and file I/O time.
+	enum class Phase {
+		PASS_I,
+		PASS_II,
+		SYMBOL_TABLE,
+		FILE_IO,
+		EMULATION,
+		PHASE_COUNT
+	};
+
+	// Counted events.
+	enum class Counter {
+		LINES_PARSED,
+		SYMBOLS_INSERTED,
+		SYMBOL_LOOKUPS,
+		HEAP_ALLOCATIONS,
+		BYTES_READ,
+		INSTRUCTIONS_RETIRED,
+		INSTRUCTIONS_SAVED,
+		ITERATIONS_ACCELERATED,
+		COUNTER_COUNT
+	};
+
+	// Adds the time from its construction to its destruction to a phase.
+	class ScopedTimer {
+
+	public:
+		explicit ScopedTimer(Phase a_phase) noexcept;
+		~ScopedTimer();
+
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+	private:
+		Phase m_phase;
+		bool m_activeFl;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	// Starts or stops recording.
+	static void Enable(bool a_enabledFl) noexcept { m_enabledFl.store(a_enabledFl, std::memory_order_relaxed); }
+
+	[[nodiscard]] static bool IsEnabled() noexcept { return m_enabledFl.load(std::memory_order_relaxed); }
+
+	// Adds to a counter.
+	static void Count(Counter a_counter, std::uint64_t a_amount = 1) noexcept
+	{
+		if (IsEnabled()) {
+			m_counters[static_cast<size_t>(a_counter)].fetch_add(a_amount, std::memory_order_relaxed);
+		}
+	}
+
+	// Clears all the timers and counters.
+	static void Reset() noexcept;
+
+	// Writes the timers and counters as a JSON object.
+	static void WriteJson(std::ostream& a_out);
+	[[nodiscard]] static bool WriteJson(const std::string& a_fileName);
+
+	[[nodiscard]] static std::uint64_t GetCount(Counter a_counter) noexcept
+	{
+		return m_counters[static_cast<size_t>(a_counter)].load(std::memory_order_relaxed);
+	}
+
+private:
+	// The names of the phases and counters in the JSON output.
+	[[nodiscard]] static constexpr std::string_view GetPhaseName(Phase a_phase) noexcept {
+		switch (a_phase) {
+			case Phase::PASS_I: return "pass_i";
+			case Phase::PASS_II: return "pass_ii";
+			case Phase::SYMBOL_TABLE: return "symbol_table";
+			case Phase::FILE_IO: return "file_io";
+			case Phase::EMULATION: return "emulation";
+			default: return "unknown";
+		}
+	}
+	[[nodiscard]] static constexpr std::string_view GetCounterName(Counter a_counter) noexcept {
+		switch (a_counter) {
+			case Counter::LINES_PARSED: return "lines_parsed";
+			case Counter::SYMBOLS_INSERTED: return "symbols_inserted";
+			case Counter::SYMBOL_LOOKUPS: return "symbol_lookups";
+			case Counter::HEAP_ALLOCATIONS: return "heap_allocations";
+			case Counter::BYTES_READ: return "bytes_read";
+			case Counter::INSTRUCTIONS_RETIRED: return "instructions_retired";
+			case Counter::INSTRUCTIONS_SAVED: return "instructions_saved";
+			case Counter::ITERATIONS_ACCELERATED: return "iterations_accelerated";
+			default: return "unknown";
+		}
+	}
+
+	static constexpr size_t PhaseCount = static_cast<size_t>(Phase::PHASE_COUNT);
+	static constexpr size_t CounterCount = static_cast<size_t>(Counter::COUNTER_COUNT);
+
+	static std::atomic<bool> m_enabledFl;
+	static std::array<std::atomic<std::uint64_t>, PhaseCount> m_phaseNanoseconds;
+	static std::array<std::atomic<std::uint64_t>, PhaseCount> m_phaseCalls;
+	static std::array<std::atomic<std::uint64_t>, CounterCount> m_counters;
+};
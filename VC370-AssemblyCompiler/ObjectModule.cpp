@@ -0,0 +1,173 @@
+#include "ObjectModule.h"
+#include "stdafx.h"
+#include <fstream>
+
+/// <summary>
+/// Clears the contents of the module.
+/// </summary>
+void ObjectModule::Clear()
+{
+	m_words.clear();
+	m_relocations.clear();
+	m_externalRefs.clear();
+	m_exports.clear();
+	m_end = 0;
+	m_operandDigits = MachineConfig::ClassicOperandDigits;
+	m_extendedFl = false;
+}
+
+/// <summary>
+/// Adds the words, relocation entries, external references and exports of
+/// another part of the same module, which was translated separately.
+/// </summary>
+/// <param name="a_other">The part to be added</param>
+void ObjectModule::Append(const ObjectModule& a_other)
+{
+	for (const auto& [loc, word] : a_other.m_words) {
+		m_words[loc] = word;
+	}
+	m_relocations.insert(m_relocations.end(), a_other.m_relocations.begin(), a_other.m_relocations.end());
+	m_externalRefs.insert(m_externalRefs.end(), a_other.m_externalRefs.begin(), a_other.m_externalRefs.end());
+	m_exports.insert(a_other.m_exports.begin(), a_other.m_exports.end());
+	m_end = std::max(m_end, a_other.m_end);
+}
+
+/// <summary>
+/// Writes the module to a text file. Each record is on its own line:
+///   W loc word     - an assembled word
+///   R loc          - the operand of the word at loc is relocatable
+///   X symbol loc   - an exported symbol
+///   I symbol loc   - the operand of the word at loc refers to an external symbol
+///   E loc          - the first location after the module
+///   D digits       - the operand width of the target machine (omitted for the classic machine)
+///   P EXTENDED     - the module uses the extended instruction set (omitted for the classic one)
+/// </summary>
+/// <param name="a_fileName">The object file to be written</param>
+/// <returns>True if the file was written successfully</returns>
+bool ObjectModule::Write(const std::string& a_fileName) const
+{
+	std::ofstream ofile(a_fileName, std::ios::out | std::ios::trunc);
+	if (!ofile) {
+		std::cerr << "Object file could not be opened: " << a_fileName << '\n';
+		return false;
+	}
+
+	return Write(ofile);
+}
+
+/// <summary>
+/// Writes the module in the object format to a stream.
+/// </summary>
+/// <param name="a_out">The stream to be written</param>
+/// <returns>True if the module was written successfully</returns>
+bool ObjectModule::Write(std::ostream& a_out) const
+{
+	a_out << ObjectFileHeader << '\n';
+	if (m_operandDigits != MachineConfig::ClassicOperandDigits) {
+		a_out << std::format("D {}\n", m_operandDigits);
+	}
+	if (m_extendedFl) {
+		a_out << "P EXTENDED\n";
+	}
+	for (const auto& [loc, word] : m_words) {
+		a_out << std::format("W {} {}\n", loc, word);
+	}
+	for (const int loc : m_relocations) {
+		a_out << std::format("R {}\n", loc);
+	}
+	for (const auto& [symbol, loc] : m_exports) {
+		a_out << std::format("X {} {}\n", symbol, loc);
+	}
+	for (const auto& ref : m_externalRefs) {
+		a_out << std::format("I {} {}\n", ref.m_symbol, ref.m_loc);
+	}
+	a_out << std::format("E {}\n", m_end);
+
+	return static_cast<bool>(a_out);
+}
+
+/// <summary>
+/// Reads a module from an object file written by Write.
+/// </summary>
+/// <param name="a_fileName">The object file to be read</param>
+/// <returns>True if the file was read successfully</returns>
+bool ObjectModule::Read(const std::string& a_fileName)
+{
+	Clear();
+
+	std::ifstream ifile(a_fileName, std::ios::in);
+	if (!ifile) {
+		std::cerr << "Object file could not be opened: " << a_fileName << '\n';
+		return false;
+	}
+
+	return Read(ifile, a_fileName);
+}
+
+/// <summary>
+/// Reads a module in the object format from a stream.
+/// </summary>
+/// <param name="a_in">The stream to be read</param>
+/// <param name="a_name">The name of the module used in the error messages</param>
+/// <returns>True if the module was read successfully</returns>
+bool ObjectModule::Read(std::istream& a_in, std::string_view a_name)
+{
+	Clear();
+
+	std::string line;
+	if (!std::getline(a_in, line) || line != ObjectFileHeader) {
+		std::cerr << "Not a VC370 object file: " << a_name << '\n';
+		return false;
+	}
+
+	while (std::getline(a_in, line)) {
+		std::istringstream record(line);
+		char type = 0;
+		std::string symbol;
+		int loc = 0;
+		int word = 0;
+
+		record >> type;
+		switch (type) {
+			case 'W':
+				record >> loc >> word;
+				m_words[loc] = word;
+				break;
+			case 'R':
+				record >> loc;
+				m_relocations.push_back(loc);
+				break;
+			case 'X':
+				record >> symbol >> loc;
+				m_exports[symbol] = loc;
+				break;
+			case 'I':
+				record >> symbol >> loc;
+				m_externalRefs.push_back({ loc, symbol });
+				break;
+			case 'E':
+				record >> m_end;
+				break;
+			case 'D':
+				record >> m_operandDigits;
+				break;
+			case 'P':
+				record >> symbol;
+				if (symbol != "EXTENDED") {
+					record.setstate(std::ios::failbit);
+				}
+				m_extendedFl = true;
+				break;
+			default:
+				std::cerr << "Invalid record in object file " << a_name << ": " << line << '\n';
+				return false;
+		}
+
+		if (!record) {
+			std::cerr << "Invalid record in object file " << a_name << ": " << line << '\n';
+			return false;
+		}
+	}
+
+	return true;
+}
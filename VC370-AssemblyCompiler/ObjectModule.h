@@ -0,0 +1,91 @@
+//
+//		ObjectModule class - a relocatable, separately assembled VC370 module.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "MachineConfig.h"
+#include <map>
+#include <memory_resource>
+
+class ObjectModule {
+
+public:
+	// A reference from an instruction operand to a symbol defined in another module.
+	struct ExternalRef {
+		int m_loc;
+		std::string m_symbol;
+	};
+
+	// The first line of every object file.
+	static constexpr std::string_view ObjectFileHeader = "VC370OBJ 1";
+
+	ObjectModule() = default;
+
+	// The words are allocated from a_resource, e.g. the arena of an assembly.
+	explicit ObjectModule(std::pmr::memory_resource* a_resource) : m_words(a_resource) { }
+
+	~ObjectModule() = default;
+
+	// Records an assembled word at a location of the module.
+	void AddWord(int a_loc, int a_contents) { m_words[a_loc] = a_contents; }
+
+	// Records that the operand of the word at a_loc is an address within this module.
+	void AddRelocation(int a_loc) { m_relocations.push_back(a_loc); }
+
+	// Records that the address of an external symbol is added to the operand of the word at a_loc.
+	void AddExternalRef(int a_loc, std::string_view a_symbol) { m_externalRefs.push_back({ a_loc, std::string(a_symbol) }); }
+
+	// Records a symbol that other modules may reference.
+	void AddExport(std::string_view a_symbol, int a_loc) { m_exports[std::string(a_symbol)] = a_loc; }
+
+	// Records the first location after the module, including storage reserved by DS.
+	void SetEnd(int a_end) noexcept { m_end = a_end; }
+
+	// Records the operand width of the machine the module was assembled for.
+	void SetOperandDigits(int a_operandDigits) noexcept { m_operandDigits = a_operandDigits; }
+
+	// Records that the module was assembled for the extended instruction set.
+	void SetExtended(bool a_extendedFl) noexcept { m_extendedFl = a_extendedFl; }
+
+	// Clears the module so it can be filled again.
+	void Clear();
+
+	// Adds the contents of another part of the same module.
+	void Append(const ObjectModule& a_other);
+
+	// Writes the module in the VC370 object format.
+	[[nodiscard]] bool Write(const std::string& a_fileName) const;
+	[[nodiscard]] bool Write(std::ostream& a_out) const;
+
+	// Reads a module written by Write.
+	[[nodiscard]] bool Read(const std::string& a_fileName);
+	[[nodiscard]] bool Read(std::istream& a_in, std::string_view a_name);
+
+	[[nodiscard]] const std::pmr::map<int, int>& GetWords() const noexcept { return m_words; }
+	[[nodiscard]] const std::vector<int>& GetRelocations() const noexcept { return m_relocations; }
+	[[nodiscard]] const std::vector<ExternalRef>& GetExternalRefs() const noexcept { return m_externalRefs; }
+	[[nodiscard]] const std::map<std::string, int>& GetExports() const noexcept { return m_exports; }
+	[[nodiscard]] int GetEnd() const noexcept { return m_end; }
+	[[nodiscard]] int GetOperandDigits() const noexcept { return m_operandDigits; }
+	[[nodiscard]] bool IsExtended() const noexcept { return m_extendedFl; }
+
+	// The machine the module was assembled for.
+	[[nodiscard]] MachineConfig GetConfig() const noexcept { return MachineConfig(m_operandDigits, m_extendedFl); }
+
+private:
+	// The assembled words, keyed by location.  A later ORG may overwrite a word, as in the emulator.
+	std::pmr::map<int, int> m_words;
+	// Locations whose operand must be moved with the module.
+	std::vector<int> m_relocations;
+	// Locations whose operand is filled in by the linker.
+	std::vector<ExternalRef> m_externalRefs;
+	// Symbols exported with ENTRY.
+	std::map<std::string, int> m_exports;
+	// The first location after the module.
+	int m_end = 0;
+	// The operand width of the machine the module was assembled for.
+	int m_operandDigits = MachineConfig::ClassicOperandDigits;
+	// True if the module was assembled for the extended instruction set.
+	bool m_extendedFl = false;
+};
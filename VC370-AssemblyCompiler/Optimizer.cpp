@@ -0,0 +1,127 @@
+#include "Optimizer.h"
+#include "Classifier.h"
+#include "stdafx.h"
+
+// The opcodes the optimizer looks at.
+static constexpr int OpLoad = 5;
+static constexpr int OpStore = 6;
+static constexpr int OpBranch = 9;
+static constexpr int OpBranchMinus = 10;
+static constexpr int OpBranchPlus = 12;
+static constexpr int OpHalt = 13;
+static constexpr int OpWriteBlock = 27;
+
+/// <summary>
+/// Analyses the image and installs the successors in the emulator.
+/// A program that may store into a reachable instruction could change its own control
+/// flow, so nothing is installed for it.
+/// </summary>
+/// <returns>What the analysis found</returns>
+Optimizer::Report Optimizer::Optimize()
+{
+	Report report;
+
+	std::vector<char> reachable;
+	std::vector<int> stored;
+	int extent = 0;
+	const bool staticStoresFl = Classifier::FindReachable(m_emul, reachable, stored, extent);
+
+	report.m_reachableInstructions = static_cast<size_t>(std::ranges::count(reachable, char{ 1 }));
+	for (int loc = 100; loc < extent; ++loc) {
+		if (!reachable[loc] && m_emul.GetWord(loc) != 0) {
+			++report.m_unreachableWords;
+		}
+	}
+
+	// Leave self-modifying programs alone
+	if (!staticStoresFl || std::ranges::any_of(stored, [&](int a_loc) { return a_loc < extent && reachable[a_loc]; })) {
+		report.m_selfModifyingFl = true;
+		return report;
+	}
+
+	std::vector<Emulator::Successor> successors(static_cast<size_t>(extent));
+	for (int loc = 0; loc < extent; ++loc) {
+		Emulator::Successor& successor = successors[loc];
+		successor = { loc + 1, 0, -1, 0 };
+		if (!reachable[loc]) {
+			continue;
+		}
+
+		const int word = m_emul.GetWord(loc);
+		const int opcode = m_config.GetOpCode(word);
+		const int operand = m_config.GetOperand(word);
+
+		// Where the instruction goes when it does not branch; LOAD X and STORE X leave X in the accumulator
+		const int lastOpCode = m_config.IsExtended() ? OpWriteBlock : OpHalt;
+		if (opcode >= 1 && opcode <= lastOpCode && opcode != OpHalt && opcode != OpBranch && loc + 1 < m_config.GetMemorySize()) {
+			const int knownLoad = opcode == OpLoad || opcode == OpStore ? operand : -1;
+			int saved = 0;
+			const int next = SkipFrom(loc + 1, knownLoad, saved);
+			if (saved > 0) {
+				successor.m_next = next;
+				successor.m_nextSaved = saved;
+				++report.m_shortenedFallThroughs;
+			}
+		}
+
+		// Where the instruction goes when it branches
+		if (opcode >= OpBranch && opcode <= OpBranchPlus) {
+			int saved = 0;
+			const int target = SkipFrom(operand, -1, saved);
+			if (saved > 0) {
+				successor.m_target = target;
+				successor.m_targetSaved = saved;
+				++report.m_threadedBranches;
+			}
+		}
+	}
+
+	if (report.m_shortenedFallThroughs + report.m_threadedBranches > 0) {
+		m_emul.SetSuccessors(std::move(successors));
+	}
+	return report;
+}
+
+/// <summary>
+/// Follows the instructions that do nothing when they are reached from the instruction
+/// before: unconditional branches, conditional branches to the next location, and
+/// LOAD X when the accumulator already holds X.
+/// </summary>
+/// <param name="a_loc">The location reached</param>
+/// <param name="a_knownLoad">The location whose value is in the accumulator, or -1</param>
+/// <param name="a_saved">Set to the number of instructions skipped</param>
+/// <returns>The first location that has to be executed</returns>
+int Optimizer::SkipFrom(int a_loc, int a_knownLoad, int& a_saved) const
+{
+	const int memorySize = m_config.GetMemorySize();
+	std::vector<int> visited;
+	int loc = a_loc;
+	a_saved = 0;
+
+	while (a_saved < MaxSkipped) {
+		const int word = m_emul.GetWord(loc);
+		const int opcode = m_config.GetOpCode(word);
+		const int operand = m_config.GetOperand(word);
+
+		int next = -1;
+		if (opcode == OpBranch) {
+			next = operand;
+		}
+		else if (opcode >= OpBranchMinus && opcode <= OpBranchPlus && operand == loc + 1) {
+			next = loc + 1;
+		}
+		else if (opcode == OpLoad && operand == a_knownLoad) {
+			next = loc + 1;
+		}
+
+		// Stop at an instruction that does something, at the end of memory and at a cycle of branches
+		visited.push_back(loc);
+		if (next < 0 || next >= memorySize || std::ranges::find(visited, next) != visited.end()) {
+			break;
+		}
+
+		loc = next;
+		++a_saved;
+	}
+	return loc;
+}
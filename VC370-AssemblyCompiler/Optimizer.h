@@ -0,0 +1,45 @@
+//
+//		Optimizer class - peephole optimization of the control flow of an assembled VC370 image.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Emulator.h"
+
+// The optimizer never changes the memory of the program, so the listing, the values the
+// program reads and writes, and the code a program inspects stay as they were.  Instead it
+// works out, for each reachable instruction, where execution really continues:
+//   - a branch to an unconditional branch goes straight to its final target (jump threading),
+//   - a branch to the next location is skipped (branch-to-next removal),
+//   - LOAD X right after STORE X or LOAD X is skipped (redundant load elimination).
+// The emulator follows these successors and counts the instructions they save.
+class Optimizer {
+
+public:
+	// What the analysis found.
+	struct Report {
+		size_t m_reachableInstructions = 0;	// Instructions reachable from location 100
+		size_t m_unreachableWords = 0;		// Non-zero words between the reachable instructions that are never executed (data or dead code)
+		size_t m_threadedBranches = 0;		// Branches whose target was moved past skipped instructions
+		size_t m_shortenedFallThroughs = 0;	// Instructions whose next location was moved past skipped instructions
+		bool m_selfModifyingFl = false;		// The program may store into its own code, so it was left alone
+	};
+
+	explicit Optimizer(Emulator& a_emul) noexcept : m_emul(a_emul), m_config(a_emul.GetConfig()) { }
+	~Optimizer() = default;
+
+	// Analyses the image and installs the successors in the emulator.
+	Report Optimize();
+
+private:
+	// Follows the instructions that can be skipped from a_loc.  a_knownLoad is the location
+	// whose value the accumulator is known to hold, or -1.  Returns the first location that
+	// has to be executed and sets a_saved to the number of instructions skipped.
+	[[nodiscard]] int SkipFrom(int a_loc, int a_knownLoad, int& a_saved) const;
+
+	// The longest chain of instructions skipped at once; it also stops cycles of branches.
+	static constexpr int MaxSkipped = 64;
+
+	Emulator& m_emul;
+	MachineConfig m_config;
+};
@@ -0,0 +1,225 @@
+#include "PageGuard.h"
+#include "stdafx.h"
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// The guard of each thread; the fault handler runs on the thread that wrote.
+static thread_local PageGuard* t_guard = nullptr;
+
+#ifdef _WIN32
+
+/// <summary>
+/// Lets a write to a protected page through.  Other exceptions are left to the next handler.
+/// </summary>
+/// <param name="a_info">The exception</param>
+/// <returns>Whether execution continues at the write</returns>
+static LONG CALLBACK OnException(EXCEPTION_POINTERS* a_info)
+{
+	const EXCEPTION_RECORD& record = *a_info->ExceptionRecord;
+	if (record.ExceptionCode == EXCEPTION_ACCESS_VIOLATION && record.ExceptionInformation[0] == 1
+		&& t_guard != nullptr && t_guard->OnFault(reinterpret_cast<const void*>(record.ExceptionInformation[1]))) {
+		return EXCEPTION_CONTINUE_EXECUTION;
+	}
+	return EXCEPTION_CONTINUE_SEARCH;
+}
+
+#else
+
+// The handlers that were installed before ours.
+static struct sigaction s_previousSegv;
+static struct sigaction s_previousBus;
+
+/// <summary>
+/// Lets a write to a protected page through.  Any other fault gets the handler that was
+/// installed before, which takes effect when the instruction faults again.
+/// </summary>
+/// <param name="a_signal">SIGSEGV or SIGBUS</param>
+/// <param name="a_info">The faulting address</param>
+static void OnSignal(int a_signal, siginfo_t* a_info, void*)
+{
+	if (t_guard != nullptr && t_guard->OnFault(a_info->si_addr)) {
+		return;
+	}
+	sigaction(a_signal, a_signal == SIGSEGV ? &s_previousSegv : &s_previousBus, nullptr);
+}
+
+#endif
+
+/// <summary>
+/// Protects the host page that holds each watched word.  Pages that hold more than one
+/// watched word are protected once.
+/// </summary>
+/// <param name="a_watched">The region of each watched word, and its guest address</param>
+PageGuard::PageGuard(const std::vector<std::pair<Region, int>>& a_watched)
+	: m_outer(t_guard)
+{
+	InstallHandler();
+
+	const size_t pageSize = GetHostPageSize();
+	m_regions.reserve(a_watched.size());	// The pages point into m_regions
+	for (const auto& [region, addr] : a_watched) {
+		// A region that does not own whole host pages cannot be protected without its neighbours
+		const size_t offset = static_cast<size_t>(addr - region.m_firstAddr) * sizeof(int);
+		if (reinterpret_cast<uintptr_t>(region.m_words) % pageSize != 0 || region.m_bytes % pageSize != 0 || offset >= region.m_bytes) {
+			continue;
+		}
+		char* page = reinterpret_cast<char*>(region.m_words) + offset / pageSize * pageSize;
+		if (std::ranges::any_of(m_pages, [page](const GuardedPage& a_page) { return a_page.m_page == page; })) {
+			continue;
+		}
+		m_regions.push_back(region);
+		m_pages.push_back({ page, &m_regions.back() });
+	}
+	std::ranges::sort(m_pages, {}, &GuardedPage::m_page);
+
+	t_guard = this;
+	for (const GuardedPage& page : m_pages) {
+		static_cast<void>(Protect(page.m_page, true));
+	}
+}
+
+/// <summary>
+/// Makes the pages writable again.
+/// </summary>
+PageGuard::~PageGuard()
+{
+	for (const GuardedPage& page : m_pages) {
+		static_cast<void>(Protect(page.m_page, false));
+	}
+	t_guard = m_outer;
+}
+
+/// <summary>
+/// Called by the fault handler on a write to protected memory.  Notes the word and its old
+/// value, and makes the page writable so the write succeeds when the handler returns.
+/// Only reads the guard and makes a system call, as a signal handler must.
+/// </summary>
+/// <param name="a_addr">The host address that was written</param>
+/// <returns>False if the address is not on a page of this guard</returns>
+bool PageGuard::OnFault(const void* a_addr) noexcept
+{
+	const char* addr = static_cast<const char*>(a_addr);
+	const size_t pageSize = GetHostPageSize();
+	const auto it = std::ranges::upper_bound(m_pages, addr, std::less<>{}, [](const GuardedPage& a_page) -> const char* { return a_page.m_page; });
+	if (it == m_pages.begin() || addr >= std::prev(it)->m_page + pageSize) {
+		return false;
+	}
+
+	const GuardedPage& page = *std::prev(it);
+	const size_t word = static_cast<size_t>(addr - reinterpret_cast<const char*>(page.m_region->m_words)) / sizeof(int);
+	m_faultAddr = page.m_region->m_firstAddr + static_cast<int>(word);
+	m_faultValue = page.m_region->m_words[word];
+	m_faultPage = page.m_page;
+	if (!Protect(page.m_page, false)) {
+		return false;
+	}
+	m_faultFl = 1;
+	return true;
+}
+
+/// <summary>
+/// Protects the page written last again, once the write is done.
+/// </summary>
+void PageGuard::Rearm() noexcept
+{
+	static_cast<void>(Protect(m_faultPage, true));
+	m_faultFl = 0;
+}
+
+/// <summary>
+/// Makes a host page read-only or writable again.
+/// </summary>
+/// <param name="a_page">The start of the page</param>
+/// <param name="a_readOnlyFl">True to make the page read-only</param>
+/// <returns>False if the protection could not be changed</returns>
+bool PageGuard::Protect(char* a_page, bool a_readOnlyFl) noexcept
+{
+#ifdef _WIN32
+	DWORD previous;
+	return VirtualProtect(a_page, GetHostPageSize(), a_readOnlyFl ? PAGE_READONLY : PAGE_READWRITE, &previous) != 0;
+#else
+	return mprotect(a_page, GetHostPageSize(), a_readOnlyFl ? PROT_READ : PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+/// <summary>
+/// Installs the fault handler the first time a guard is made.
+/// </summary>
+void PageGuard::InstallHandler()
+{
+	static std::once_flag installed;
+	std::call_once(installed, [] {
+#ifdef _WIN32
+		static_cast<void>(AddVectoredExceptionHandler(1, OnException));
+#else
+		struct sigaction action {};
+		action.sa_sigaction = OnSignal;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGSEGV, &action, &s_previousSegv);
+		sigaction(SIGBUS, &action, &s_previousBus);	// Some systems report writes to read-only pages as SIGBUS
+#endif
+	});
+}
+
+/// <summary>
+/// Returns the size of a host page, the unit of protection.
+/// </summary>
+/// <returns>The page size in bytes</returns>
+size_t PageGuard::GetHostPageSize() noexcept
+{
+	static const size_t pageSize = [] {
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return static_cast<size_t>(info.dwPageSize);
+#else
+		return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+	}();
+	return pageSize;
+}
+
+/// <summary>
+/// Maps zeroed memory on whole host pages, so that it can be protected page by page
+/// without affecting anything else.
+/// </summary>
+/// <param name="a_bytes">The number of bytes; rounded up to whole pages</param>
+/// <returns>The start of the memory</returns>
+void* PageGuard::AllocatePages(size_t a_bytes)
+{
+#ifdef _WIN32
+	void* pages = VirtualAlloc(nullptr, a_bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (pages == nullptr) {
+		throw std::bad_alloc();
+	}
+#else
+	void* pages = mmap(nullptr, a_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pages == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+#endif
+	return pages;
+}
+
+/// <summary>
+/// Releases memory mapped by AllocatePages.
+/// </summary>
+/// <param name="a_pages">The start of the memory</param>
+/// <param name="a_bytes">The number of bytes it was mapped with</param>
+void PageGuard::FreePages(void* a_pages, size_t a_bytes) noexcept
+{
+#ifdef _WIN32
+	static_cast<void>(a_bytes);
+	VirtualFree(a_pages, 0, MEM_RELEASE);
+#else
+	munmap(a_pages, a_bytes);
+#endif
+}
@@ -0,0 +1,89 @@
+//
+//		PageGuard class - write protection of the host pages that hold watched words.
+//
+#pragma once
+
+#include "stdafx.h"
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+
+// Watchpoints are free until they fire: the host pages that hold the watched words are made
+// read-only, so the interpreter runs unchanged and only a write to one of those pages traps.
+// The fault handler notes the word and its old value and makes the page writable, so the
+// write goes through when the handler returns.  The emulator then calls TakeFault after the
+// instruction, which protects the page again.
+//
+// The handler is SIGSEGV (and SIGBUS) on POSIX systems and a vectored exception handler on
+// Windows.  A guard belongs to the thread that created it; faults that are not on its pages
+// are passed on.
+class PageGuard {
+
+public:
+	// Host memory that holds the consecutive guest words from m_firstAddr.  The region must
+	// start on a host page and own m_bytes bytes of whole pages.
+	struct Region {
+		int* m_words;
+		size_t m_bytes;
+		int m_firstAddr;
+	};
+
+	// Protects the page of each region that holds its watched word, for the lifetime of the guard.
+	explicit PageGuard(const std::vector<std::pair<Region, int>>& a_watched);
+	~PageGuard();
+
+	// Prevent copying
+	PageGuard(const PageGuard&) = delete;
+	PageGuard& operator=(const PageGuard&) = delete;
+
+	// Returns true, with the guest address and old value of the word, if a protected page was
+	// written since the last call.  The page is protected again.
+	[[nodiscard]] bool TakeFault(int& a_addr, int& a_oldValue) {
+		// The write comes before the check, as far as the compiler is concerned
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+		if (m_faultFl == 0) {
+			return false;
+		}
+		Rearm();
+		a_addr = m_faultAddr;
+		a_oldValue = m_faultValue;
+		return true;
+	}
+
+	// Called by the fault handler.  Lets the write to a_addr through and returns true if it
+	// is on a page of this guard.
+	bool OnFault(const void* a_addr) noexcept;
+
+	// The size of a host page.
+	[[nodiscard]] static size_t GetHostPageSize() noexcept;
+
+	// Maps a_bytes of zeroed memory on whole host pages, and releases it.
+	[[nodiscard]] static void* AllocatePages(size_t a_bytes);
+	static void FreePages(void* a_pages, size_t a_bytes) noexcept;
+
+private:
+	// A protected host page.
+	struct GuardedPage {
+		char* m_page;
+		const Region* m_region;
+	};
+
+	// Protects the page written last again.
+	void Rearm() noexcept;
+
+	// Changes the protection of a host page.
+	static bool Protect(char* a_page, bool a_readOnlyFl) noexcept;
+
+	// Installs the fault handler of the process once.
+	static void InstallHandler();
+
+	std::vector<Region> m_regions;			// The regions of the watched words
+	std::vector<GuardedPage> m_pages;		// The protected pages, in address order
+	PageGuard* m_outer = nullptr;			// The guard of the thread before this one
+
+	// Set by the fault handler
+	volatile std::sig_atomic_t m_faultFl = 0;
+	int m_faultAddr = 0;
+	int m_faultValue = 0;
+	char* m_faultPage = nullptr;
+};
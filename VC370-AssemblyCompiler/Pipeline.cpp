@@ -0,0 +1,505 @@
+#include "Pipeline.h"
+#include "stdafx.h"
+#include "Assembler.h"
+#include "Error.h"
+#include "Metrics.h"
+#include "Probes.h"
+#include <charconv>
+#include <fstream>
+#include <thread>
+
+// The name a connect uses for the standard input.
+static constexpr std::string_view StandardInputName = "input";
+
+// The largest capacity a connect may ask for.
+static constexpr size_t MaxChannelCapacity = 1 << 20;
+
+/// <summary>
+/// Reads the description of the pipeline and assembles its machines.
+/// </summary>
+/// <param name="a_fileName">The description</param>
+/// <param name="a_err">Where mistakes in the description and assembly errors are written</param>
+/// <returns>False if the pipeline cannot be run</returns>
+bool Pipeline::Load(const std::string& a_fileName, std::ostream& a_err)
+{
+	std::ifstream file(a_fileName);
+	if (!file) {
+		a_err << "Could not open " << a_fileName << '\n';
+		return false;
+	}
+
+	const std::filesystem::path directory = std::filesystem::path(a_fileName).parent_path();
+	std::vector<std::filesystem::path> sources;
+	bool okFl = true;
+	int lineNum = 0;
+	std::string line;
+	while (std::getline(file, line)) {
+		++lineNum;
+		const std::string error = ParseStatement(line, directory, sources);
+		if (!error.empty()) {
+			a_err << std::format("{}:{}: {}\n", a_fileName, lineNum, error);
+			okFl = false;
+		}
+	}
+	if (okFl && m_machines.empty()) {
+		a_err << a_fileName << ": no machines\n";
+		okFl = false;
+	}
+	if (!okFl) {
+		return false;
+	}
+
+	// One assembler serves all the sources
+	Assembler assem(m_config);
+	for (size_t i = 0; i < m_machines.size(); ++i) {
+		okFl = AssembleMachine(assem, *m_machines[i], sources[i], a_err) && okFl;
+	}
+	return okFl;
+}
+
+/// <summary>
+/// Reads one statement of the description: a machine or a connection.
+/// </summary>
+/// <param name="a_line">The line</param>
+/// <param name="a_directory">The directory of the description; source paths are relative to it</param>
+/// <param name="a_sources">The source file of each machine; a machine statement adds to it</param>
+/// <returns>What is wrong with the statement, or an empty string</returns>
+std::string Pipeline::ParseStatement(std::string_view a_line, const std::filesystem::path& a_directory, std::vector<std::filesystem::path>& a_sources)
+{
+	a_line = a_line.substr(0, a_line.find('#'));
+	std::vector<std::string_view> words;
+	for (size_t pos = a_line.find_first_not_of(" \t\r"); pos != std::string_view::npos; pos = a_line.find_first_not_of(" \t\r", pos)) {
+		const size_t end = std::min(a_line.find_first_of(" \t\r", pos), a_line.size());
+		words.push_back(a_line.substr(pos, end - pos));
+		pos = end;
+	}
+	if (words.empty()) {
+		return {};
+	}
+
+	if (words[0] == "machine") {
+		if (words.size() != 3) {
+			return "expected: machine <Name> <SourceFile>";
+		}
+		if (words[1] == StandardInputName || FindMachine(words[1]) != nullptr) {
+			return std::format("the name {} is already used", words[1]);
+		}
+
+		auto machine = std::make_unique<Machine>();
+		machine->m_name = words[1];
+		machine->m_index = m_machines.size();
+		m_machines.push_back(std::move(machine));
+		a_sources.push_back(a_directory / words[2]);
+		return {};
+	}
+
+	if (words[0] == "connect") {
+		if (words.size() != 3 && words.size() != 4) {
+			return "expected: connect <From> <To> [<Capacity>]";
+		}
+		const bool standardInputFl = words[1] == StandardInputName;
+		Machine* const from = standardInputFl ? nullptr : FindMachine(words[1]);
+		Machine* const to = FindMachine(words[2]);
+		if (!standardInputFl && from == nullptr) {
+			return std::format("no machine called {}", words[1]);
+		}
+		if (to == nullptr) {
+			return std::format("no machine called {}", words[2]);
+		}
+		if (to->m_producer != nullptr || to->m_standardInputFl) {
+			return std::format("the input of {} is already connected", to->m_name);
+		}
+		if (from != nullptr && from->m_consumer != nullptr) {
+			return std::format("the output of {} is already connected", from->m_name);
+		}
+		if (standardInputFl && std::ranges::any_of(m_machines, &Machine::m_standardInputFl)) {
+			return "the standard input is already connected";
+		}
+
+		size_t capacity = Channel::DefaultCapacity;
+		if (words.size() == 4) {
+			const auto [end, ec] = std::from_chars(words[3].data(), words[3].data() + words[3].size(), capacity);
+			if (ec != std::errc() || end != words[3].data() + words[3].size() || capacity == 0 || capacity > MaxChannelCapacity) {
+				return std::format("the capacity must be from 1 to {}", MaxChannelCapacity);
+			}
+			if (standardInputFl) {
+				return "the standard input has no capacity";
+			}
+		}
+
+		if (standardInputFl) {
+			to->m_standardInputFl = true;
+		}
+		else {
+			from->m_consumer = to;
+			to->m_producer = from;
+			to->m_inCapacity = capacity;
+		}
+		return {};
+	}
+
+	return std::format("unknown statement {}", words[0]);
+}
+
+/// <summary>
+/// Assembles the source of a machine and, as with -O, optimizes the image.
+/// </summary>
+/// <param name="a_assem">The assembler</param>
+/// <param name="a_machine">The machine; its image is set</param>
+/// <param name="a_sourceFile">The source file</param>
+/// <param name="a_err">Where the errors are written</param>
+/// <returns>False if the source could not be read or had errors</returns>
+bool Pipeline::AssembleMachine(Assembler& a_assem, Machine& a_machine, const std::filesystem::path& a_sourceFile, std::ostream& a_err)
+{
+	std::ifstream file(a_sourceFile);
+	if (!file) {
+		a_err << std::format("{}: could not open {}\n", a_machine.m_name, a_sourceFile.string());
+		return false;
+	}
+	const std::string source{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+	const Assembler::Result result = a_assem.Assemble(source);
+	if (!result.Succeeded()) {
+		a_err << std::format("{}: {} has errors\n", a_machine.m_name, a_sourceFile.string());
+		Error::DisplayErrors(a_err);
+		return false;
+	}
+
+	if (!m_optimizeFl) {
+		a_machine.m_image = result.m_image;
+		return true;
+	}
+	static_cast<void>(a_assem.OptimizeProgram());
+	static_cast<void>(a_assem.ClassifyProgram());
+	static_cast<void>(a_assem.AccelerateLoops());
+	a_machine.m_image = std::make_shared<const Emulator>(a_assem.GetEmulator());
+	return true;
+}
+
+/// <summary>
+/// Returns the machine with a name.
+/// </summary>
+/// <param name="a_name">The name</param>
+/// <returns>The machine, or null if there is none</returns>
+Pipeline::Machine* Pipeline::FindMachine(std::string_view a_name) const
+{
+	const auto it = std::ranges::find(m_machines, a_name, &Machine::m_name);
+	return it == m_machines.end() ? nullptr : it->get();
+}
+
+/// <summary>
+/// Runs the machines until they have all stopped, or until none of those left can go on
+/// because each waits for a channel that no running machine will fill or empty.
+/// </summary>
+/// <param name="a_workerCount">The number of threads; no more than the number of machines are used</param>
+/// <param name="a_in">The standard input of the pipeline</param>
+/// <param name="a_out">The standard output of the pipeline</param>
+/// <param name="a_err">Where the machines that did not halt are reported</param>
+/// <returns>True if every machine halted, or stopped because the machine it writes to had halted</returns>
+bool Pipeline::Run(unsigned a_workerCount, std::istream& a_in, std::ostream& a_out, std::ostream& a_err)
+{
+	Metrics::ScopedTimer timer(Metrics::Phase::EMULATION);
+
+	m_in = &a_in;
+	m_out = &a_out;
+	m_sharedOutputFl = std::ranges::count(m_machines, nullptr, &Machine::m_consumer) > 1;
+
+	// The channels are made for each run, as a run leaves them closed
+	m_channels.clear();
+	for (const auto& machine : m_machines) {
+		machine->m_in = nullptr;
+		machine->m_out = nullptr;
+	}
+	for (const auto& machine : m_machines) {
+		if (machine->m_consumer != nullptr) {
+			m_channels.push_back(std::make_unique<Channel>(machine->m_consumer->m_inCapacity));
+			machine->m_out = m_channels.back().get();
+			machine->m_consumer->m_in = m_channels.back().get();
+		}
+	}
+
+	const size_t workerCount = std::clamp<size_t>(a_workerCount, 1, m_machines.size());
+	m_workers.clear();
+	for (size_t i = 0; i < workerCount; ++i) {
+		m_workers.push_back(std::make_unique<Worker>(m_machines.size()));
+	}
+
+	// Deal the machines out to the workers; the threads start after this
+	for (const auto& machine : m_machines) {
+		machine->m_session.emplace(Emulator::StartSession(Emulator(machine->m_image)));
+		machine->m_state.store(QUEUED, std::memory_order_relaxed);
+		machine->m_outcome = Outcome::RUNNING;
+		machine->m_error.clear();
+		machine->m_output.clear();
+		m_workers[machine->m_index % workerCount]->m_deque.Push(machine.get());
+	}
+	m_active.store(m_machines.size());
+	m_stopFl.store(false);
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < workerCount; ++i) {
+		threads.emplace_back(&Pipeline::Work, this, i);
+	}
+	Work(0);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	m_report = Report();
+	m_report.m_machines = m_machines.size();
+	m_report.m_channels = m_channels.size();
+	m_report.m_workers = static_cast<unsigned>(workerCount);
+	for (const auto& worker : m_workers) {
+		m_report.m_words += worker->m_words;
+		m_report.m_parks += worker->m_parks;
+		m_report.m_steals += worker->m_steals;
+	}
+
+	bool okFl = true;
+	for (const auto& machine : m_machines) {
+		Machine& m = *machine;
+		for (const int word : m.m_output) {
+			a_out << m.m_name << ": " << word << '\n';
+		}
+
+		// A machine still running when the pool stopped was parked on a channel for good
+		if (m.m_outcome == Outcome::RUNNING) {
+			m.m_outcome = Outcome::DEADLOCKED;
+			m.m_error = m.m_session->GetState() == EmulatorSession::State::WAITING_FOR_INPUT
+				? "deadlocked waiting for input" : "deadlocked waiting to write to a full channel";
+		}
+		if (m.m_outcome != Outcome::HALTED && m.m_outcome != Outcome::OUTPUT_CLOSED) {
+			a_err << std::format("Pipeline: {}: {}\n", m.m_name, m.m_error);
+			okFl = false;
+		}
+		m.m_session.reset();
+	}
+	return okFl;
+}
+
+/// <summary>
+/// The loop of a worker: run its own tasks, most recent first, then steal the oldest
+/// tasks of the others, and sleep when there are none until one is queued.
+/// </summary>
+/// <param name="a_index">The worker</param>
+void Pipeline::Work(size_t a_index)
+{
+	Worker& worker = *m_workers[a_index];
+	while (!m_stopFl.load(std::memory_order_acquire)) {
+		Machine* machine = worker.m_deque.Pop();
+		if (machine == nullptr) {
+			machine = Steal(a_index);
+		}
+		if (machine == nullptr) {
+			// Look once more after saying that this worker is idle; a task queued since
+			// then bumps m_signal, so the wait returns at once
+			m_idle.fetch_add(1);
+			const unsigned seen = m_signal.load();
+			machine = Steal(a_index);
+			if (machine == nullptr && !m_stopFl.load()) {
+				m_signal.wait(seen);
+			}
+			m_idle.fetch_sub(1);
+		}
+		if (machine != nullptr) {
+			machine->m_state.store(RUNNING, std::memory_order_relaxed);
+			RunMachine(*machine, worker);
+		}
+	}
+}
+
+/// <summary>
+/// Takes the oldest task of the first other worker that has one.
+/// </summary>
+/// <param name="a_index">The worker that steals</param>
+/// <returns>The task, or null if none was found</returns>
+Pipeline::Machine* Pipeline::Steal(size_t a_index)
+{
+	for (size_t i = 1; i < m_workers.size(); ++i) {
+		Machine* const machine = m_workers[(a_index + i) % m_workers.size()]->m_deque.Steal();
+		if (machine != nullptr) {
+			++m_workers[a_index]->m_steals;
+			return machine;
+		}
+	}
+	return nullptr;
+}
+
+/// <summary>
+/// Runs a machine, passing its words to and from its channels, until it has to wait for a
+/// channel or it stops.
+/// </summary>
+/// <param name="a_machine">The machine</param>
+/// <param name="a_worker">The worker running it</param>
+void Pipeline::RunMachine(Machine& a_machine, Worker& a_worker)
+{
+	EmulatorSession& session = *a_machine.m_session;
+	try {
+		for (;;) {
+			switch (session.GetState()) {
+				case EmulatorSession::State::NOT_STARTED:
+					static_cast<void>(session.Resume());
+					break;
+				case EmulatorSession::State::OUTPUT_READY: {
+					const int word = session.GetOutput();
+					Channel* const out = a_machine.m_out;
+					if (out == nullptr) {
+						if (m_sharedOutputFl) {
+							a_machine.m_output.push_back(word);
+						}
+						else {
+							*m_out << word << '\n';
+						}
+					}
+					else if (out->IsAbandoned()) {
+						Finish(a_machine, a_worker, Outcome::OUTPUT_CLOSED);
+						return;
+					}
+					else if (out->TryPush(word)) {
+						++a_worker.m_words;
+						Wake(a_machine.m_consumer, a_worker);
+					}
+					else {
+						if (Park(a_machine, a_worker, false, [out] { return !out->IsFull() || out->IsAbandoned(); })) {
+							return;
+						}
+						continue;
+					}
+					static_cast<void>(session.Resume());
+					break;
+				}
+				case EmulatorSession::State::WAITING_FOR_INPUT: {
+					std::string line;
+					Channel* const in = a_machine.m_in;
+					if (in == nullptr) {
+						if (!a_machine.m_standardInputFl || !(*m_in >> line)) {
+							Finish(a_machine, a_worker, Outcome::END_OF_INPUT, "read past the end of its input");
+							return;
+						}
+					}
+					else {
+						// The producer adds its last words before it closes the channel
+						int word = 0;
+						const bool closedFl = in->IsClosed();
+						if (!in->TryPop(word)) {
+							if (closedFl) {
+								Finish(a_machine, a_worker, Outcome::END_OF_INPUT, "read past the end of its input");
+								return;
+							}
+							if (Park(a_machine, a_worker, true, [in] { return !in->IsEmpty() || in->IsClosed(); })) {
+								return;
+							}
+							continue;
+						}
+						Wake(a_machine.m_producer, a_worker);
+						line = std::to_string(word);
+					}
+					session.SetInput(std::move(line));
+					static_cast<void>(session.Resume());
+					break;
+				}
+				case EmulatorSession::State::HALTED:
+					Finish(a_machine, a_worker, Outcome::HALTED);
+					return;
+				case EmulatorSession::State::FAILED:
+					Finish(a_machine, a_worker, Outcome::FAILED, session.GetError());
+					return;
+			}
+		}
+	}
+	catch (const std::exception& e) {
+		Finish(a_machine, a_worker, Outcome::FAILED, e.what());
+	}
+}
+
+/// <summary>
+/// Parks a machine.  The machine on the other side of the channel may have changed it
+/// after this one looked, so the channel is checked again once the machine is marked
+/// parked: either this check sees the change, or the other machine sees the mark and
+/// queues this one.
+/// </summary>
+/// <param name="a_machine">The machine</param>
+/// <param name="a_worker">The worker running it</param>
+/// <param name="a_inputFl">True if the machine waits to read, false if it waits to write</param>
+/// <param name="a_ready">Returns true once the machine can go on</param>
+/// <returns>False if the machine can go on; true if the worker must leave it</returns>
+template <typename Ready>
+bool Pipeline::Park(Machine& a_machine, Worker& a_worker, bool a_inputFl, Ready a_ready)
+{
+	a_machine.m_state.store(PARKED);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (a_ready()) {
+		int expected = PARKED;
+		if (a_machine.m_state.compare_exchange_strong(expected, RUNNING)) {
+			return false;
+		}
+		// The other machine queued it already; the worker that takes it runs it
+	}
+
+	++a_worker.m_parks;
+	VC370_PROBE2(machine__park, a_machine.m_index, static_cast<int>(a_inputFl));
+	Leave();
+	return true;
+}
+
+/// <summary>
+/// Queues a machine on this worker if it is parked.  It waits for the channel this worker's
+/// machine has just written to or read from, so it can go on.
+/// </summary>
+/// <param name="a_machine">The machine on the other side of the channel</param>
+/// <param name="a_worker">The worker</param>
+void Pipeline::Wake(Machine* a_machine, Worker& a_worker)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int expected = PARKED;
+	if (a_machine->m_state.load(std::memory_order_relaxed) != PARKED || !a_machine->m_state.compare_exchange_strong(expected, QUEUED)) {
+		return;
+	}
+
+	// Counted before this worker's own task can leave, so the count never drops to zero early
+	m_active.fetch_add(1);
+	a_worker.m_deque.Push(a_machine);
+	m_signal.fetch_add(1);
+	if (m_idle.load() != 0) {
+		m_signal.notify_one();
+	}
+}
+
+/// <summary>
+/// Ends the run of a machine.  Its output channel is closed and its input channel
+/// abandoned, and the machines on the other side are woken to find out.
+/// </summary>
+/// <param name="a_machine">The machine</param>
+/// <param name="a_worker">The worker running it</param>
+/// <param name="a_outcome">How it ended</param>
+/// <param name="a_error">Why, if it did not halt</param>
+void Pipeline::Finish(Machine& a_machine, Worker& a_worker, Outcome a_outcome, std::string_view a_error)
+{
+	a_machine.m_outcome = a_outcome;
+	a_machine.m_error = a_error.substr(0, a_error.find_last_not_of('\n') + 1);
+	a_machine.m_state.store(DONE);
+	VC370_PROBE2(machine__done, a_machine.m_index, static_cast<int>(a_outcome));
+
+	if (a_machine.m_out != nullptr) {
+		a_machine.m_out->Close();
+		Wake(a_machine.m_consumer, a_worker);
+	}
+	if (a_machine.m_in != nullptr) {
+		a_machine.m_in->Abandon();
+		Wake(a_machine.m_producer, a_worker);
+	}
+	Leave();
+}
+
+/// <summary>
+/// Counts a task that parked or ended.  When none is left queued or running, every machine
+/// has ended or waits for one that has, and the pool stops.
+/// </summary>
+void Pipeline::Leave() noexcept
+{
+	if (m_active.fetch_sub(1) == 1) {
+		m_stopFl.store(true);
+		m_signal.fetch_add(1);
+		m_signal.notify_all();
+	}
+}
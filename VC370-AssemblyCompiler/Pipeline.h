@@ -0,0 +1,146 @@
+//
+//		Pipeline class - several VC370 machines wired output to input and run on a work-stealing pool.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Emulator.h"
+#include "Channel.h"
+#include "WorkStealingDeque.h"
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+class Assembler;
+
+// A pipeline is described in a text file, one statement per line ('#' starts a comment):
+//
+//   machine <Name> <SourceFile>              assembles a source; the path is relative to the file
+//   connect <From> <To> [<Capacity>]         the WRITEs of From become the READs of To
+//   connect input <To>                       To reads the standard input
+//
+// A machine has one input port and one output port, so each appears at most once on each
+// side of a connect.  A machine whose output is not connected writes to the standard output;
+// when several do, their words are printed after the run, each after the machine's name.
+//
+// Each machine runs as an EmulatorSession, a task of the pool.  A worker runs a task until
+// its machine reads from an empty channel or writes to a full one, and then parks it; the
+// machine on the other side of the channel queues it again when it has taken or added a
+// word.  The words of a channel arrive in order and a machine only waits on one channel at
+// a time, so the output does not depend on the number of workers or on how they are scheduled.
+class Pipeline {
+
+public:
+	// What the last run did.
+	struct Report {
+		size_t m_machines = 0;
+		size_t m_channels = 0;
+		unsigned m_workers = 0;
+		unsigned long long m_words = 0;		// Words sent through the channels
+		unsigned long long m_parks = 0;		// Times a machine waited for a channel
+		unsigned long long m_steals = 0;	// Tasks a worker took from another one
+	};
+
+	// All the machines are assembled for a_config; with a_optimizeFl they are optimized as by -O.
+	explicit Pipeline(const MachineConfig& a_config = MachineConfig(), bool a_optimizeFl = false) noexcept
+		: m_config(a_config), m_optimizeFl(a_optimizeFl) { }
+	~Pipeline() = default;
+
+	// Prevent copying
+	Pipeline(const Pipeline&) = delete;
+	Pipeline& operator=(const Pipeline&) = delete;
+
+	// Reads the description and assembles the machines.  Mistakes and assembly errors are
+	// written to a_err; returns false if there were any.
+	[[nodiscard]] bool Load(const std::string& a_fileName, std::ostream& a_err = std::cerr);
+
+	// Runs the machines on a_workerCount threads until they all stop.  Returns true if every
+	// machine halted (or stopped because the machine it writes to had halted); the others are
+	// reported to a_err.
+	bool Run(unsigned a_workerCount, std::istream& a_in = std::cin, std::ostream& a_out = std::cout, std::ostream& a_err = std::cerr);
+
+	[[nodiscard]] const Report& GetReport() const noexcept { return m_report; }
+
+private:
+	// How a machine's run ended.
+	enum class Outcome { RUNNING, HALTED, FAILED, END_OF_INPUT, OUTPUT_CLOSED, DEADLOCKED };
+
+	// Where the task of a machine is.  Only a worker that moves it out of PARKED may queue it.
+	enum TaskState : int { QUEUED, RUNNING, PARKED, DONE };
+
+	struct Machine {
+		std::string m_name;
+		size_t m_index = 0;
+		std::shared_ptr<const Emulator> m_image;
+		std::optional<EmulatorSession> m_session;
+		Channel* m_in = nullptr;			// Null if the input port is not connected
+		Machine* m_producer = nullptr;		// The machine that writes to m_in
+		Channel* m_out = nullptr;			// Null if the machine writes to the standard output
+		Machine* m_consumer = nullptr;		// The machine that reads m_out
+		size_t m_inCapacity = Channel::DefaultCapacity;
+		bool m_standardInputFl = false;		// Connected to input
+		std::atomic<int> m_state{ QUEUED };
+		Outcome m_outcome = Outcome::RUNNING;
+		std::string m_error;
+		std::vector<int> m_output;			// Words for the standard output, if it is shared
+	};
+
+	struct Worker {
+		explicit Worker(size_t a_capacity) : m_deque(a_capacity) { }
+		WorkStealingDeque<Machine> m_deque;
+		unsigned long long m_parks = 0;
+		unsigned long long m_steals = 0;
+		unsigned long long m_words = 0;
+	};
+
+	// Reads one statement of the description.  Returns an error message, or an empty string.
+	[[nodiscard]] std::string ParseStatement(std::string_view a_line, const std::filesystem::path& a_directory, std::vector<std::filesystem::path>& a_sources);
+
+	// Assembles the source file of a machine.  Returns false if it had errors.
+	bool AssembleMachine(Assembler& a_assem, Machine& a_machine, const std::filesystem::path& a_sourceFile, std::ostream& a_err);
+
+	// Returns the machine called a_name, or null.
+	[[nodiscard]] Machine* FindMachine(std::string_view a_name) const;
+
+	// Runs tasks until the pipeline stops.
+	void Work(size_t a_index);
+
+	// Takes a task from another worker's deque.
+	[[nodiscard]] Machine* Steal(size_t a_index);
+
+	// Runs a machine until it parks or stops.
+	void RunMachine(Machine& a_machine, Worker& a_worker);
+
+	// Parks a machine that found its channel empty or full.  Returns false if the channel
+	// became ready meanwhile, in which case the machine keeps running.
+	template <typename Ready>
+	[[nodiscard]] bool Park(Machine& a_machine, Worker& a_worker, bool a_inputFl, Ready a_ready);
+
+	// Queues a parked machine on this worker, now that its channel may be ready.
+	void Wake(Machine* a_machine, Worker& a_worker);
+
+	// Ends the run of a machine and wakes the machines on its channels.
+	void Finish(Machine& a_machine, Worker& a_worker, Outcome a_outcome, std::string_view a_error = {});
+
+	// A task stops running: it parked or ended.  The last one stops the pool.
+	void Leave() noexcept;
+
+	MachineConfig m_config;
+	bool m_optimizeFl;
+	std::vector<std::unique_ptr<Machine>> m_machines;
+	std::vector<std::unique_ptr<Channel>> m_channels;
+	std::vector<std::unique_ptr<Worker>> m_workers;
+
+	// The tasks that are queued or running; when it drops to zero no machine can make progress
+	std::atomic<size_t> m_active{ 0 };
+	std::atomic<bool> m_stopFl{ false };
+	// Bumped when a task is queued, so that idle workers waiting on it look again
+	std::atomic<unsigned> m_signal{ 0 };
+	std::atomic<unsigned> m_idle{ 0 };
+
+	std::istream* m_in = &std::cin;
+	std::ostream* m_out = &std::cout;
+	bool m_sharedOutputFl = false;		// Several machines write to the standard output
+	Report m_report;
+};
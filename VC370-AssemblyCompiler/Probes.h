@@ -0,0 +1,81 @@
+//
+//		Probes - static tracepoints (USDT) for perf, bpftrace and SystemTap.
+//
+#pragma once
+
+#include <type_traits>
+
+// A probe is a NOP in the code and a note in the .note.stapsdt section of the ELF file,
+// laid out as by <sys/sdt.h>: the address of the NOP, the provider ("vc370"), the name
+// of the probe and where each argument is, e.g. "-4@%eax".  A tracer that attaches to a
+// probe replaces the NOP with a breakpoint; nothing else happens at run time, and the
+// program does not need <sys/sdt.h> or any library to build or run.
+//
+// The probes are emitted on Linux on x86-64 and AArch64 with GCC or Clang.  Elsewhere,
+// or when built with VC370_PROBES=0, the macros expand to nothing.
+//
+//   bpftrace -e 'usdt:./Assem:vc370:error__record { @[arg0] = count(); }' -c './Assem bad.asm'
+//
+// The note holds a probe name as it is written here, with its double underscore (pass1__start),
+// and perf and bpftrace take it that way.
+#ifndef VC370_PROBES
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__)) && defined(__GNUC__)
+#define VC370_PROBES 1
+#else
+#define VC370_PROBES 0
+#endif
+#endif
+
+#if VC370_PROBES
+
+// The size of an argument, positive for signed types: %n prints it negated, and a signed
+// argument is written with a negative size, e.g. "-4@%eax".
+#define VC370_PROBE_SIZE(x) ((std::is_signed_v<std::decay_t<decltype(x)>> ? 1 : -1) * static_cast<int>(sizeof(x)))
+
+// The .stapsdt.base section lets the tools adjust the probe addresses of a prelinked file.
+#define VC370_PROBE_ASM(name, args) \
+	"990:\tnop\n" \
+	"\t.pushsection .note.stapsdt,\"?\",\"note\"\n" \
+	"\t.balign 4\n" \
+	"\t.4byte 992f-991f, 994f-993f, 3\n" \
+	"991:\t.asciz \"stapsdt\"\n" \
+	"992:\t.balign 4\n" \
+	"993:\t.8byte 990b\n" \
+	"\t.8byte _.stapsdt.base\n" \
+	"\t.8byte 0\n" \
+	"\t.asciz \"vc370\"\n" \
+	"\t.asciz \"" #name "\"\n" \
+	"\t.asciz \"" args "\"\n" \
+	"994:\t.balign 4\n" \
+	"\t.popsection\n" \
+	"\t.ifndef _.stapsdt.base\n" \
+	"\t.pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+	"\t.weak _.stapsdt.base\n" \
+	"\t.hidden _.stapsdt.base\n" \
+	"_.stapsdt.base:\t.space 1\n" \
+	"\t.size _.stapsdt.base, 1\n" \
+	"\t.popsection\n" \
+	"\t.endif\n"
+
+// Arguments are in registers or constants.  <sys/sdt.h> also allows memory, but a thread-local
+// operand would be %fs-relative, which the tools cannot read; the probes are not on hot paths.
+#define VC370_PROBE_ARG(n, x) [s##n] "n" (VC370_PROBE_SIZE(x)), [a##n] "nr" (x)
+
+#define VC370_PROBE0(name) \
+	__asm__ __volatile__(VC370_PROBE_ASM(name, ""))
+#define VC370_PROBE1(name, a1) \
+	__asm__ __volatile__(VC370_PROBE_ASM(name, "%n[s1]@%[a1]") :: VC370_PROBE_ARG(1, a1))
+#define VC370_PROBE2(name, a1, a2) \
+	__asm__ __volatile__(VC370_PROBE_ASM(name, "%n[s1]@%[a1] %n[s2]@%[a2]") :: VC370_PROBE_ARG(1, a1), VC370_PROBE_ARG(2, a2))
+#define VC370_PROBE3(name, a1, a2, a3) \
+	__asm__ __volatile__(VC370_PROBE_ASM(name, "%n[s1]@%[a1] %n[s2]@%[a2] %n[s3]@%[a3]") \
+		:: VC370_PROBE_ARG(1, a1), VC370_PROBE_ARG(2, a2), VC370_PROBE_ARG(3, a3))
+
+#else
+
+#define VC370_PROBE0(name) ((void)0)
+#define VC370_PROBE1(name, a1) ((void)0)
+#define VC370_PROBE2(name, a1, a2) ((void)0)
+#define VC370_PROBE3(name, a1, a2, a3) ((void)0)
+
+#endif
@@ -0,0 +1,307 @@
+#include "Protocol.h"
+#include "stdafx.h"
+#include <cstring>
+#include <mutex>
+
+#ifdef _WIN32
+#pragma comment(lib, "Ws2_32.lib")
+#define SEND_FLAGS 0
+#else
+#include <sys/stat.h>
+#define SEND_FLAGS MSG_NOSIGNAL   // A client that went away must not kill the daemon with SIGPIPE
+#endif
+
+/// <summary>
+/// Initializes Winsock once per process.  Nothing is needed elsewhere.
+/// </summary>
+static void InitSockets()
+{
+#ifdef _WIN32
+	static std::once_flag initialized;
+	std::call_once(initialized, [] {
+		WSADATA data;
+		static_cast<void>(WSAStartup(MAKEWORD(2, 2), &data));
+	});
+#endif
+}
+
+/// <summary>
+/// Fills in the address of a Unix domain socket.
+/// </summary>
+/// <param name="a_path">The path of the socket</param>
+/// <param name="a_addr">The address to be filled in</param>
+/// <returns>False if the path does not fit in the address</returns>
+static bool MakeAddress(const std::string& a_path, sockaddr_un& a_addr)
+{
+	std::memset(&a_addr, 0, sizeof(a_addr));
+	a_addr.sun_family = AF_UNIX;
+	if (a_path.size() >= sizeof(a_addr.sun_path)) {
+		std::cerr << "Socket path is too long: " << a_path << '\n';
+		return false;
+	}
+	std::memcpy(a_addr.sun_path, a_path.c_str(), a_path.size() + 1);
+	return true;
+}
+
+/// <summary>
+/// Move assignment; closes the socket that was held before.
+/// </summary>
+/// <param name="a_other">The socket to be moved</param>
+/// <returns>This socket</returns>
+Socket& Socket::operator=(Socket&& a_other) noexcept
+{
+	if (this != &a_other) {
+		Close();
+		m_handle = std::exchange(a_other.m_handle, InvalidHandle);
+	}
+	return *this;
+}
+
+/// <summary>
+/// Closes the socket.
+/// </summary>
+void Socket::Close() noexcept
+{
+	if (m_handle == InvalidHandle) return;
+#ifdef _WIN32
+	closesocket(m_handle);
+#else
+	close(m_handle);
+#endif
+	m_handle = InvalidHandle;
+}
+
+/// <summary>
+/// Removes the socket file an earlier daemon left behind at a path.  Anything else there,
+/// a regular file or the socket of a daemon that still listens, is left alone.
+/// </summary>
+/// <param name="a_path">The path of the socket</param>
+/// <param name="a_addr">Its address</param>
+/// <returns>False if the path is taken</returns>
+bool Socket::RemoveStaleSocket(const std::string& a_path, const sockaddr_un& a_addr)
+{
+#ifdef _WIN32
+	// A Unix domain socket is a reparse point on Windows
+	const DWORD attributes = GetFileAttributesA(a_path.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES) return true;
+	const bool socketFl = (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+#else
+	struct stat info;
+	if (lstat(a_path.c_str(), &info) != 0) return true;
+	const bool socketFl = S_ISSOCK(info.st_mode);
+#endif
+	if (!socketFl) {
+		std::cerr << "Path exists and is not a socket: " << a_path << '\n';
+		return false;
+	}
+
+	Socket probe(socket(AF_UNIX, SOCK_STREAM, 0));
+	if (probe.IsValid() && connect(probe.m_handle, reinterpret_cast<const sockaddr*>(&a_addr), sizeof(a_addr)) == 0) {
+		std::cerr << "A daemon is already listening on " << a_path << '\n';
+		return false;
+	}
+	std::remove(a_path.c_str());
+	return true;
+}
+
+/// <summary>
+/// Creates a socket that listens on the given path.
+/// A socket file left behind by an earlier daemon is removed first.
+/// </summary>
+/// <param name="a_path">The path of the socket</param>
+/// <param name="a_backlog">The number of connections the system may hold before they are accepted</param>
+/// <returns>The listening socket; it is not valid if the socket could not be created or the path is taken</returns>
+Socket Socket::Listen(const std::string& a_path, int a_backlog)
+{
+	InitSockets();
+
+	sockaddr_un addr;
+	if (!MakeAddress(a_path, addr)) return Socket();
+
+	Socket sock(socket(AF_UNIX, SOCK_STREAM, 0));
+	if (!sock.IsValid()) return Socket();
+
+	if (!RemoveStaleSocket(a_path, addr)) return Socket();
+	if (bind(sock.m_handle, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0
+		|| listen(sock.m_handle, a_backlog) != 0) {
+		std::cerr << "Could not listen on " << a_path << '\n';
+		return Socket();
+	}
+	return sock;
+}
+
+/// <summary>
+/// Connects to a daemon listening on the given path.
+/// </summary>
+/// <param name="a_path">The path of the socket</param>
+/// <returns>The connected socket; it is not valid if the connection failed</returns>
+Socket Socket::Connect(const std::string& a_path)
+{
+	InitSockets();
+
+	sockaddr_un addr;
+	if (!MakeAddress(a_path, addr)) return Socket();
+
+	Socket sock(socket(AF_UNIX, SOCK_STREAM, 0));
+	if (!sock.IsValid()) return Socket();
+
+	if (connect(sock.m_handle, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+		std::cerr << "Could not connect to " << a_path << '\n';
+		return Socket();
+	}
+	return sock;
+}
+
+/// <summary>
+/// Waits for the next connection on a listening socket.
+/// </summary>
+/// <returns>The connected socket; it is not valid if accepting failed</returns>
+Socket Socket::Accept() const
+{
+	return Socket(accept(m_handle, nullptr, nullptr));
+}
+
+/// <summary>
+/// Sets the send and receive timeouts of the socket, so that a peer that stops sending
+/// or reading does not hold the other side forever.
+/// </summary>
+/// <param name="a_timeout">The longest a send or a receive may wait</param>
+/// <returns>False if the timeouts could not be set</returns>
+bool Socket::SetTimeout(std::chrono::milliseconds a_timeout) const noexcept
+{
+#ifdef _WIN32
+	const DWORD timeout = static_cast<DWORD>(a_timeout.count());
+#else
+	const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(a_timeout);
+	const timeval timeout{ static_cast<time_t>(seconds.count()), static_cast<suseconds_t>((a_timeout - seconds).count() * 1000) };
+#endif
+	const char* value = reinterpret_cast<const char*>(&timeout);
+	return setsockopt(m_handle, SOL_SOCKET, SO_RCVTIMEO, value, sizeof(timeout)) == 0
+		&& setsockopt(m_handle, SOL_SOCKET, SO_SNDTIMEO, value, sizeof(timeout)) == 0;
+}
+
+/// <summary>
+/// Sends the whole buffer, retrying after partial writes.
+/// </summary>
+/// <param name="a_data">The data to be sent</param>
+/// <returns>True if everything was sent</returns>
+bool Socket::SendAll(std::string_view a_data) const
+{
+	while (!a_data.empty()) {
+		const int chunk = static_cast<int>(std::min<size_t>(a_data.size(), 1 << 20));
+		const auto sent = send(m_handle, a_data.data(), chunk, SEND_FLAGS);
+		if (sent <= 0) return false;
+		a_data.remove_prefix(static_cast<size_t>(sent));
+	}
+	return true;
+}
+
+/// <summary>
+/// Receives exactly the given number of bytes.
+/// </summary>
+/// <param name="a_data">The buffer that receives the data</param>
+/// <param name="a_size">The number of bytes to be received</param>
+/// <returns>True if all the bytes were received before the connection closed</returns>
+bool Socket::ReceiveAll(char* a_data, size_t a_size) const
+{
+	while (a_size > 0) {
+		const int chunk = static_cast<int>(std::min<size_t>(a_size, 1 << 20));
+		const auto received = recv(m_handle, a_data, chunk, 0);
+		if (received <= 0) return false;
+		a_data += received;
+		a_size -= static_cast<size_t>(received);
+	}
+	return true;
+}
+
+/// <summary>
+/// Receives one line.  Section headers are short, so they are read a byte at a time.
+/// </summary>
+/// <param name="a_line">The line without the newline</param>
+/// <param name="a_maxSize">The longest line accepted</param>
+/// <returns>True if a whole line was received</returns>
+bool Socket::ReceiveLine(std::string& a_line, size_t a_maxSize) const
+{
+	a_line.clear();
+	char c = 0;
+	while (ReceiveAll(&c, 1)) {
+		if (c == '\n') return true;
+		if (a_line.size() == a_maxSize) return false;
+		a_line.push_back(c);
+	}
+	return false;
+}
+
+/// <summary>
+/// Returns the data of the first section with the given name.
+/// </summary>
+/// <param name="a_name">The name of the section</param>
+/// <returns>The data of the section, or nullptr if there is no such section</returns>
+const std::string* Message::Find(std::string_view a_name) const noexcept
+{
+	const auto it = std::ranges::find(m_sections, a_name, [](const auto& a_section) -> std::string_view { return a_section.first; });
+	return it == m_sections.end() ? nullptr : &it->second;
+}
+
+/// <summary>
+/// Returns the data of every section with the given name.
+/// </summary>
+/// <param name="a_name">The name of the sections</param>
+/// <returns>The data of the sections in the order they were added</returns>
+std::vector<std::string_view> Message::FindAll(std::string_view a_name) const
+{
+	std::vector<std::string_view> found;
+	for (const auto& [name, data] : m_sections) {
+		if (name == a_name) found.push_back(data);
+	}
+	return found;
+}
+
+/// <summary>
+/// Sends the message followed by the END section.
+/// </summary>
+/// <param name="a_socket">The connected socket</param>
+/// <returns>True if the whole message was sent</returns>
+bool Message::Send(const Socket& a_socket) const
+{
+	std::string wire;
+	for (const auto& [name, data] : m_sections) {
+		wire += std::format("{} {}\n", name, data.size());
+		wire += data;
+	}
+	wire += "END 0\n";
+	return a_socket.SendAll(wire);
+}
+
+/// <summary>
+/// Receives the sections up to the END section.
+/// </summary>
+/// <param name="a_socket">The connected socket</param>
+/// <returns>True if a well formed message was received</returns>
+bool Message::Receive(const Socket& a_socket)
+{
+	m_sections.clear();
+	size_t total = 0;		// The data received so far
+
+	std::string header;
+	while (a_socket.ReceiveLine(header, 64)) {
+		const size_t space = header.find(' ');
+		if (space == std::string::npos || space == 0) return false;
+
+		std::string name = header.substr(0, space);
+		const std::string length = header.substr(space + 1);
+		if (length.empty() || length.size() > 9 || !std::ranges::all_of(length, [](unsigned char c) { return std::isdigit(c); })) {
+			return false;
+		}
+
+		const size_t size = std::stoul(length);
+		if (name == "END") return size == 0;
+		if (size > MaxSectionSize || size > MaxMessageSize - total || m_sections.size() == MaxSectionCount) return false;
+		total += size;
+
+		std::string data(size, '\0');
+		if (!a_socket.ReceiveAll(data.data(), size)) return false;
+		Add(std::move(name), std::move(data));
+	}
+	return false;
+}
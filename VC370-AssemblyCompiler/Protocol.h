@@ -0,0 +1,102 @@
+//
+//		Protocol classes - the socket and message framing shared by the assembler daemon and its client.
+//
+#pragma once
+
+#include "stdafx.h"
+#include <chrono>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// A connected or listening Unix domain socket.  The socket is closed when the object is destroyed.
+class Socket {
+
+public:
+#ifdef _WIN32
+	using Handle = SOCKET;
+	static constexpr Handle InvalidHandle = INVALID_SOCKET;
+#else
+	using Handle = int;
+	static constexpr Handle InvalidHandle = -1;
+#endif
+
+	Socket() = default;
+	explicit Socket(Handle a_handle) noexcept : m_handle(a_handle) { }
+	~Socket() { Close(); }
+
+	// Sockets are moved, never copied
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+	Socket(Socket&& a_other) noexcept : m_handle(std::exchange(a_other.m_handle, InvalidHandle)) { }
+	Socket& operator=(Socket&& a_other) noexcept;
+
+	// Creates a socket that listens on the given path, replacing a stale socket file.
+	[[nodiscard]] static Socket Listen(const std::string& a_path, int a_backlog);
+
+	// Connects to a daemon listening on the given path.
+	[[nodiscard]] static Socket Connect(const std::string& a_path);
+
+	// Waits for the next connection on a listening socket.
+	[[nodiscard]] Socket Accept() const;
+
+	// Makes a send or receive that waits longer than a_timeout fail.  Returns false if it could not be set.
+	bool SetTimeout(std::chrono::milliseconds a_timeout) const noexcept;
+
+	// Sends the whole buffer.
+	[[nodiscard]] bool SendAll(std::string_view a_data) const;
+
+	// Receives exactly a_size bytes.
+	[[nodiscard]] bool ReceiveAll(char* a_data, size_t a_size) const;
+
+	// Receives one line without the newline.
+	[[nodiscard]] bool ReceiveLine(std::string& a_line, size_t a_maxSize) const;
+
+	[[nodiscard]] bool IsValid() const noexcept { return m_handle != InvalidHandle; }
+
+	void Close() noexcept;
+
+private:
+	// Removes a socket file left behind by a daemon that is gone.  Returns false if the path is taken.
+	[[nodiscard]] static bool RemoveStaleSocket(const std::string& a_path, const sockaddr_un& a_addr);
+
+	Handle m_handle = InvalidHandle;
+};
+
+// A request or a response: a list of named sections.  On the wire each section is sent as
+//   NAME <length>\n<length bytes of data>
+// and the message ends with the section "END 0\n".
+class Message {
+
+public:
+	// The largest section, the largest message and the most sections accepted from the other
+	// side; a message beyond any of them is rejected before more of it is read.
+	static constexpr size_t MaxSectionSize = 64 * 1024 * 1024;
+	static constexpr size_t MaxMessageSize = 256 * 1024 * 1024;
+	static constexpr size_t MaxSectionCount = 4096;
+
+	// Adds a section.  A name may appear more than once.
+	void Add(std::string a_name, std::string a_data) { m_sections.emplace_back(std::move(a_name), std::move(a_data)); }
+
+	// Returns the data of the first section with the given name, or nullptr if there is none.
+	[[nodiscard]] const std::string* Find(std::string_view a_name) const noexcept;
+
+	// Returns the data of every section with the given name in the order they were added.
+	[[nodiscard]] std::vector<std::string_view> FindAll(std::string_view a_name) const;
+
+	// Sends the message over the socket.
+	[[nodiscard]] bool Send(const Socket& a_socket) const;
+
+	// Receives a whole message from the socket.
+	[[nodiscard]] bool Receive(const Socket& a_socket);
+
+private:
+	std::vector<std::pair<std::string, std::string>> m_sections;
+};
@@ -0,0 +1,306 @@
+#include "Server.h"
+#include "stdafx.h"
+#include "Assembler.h"
+#include "Linker.h"
+#include "Error.h"
+#include "Metrics.h"
+
+/// <summary>
+/// Constructor for the Server class.
+/// </summary>
+/// <param name="a_socketPath">The path of the Unix domain socket to listen on</param>
+/// <param name="a_workerCount">The number of requests served at the same time</param>
+/// <param name="a_queueCapacity">The number of connections that may wait for a worker</param>
+/// <param name="a_cacheCapacity">The number of assembled sources kept</param>
+/// <param name="a_cacheBytes">The bytes the assembled sources kept may take</param>
+Server::Server(std::string a_socketPath, unsigned a_workerCount, size_t a_queueCapacity, size_t a_cacheCapacity, size_t a_cacheBytes)
+	: m_socketPath(std::move(a_socketPath))
+	, m_workerCount(std::max(a_workerCount, 1u))
+	, m_queueCapacity(std::max<size_t>(a_queueCapacity, 1))
+	, m_cacheCapacity(a_cacheCapacity)
+	, m_cacheByteCapacity(a_cacheBytes)
+{
+}
+
+/// <summary>
+/// Starts the workers and accepts connections.
+/// A connection that finds the queue full is answered with STATUS BUSY right away,
+/// so that a burst of clients cannot pile up unbounded work in the daemon.
+/// </summary>
+/// <returns>False if the socket could not be created or accepting failed</returns>
+bool Server::Run()
+{
+	Socket listener = Socket::Listen(m_socketPath, static_cast<int>(m_queueCapacity));
+	if (!listener.IsValid()) {
+		return false;
+	}
+
+	std::vector<std::jthread> workers;
+	for (unsigned i = 0; i < m_workerCount; ++i) {
+		workers.emplace_back([this](std::stop_token a_stop) { Work(a_stop); });
+	}
+	std::cerr << std::format("Listening on {} with {} workers\n", m_socketPath, m_workerCount);
+
+	while (true) {
+		Socket client = listener.Accept();
+		if (!client.IsValid()) {
+			break;
+		}
+		static_cast<void>(client.SetTimeout(ClientTimeout));
+
+		std::unique_lock lock(m_queueMutex);
+		if (m_queue.size() >= m_queueCapacity) {
+			lock.unlock();
+			Message busy;
+			busy.Add("STATUS", "BUSY");
+			static_cast<void>(busy.Send(client));
+			continue;
+		}
+		m_queue.push_back(std::move(client));
+		lock.unlock();
+		m_queueReady.notify_one();
+	}
+
+	// Destroying the workers stops them once they have served their current clients
+	std::cerr << "Accepting connections failed, daemon terminated.\n";
+	return false;
+}
+
+/// <summary>
+/// The loop of a worker thread.
+/// </summary>
+/// <param name="a_stop">Requested when the daemon stops</param>
+void Server::Work(std::stop_token a_stop)
+{
+	while (true) {
+		Socket client;
+		{
+			std::unique_lock lock(m_queueMutex);
+			if (!m_queueReady.wait(lock, a_stop, [this] { return !m_queue.empty(); })) {
+				return;
+			}
+			client = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+		Serve(client);
+	}
+}
+
+/// <summary>
+/// Reads one request from the client and sends the response.
+/// </summary>
+/// <param name="a_client">The connected client</param>
+void Server::Serve(const Socket& a_client)
+{
+	Message request;
+	Message response;
+	if (request.Receive(a_client)) {
+		response = Process(request);
+	}
+	else {
+		response.Add("STATUS", "BAD_REQUEST");
+	}
+	static_cast<void>(response.Send(a_client));
+}
+
+/// <summary>
+/// Builds the response to a request.  A request holds either one SOURCE section
+/// or one or more OBJECT sections to be linked, and optionally WIDTH (the operand
+/// digits of the machine), PROFILE (EXTENDED for the extended instruction set) and
+/// INPUT (what the program READs).  The response holds
+/// STATUS (OK, ERRORS or BAD_REQUEST), LISTING, ERRORS and OUTPUT.
+/// A request with a METRICS section is answered with the metrics of the daemon as JSON.
+/// </summary>
+/// <param name="a_request">The request</param>
+/// <returns>The response</returns>
+Message Server::Process(const Message& a_request)
+{
+	Message response;
+
+	if (a_request.Find("METRICS") != nullptr) {
+		std::ostringstream json;
+		Metrics::WriteJson(json);
+		response.Add("STATUS", "OK");
+		response.Add("METRICS", json.str());
+		return response;
+	}
+
+	MachineConfig config;
+	if (const std::string* width = a_request.Find("WIDTH")) {
+		const bool validFl = width->size() == 1 && std::isdigit(static_cast<unsigned char>((*width)[0]))
+			&& MachineConfig::IsValidOperandDigits((*width)[0] - '0');
+		if (!validFl) {
+			response.Add("STATUS", "BAD_REQUEST");
+			return response;
+		}
+		config = MachineConfig((*width)[0] - '0');
+	}
+	if (const std::string* profile = a_request.Find("PROFILE")) {
+		if (*profile != "EXTENDED") {
+			response.Add("STATUS", "BAD_REQUEST");
+			return response;
+		}
+		config = MachineConfig(config.GetOperandDigits(), true);
+	}
+
+	const std::string* source = a_request.Find("SOURCE");
+	const std::vector<std::string_view> objects = a_request.FindAll("OBJECT");
+	if ((source == nullptr) == objects.empty()) {
+		response.Add("STATUS", "BAD_REQUEST");
+		return response;
+	}
+
+	const std::shared_ptr<const Assembly> assembly = source != nullptr ? Assemble(*source, config) : Link(objects);
+	if (assembly == nullptr) {
+		response.Add("STATUS", "BAD_REQUEST");
+		return response;
+	}
+
+	const std::string* input = a_request.Find("INPUT");
+	Run(*assembly, input != nullptr ? *input : std::string(), response);
+	return response;
+}
+
+/// <summary>
+/// Hashes a source together with the machine it is assembled for.
+/// </summary>
+/// <param name="a_source">The text of the source</param>
+/// <param name="a_config">The dimensions of the target machine</param>
+/// <returns>The hash</returns>
+size_t Server::HashSource(std::string_view a_source, const MachineConfig& a_config) noexcept
+{
+	const size_t hash = std::hash<std::string_view>{}(a_source);
+	const size_t machine = static_cast<size_t>(a_config.GetOperandDigits()) * 2 + (a_config.IsExtended() ? 1 : 0);
+	return hash ^ (machine + 0x9E3779B9 + (hash << 6) + (hash >> 2));
+}
+
+/// <summary>
+/// Assembles a source.  The same source for the same machine is assembled only once
+/// while it stays in the cache.
+/// </summary>
+/// <param name="a_source">The text of the source</param>
+/// <param name="a_config">The dimensions of the target machine</param>
+/// <returns>The assembly</returns>
+std::shared_ptr<const Server::Assembly> Server::Assemble(const std::string& a_source, const MachineConfig& a_config)
+{
+	const size_t hash = HashSource(a_source, a_config);
+	const auto findEntry = [&] {
+		const auto [first, last] = m_cacheIndex.equal_range(hash);
+		const auto it = std::find_if(first, last, [&](const auto& a_index) {
+			return a_index.second->m_config == a_config && a_index.second->m_source == a_source;
+		});
+		return it != last ? it->second : m_cache.end();
+	};
+
+	if (m_cacheCapacity > 0) {
+		std::lock_guard lock(m_cacheMutex);
+		if (const auto entry = findEntry(); entry != m_cache.end()) {
+			m_cache.splice(m_cache.begin(), m_cache, entry);
+			return entry->m_assembly;
+		}
+	}
+
+	// Each worker keeps an assembler for the machine it assembled for last, so its tables are
+	// reused.  The errors are kept per thread, and Assemble starts a new report.
+	thread_local std::optional<Assembler> assem;
+	if (!assem || assem->GetConfig() != a_config) {
+		assem.emplace(a_config);
+	}
+
+	std::ostringstream listing;
+	assem->SetOutput(listing, false);
+	Assembler::Result result = assem->Assemble(a_source);
+
+	std::ostringstream errors;
+	Error::DisplayErrors(errors);
+	auto assembly = std::make_shared<const Assembly>(Assembly{ listing.str(), errors.str(), std::move(result.m_image) });
+
+	const size_t bytes = a_source.size() + assembly->m_listing.size() + assembly->m_errors.size()
+		+ assembly->m_image->GetAllocatedWords() * sizeof(int);
+	if (m_cacheCapacity > 0 && bytes <= m_cacheByteCapacity) {
+		std::lock_guard lock(m_cacheMutex);
+		if (findEntry() == m_cache.end()) {
+			m_cache.push_front(CacheEntry{ hash, a_source, a_config, bytes, assembly });
+			m_cacheIndex.emplace(hash, m_cache.begin());
+			m_cacheBytes += bytes;
+			while (m_cache.size() > m_cacheCapacity || m_cacheBytes > m_cacheByteCapacity) {
+				const auto last = std::prev(m_cache.end());
+				const auto [first, end] = m_cacheIndex.equal_range(last->m_hash);
+				m_cacheIndex.erase(std::find_if(first, end, [&](const auto& a_index) { return a_index.second == last; }));
+				m_cacheBytes -= last->m_bytes;
+				m_cache.pop_back();
+			}
+		}
+	}
+	return assembly;
+}
+
+/// <summary>
+/// Links object modules.  The machine is the one the first module was assembled for.
+/// </summary>
+/// <param name="a_objects">The text of the object modules</param>
+/// <returns>The linked image, or nullptr if a module could not be read</returns>
+std::shared_ptr<const Server::Assembly> Server::Link(const std::vector<std::string_view>& a_objects)
+{
+	Error::InitErrorReporting();
+
+	Linker linker;
+	MachineConfig config(MachineConfig::ClassicOperandDigits);
+	for (size_t i = 0; i < a_objects.size(); ++i) {
+		std::istringstream text{ std::string(a_objects[i]) };
+		ObjectModule module;
+		if (!module.Read(text, std::format("OBJECT {}", i + 1))) {
+			return nullptr;
+		}
+		if (i == 0) {
+			config = module.GetConfig();
+		}
+		linker.AddModule(std::move(module));
+	}
+
+	Emulator emul{ config };
+	static_cast<void>(linker.Link(emul));
+
+	std::ostringstream errors;
+	Error::DisplayErrors(errors);
+	return std::make_shared<const Assembly>(Assembly{ std::string(), errors.str(), std::make_shared<const Emulator>(std::move(emul)) });
+}
+
+/// <summary>
+/// Runs a program on a copy-on-write instance of its image, so that a cached image is
+/// never changed.  Each worker keeps the instance of the image it ran last; when the same
+/// image is run again the instance is reset, which restores only the pages the previous
+/// run wrote.  A program with errors is not run.
+/// </summary>
+/// <param name="a_assembly">The assembly to be run</param>
+/// <param name="a_input">The input of the program</param>
+/// <param name="a_response">The response the results are added to</param>
+void Server::Run(const Assembly& a_assembly, const std::string& a_input, Message& a_response)
+{
+	std::string output;
+	if (a_assembly.m_errors.empty()) {
+		Error::InitErrorReporting();
+
+		thread_local std::shared_ptr<const Emulator> lastImage;
+		thread_local std::optional<Emulator> instance;
+		if (instance && lastImage == a_assembly.m_image) {
+			instance->Reset();
+		}
+		else {
+			instance.emplace(a_assembly.m_image);
+			instance->SetInstructionLimit(DefaultInstructionLimit);
+			lastImage = a_assembly.m_image;
+		}
+		Emulator& emul = *instance;
+
+		std::istringstream in(a_input);
+		std::ostringstream out;
+		static_cast<void>(emul.RunProgram(in, out));
+		output = out.str();
+	}
+
+	a_response.Add("STATUS", a_assembly.m_errors.empty() ? "OK" : "ERRORS");
+	a_response.Add("LISTING", a_assembly.m_listing);
+	a_response.Add("ERRORS", a_assembly.m_errors);
+	a_response.Add("OUTPUT", std::move(output));
+}
@@ -0,0 +1,97 @@
+//
+//		Server class - a daemon that assembles and runs VC370 programs sent over a Unix domain socket.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Protocol.h"
+#include "Emulator.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+class Server {
+
+public:
+	// The instructions a program may execute before the daemon stops it.
+	static constexpr unsigned long long DefaultInstructionLimit = 100'000'000;
+
+	// The longest a worker waits for a client to send or read; a stalled client then loses its connection.
+	static constexpr std::chrono::seconds ClientTimeout{ 30 };
+
+	// The bytes of sources, listings and images the cache may hold.
+	static constexpr size_t DefaultCacheBytes = size_t{ 256 } << 20;
+
+	Server(std::string a_socketPath, unsigned a_workerCount, size_t a_queueCapacity = 64, size_t a_cacheCapacity = 64,
+		size_t a_cacheBytes = DefaultCacheBytes);
+	~Server() = default;
+
+	// Prevent copying
+	Server(const Server&) = delete;
+	Server& operator=(const Server&) = delete;
+
+	// Accepts connections until the listening socket fails.  Returns false if it could not be
+	// created or accepting failed; the workers finish the requests they serve first.
+	bool Run();
+
+private:
+	// The result of assembling a source; kept in the cache so that a source sent again is only run.
+	struct Assembly {
+		std::string m_listing;      // Symbol table and translation
+		std::string m_errors;       // The errors; empty if the program can be run
+		std::shared_ptr<const Emulator> m_image;    // The loaded image; runs use copy-on-write instances of it
+	};
+
+	// An entry of the cache.  The source is kept once, here, so that a hash that matches can be checked.
+	struct CacheEntry {
+		size_t m_hash;                              // The hash of the source and the machine
+		std::string m_source;                       // The source that was assembled
+		MachineConfig m_config;                     // The machine it was assembled for
+		size_t m_bytes;                             // The memory the entry takes
+		std::shared_ptr<const Assembly> m_assembly;
+	};
+
+	// Hashes a source together with the machine it is assembled for.
+	[[nodiscard]] static size_t HashSource(std::string_view a_source, const MachineConfig& a_config) noexcept;
+
+	// Takes connections off the queue and serves them until a_stop is requested.
+	void Work(std::stop_token a_stop);
+
+	// Reads a request and sends its response.
+	void Serve(const Socket& a_client);
+
+	// Builds the response to a request.
+	Message Process(const Message& a_request);
+
+	// Assembles a source, or finds it in the cache.
+	std::shared_ptr<const Assembly> Assemble(const std::string& a_source, const MachineConfig& a_config);
+
+	// Links object modules.
+	std::shared_ptr<const Assembly> Link(const std::vector<std::string_view>& a_objects);
+
+	// Runs an assembled program on an instance of its image.
+	static void Run(const Assembly& a_assembly, const std::string& a_input, Message& a_response);
+
+	std::string m_socketPath;
+	unsigned m_workerCount;
+	size_t m_queueCapacity;
+	size_t m_cacheCapacity;
+	size_t m_cacheByteCapacity;
+
+	// Connections accepted but not yet served.  When it is full new clients are told to retry.
+	std::deque<Socket> m_queue;
+	std::mutex m_queueMutex;
+	std::condition_variable_any m_queueReady;
+
+	// Least recently used assemblies; the most recent is at the front.  They are indexed by
+	// HashSource, and evicted when there are more than m_cacheCapacity of them or they take
+	// more than m_cacheByteCapacity bytes.
+	std::list<CacheEntry> m_cache;
+	std::unordered_multimap<size_t, decltype(m_cache)::iterator> m_cacheIndex;
+	size_t m_cacheBytes = 0;
+	std::mutex m_cacheMutex;
+};
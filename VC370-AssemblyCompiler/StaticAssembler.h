@@ -0,0 +1,363 @@
+//
+//		StaticAssembler class - assembles a VC370 source at compile time.
+//
+#pragma once
+
+#include "stdafx.h"
+#include "Instruction.h"
+#include "Emulator.h"
+#include "Error.h"
+#include "Expression.h"
+
+// Programs that ship inside a tool are assembled by the C++ compiler:
+//
+//		static constexpr StaticAssembler::Image image = StaticAssembler::Assemble(R"(...)");
+//		Emulator emul(image);
+//
+// Assemble uses the lexer of Instruction and does both passes in constant evaluation, so
+// the image is a constant of the host binary and starting the program does no assembly
+// work.  The rules are those of the Assembler for the classic 10,000 word machine.  A
+// source with an error does not compile: the error stops the constant evaluation at a
+// call to one of the Diagnostic functions, which the compiler names in its message; the
+// line number is the argument of the call.  Linkage directives need the linker and are
+// errors here.
+class StaticAssembler {
+
+public:
+	// The memory of the classic machine, word by word.
+	using Image = std::array<int, Emulator::MEMSZ>;
+
+	// Assembles a source for the classic machine, or for the extended instruction set.
+	[[nodiscard]] static consteval Image Assemble(std::string_view a_source, bool a_extendedFl = false);
+
+	// The errors.  They are not constexpr, so calling one in constant evaluation is a compile error.
+	struct Diagnostic {
+		static void InvalidOpcode(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void UndefinedLabel(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void DuplicateLabel(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void InvalidLabel(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void SyntaxError(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void ExtraElements(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void MissingOperand(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void MissingEndStatement(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void EndStatementNotLast(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void OperandOverflow(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void InvalidOperand(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void MemoryOverflow(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void MachineCodeAfterHalt(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void AssemblyCodeBeforeHalt(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void LinkageDirective(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+		static void DivisionByZero(int a_lineNumber) noexcept { static_cast<void>(a_lineNumber); }
+	};
+
+private:
+	// A line of the source with its elements.
+	struct Line {
+		int m_number;					// Counted from 1
+		Instruction::Elements m_elements;
+		bool m_blankFl;					// Only whitespace and a comment
+	};
+
+	// A label, its location and the words of its statement.
+	struct Symbol {
+		std::string_view m_name;
+		int m_loc;
+		int m_length;
+	};
+
+	// Splits the source into lines.
+	[[nodiscard]] static constexpr std::vector<Line> SplitSource(std::string_view a_source);
+
+	// The value of an operand of digits, or -1 if it has other characters or ten digits or more.
+	[[nodiscard]] static constexpr int ParseNumber(std::string_view a_operand) noexcept;
+
+	// The value of an operand expression, below a_limit.  With a_addressFl it must be an
+	// address, and with a_constantFl it may only have numbers.
+	[[nodiscard]] static constexpr int EvaluateOperand(std::string_view a_operand, const std::vector<Symbol>& a_symbols,
+		bool a_addressFl, bool a_constantFl, int a_limit, int a_lineNumber);
+
+	// Stops the compilation with the diagnostic of an error code.
+	static constexpr void Fail(Error::ErrorCode a_code, int a_lineNumber) noexcept;
+};
+
+/// <summary>
+/// Splits a source into lines and each line into its elements.
+/// </summary>
+/// <param name="a_source">The source</param>
+/// <returns>The lines</returns>
+constexpr std::vector<StaticAssembler::Line> StaticAssembler::SplitSource(std::string_view a_source)
+{
+	std::vector<Line> lines;
+	int number = 0;
+	while (!a_source.empty()) {
+		const size_t end = std::min(a_source.find('\n'), a_source.size());
+		const std::string_view text = Instruction::RemoveComment(a_source.substr(0, end));
+		a_source.remove_prefix(std::min(end + 1, a_source.size()));
+
+		const bool blankFl = text.find_first_not_of(" \t\n\v\f\r") == std::string_view::npos;
+		lines.push_back({ ++number, blankFl ? Instruction::Elements{} : Instruction::SplitLine(text), blankFl });
+	}
+	return lines;
+}
+
+/// <summary>
+/// Converts an operand of decimal digits.
+/// </summary>
+/// <param name="a_operand">The operand</param>
+/// <returns>The value, or -1 if the operand is not a number of fewer than ten digits</returns>
+constexpr int StaticAssembler::ParseNumber(std::string_view a_operand) noexcept
+{
+	if (a_operand.empty() || a_operand.size() >= 10) {
+		return -1;
+	}
+
+	int value = 0;
+	for (const char c : a_operand) {
+		if (c < '0' || c > '9') {
+			return -1;
+		}
+		value = value * 10 + (c - '0');
+	}
+	return value;
+}
+
+/// <summary>
+/// Evaluates an operand expression with the rules of Assembler::TranslateExpression.
+/// </summary>
+/// <param name="a_operand">The operand</param>
+/// <param name="a_symbols">The labels</param>
+/// <param name="a_addressFl">True if the value must be an address</param>
+/// <param name="a_constantFl">True if the value may only have numbers, as for ORG and DS</param>
+/// <param name="a_limit">The value must be below it</param>
+/// <param name="a_lineNumber">The line of the source, counted from 1</param>
+/// <returns>The value</returns>
+constexpr int StaticAssembler::EvaluateOperand(std::string_view a_operand, const std::vector<Symbol>& a_symbols,
+	bool a_addressFl, bool a_constantFl, int a_limit, int a_lineNumber)
+{
+	const auto lookup = [&a_symbols](std::string_view a_name) -> std::optional<Expression::Symbol> {
+		const auto symbol = std::ranges::find(a_symbols, a_name, &Symbol::m_name);
+		if (symbol == a_symbols.end()) {
+			return std::nullopt;
+		}
+		return Expression::Symbol{ symbol->m_loc, symbol->m_length, false, false };
+	};
+	const Expression::Value value = Expression::Evaluate(a_operand, lookup);
+
+	if (value.m_error) {
+		Fail(*value.m_error, a_lineNumber);
+	}
+	if ((value.m_relocations != 0 && value.m_relocations != 1) || (a_addressFl && value.m_relocations != 1)
+		|| (a_constantFl && value.m_symbolicFl)) {
+		Fail(Error::ErrorCode::ERR_INVALID_OPERAND, a_lineNumber);
+	}
+	if (value.m_value < 0 || value.m_value >= a_limit) {
+		Fail(Error::ErrorCode::ERR_OPERAND_OVERFLOW, a_lineNumber);
+	}
+	return static_cast<int>(value.m_value);
+}
+
+/// <summary>
+/// Reports an error.  The diagnostic functions are not constexpr, so reaching one of them
+/// stops the constant evaluation.
+/// </summary>
+/// <param name="a_code">The error</param>
+/// <param name="a_lineNumber">The line of the source, counted from 1</param>
+constexpr void StaticAssembler::Fail(Error::ErrorCode a_code, int a_lineNumber) noexcept
+{
+	switch (a_code) {
+		case Error::ErrorCode::ERR_INVALID_OPCODE: Diagnostic::InvalidOpcode(a_lineNumber); break;
+		case Error::ErrorCode::ERR_UNDEFINED_LABEL: Diagnostic::UndefinedLabel(a_lineNumber); break;
+		case Error::ErrorCode::ERR_DUPLICATE_LABEL: Diagnostic::DuplicateLabel(a_lineNumber); break;
+		case Error::ErrorCode::ERR_INVALID_LABEL: Diagnostic::InvalidLabel(a_lineNumber); break;
+		case Error::ErrorCode::ERR_SYNTAX_ERROR: Diagnostic::SyntaxError(a_lineNumber); break;
+		case Error::ErrorCode::ERR_EXTRA_ELEMENTS: Diagnostic::ExtraElements(a_lineNumber); break;
+		case Error::ErrorCode::ERR_MISSING_OPERAND: Diagnostic::MissingOperand(a_lineNumber); break;
+		case Error::ErrorCode::ERR_MISSING_END_STATEMENT: Diagnostic::MissingEndStatement(a_lineNumber); break;
+		case Error::ErrorCode::ERR_END_STATEMENT_NOT_LAST: Diagnostic::EndStatementNotLast(a_lineNumber); break;
+		case Error::ErrorCode::ERR_OPERAND_OVERFLOW: Diagnostic::OperandOverflow(a_lineNumber); break;
+		case Error::ErrorCode::ERR_INVALID_OPERAND: Diagnostic::InvalidOperand(a_lineNumber); break;
+		case Error::ErrorCode::ERR_MEMORY_OVERFLOW: Diagnostic::MemoryOverflow(a_lineNumber); break;
+		case Error::ErrorCode::ERR_MACHINE_CODE_AFTER_HALT: Diagnostic::MachineCodeAfterHalt(a_lineNumber); break;
+		case Error::ErrorCode::ERR_ASSEMBLY_CODE_BEFORE_HALT: Diagnostic::AssemblyCodeBeforeHalt(a_lineNumber); break;
+		case Error::ErrorCode::ERR_UNRESOLVED_EXTERNAL: Diagnostic::LinkageDirective(a_lineNumber); break;
+		case Error::ErrorCode::ERR_DIVISION_BY_ZERO: Diagnostic::DivisionByZero(a_lineNumber); break;
+		default: break;
+	}
+}
+
+/// <summary>
+/// Assembles a source into the memory image of the machine.  Pass I finds the locations
+/// of the labels; Pass II translates the lines.  Any error stops the compilation.
+/// </summary>
+/// <param name="a_source">The source, e.g. a raw string literal</param>
+/// <param name="a_extendedFl">True to accept the extended instruction set</param>
+/// <returns>The memory image; execution starts at location 100</returns>
+consteval StaticAssembler::Image StaticAssembler::Assemble(std::string_view a_source, bool a_extendedFl)
+{
+	constexpr MachineConfig config(MachineConfig::ClassicOperandDigits);
+	const std::vector<Line> lines = SplitSource(a_source);
+
+	// Pass I: the locations of the labels
+	std::vector<Symbol> symbols;
+	int loc = 0;
+	size_t endLine = lines.size();
+	for (size_t i = 0; i < lines.size() && endLine == lines.size(); ++i) {
+		const Line& line = lines[i];
+		const Instruction::Elements& elements = line.m_elements;
+		if (line.m_blankFl) {
+			continue;
+		}
+		if (Instruction::MatchesOpCode(elements.m_opCode, "END")) {
+			endLine = i;
+			break;
+		}
+
+		// ORG and DS may take an expression of numbers, e.g. 4*25
+		const long long value = Expression::EvaluateConstant(elements.m_operand);
+		const bool orgFl = value >= 0 && Instruction::MatchesOpCode(elements.m_opCode, "ORG");
+		const bool dsFl = value >= 0 && Instruction::MatchesOpCode(elements.m_opCode, "DS");
+		const int length = orgFl ? 0 : dsFl ? static_cast<int>(value % config.GetMemorySize()) : 1;
+
+		if (!elements.m_label.empty()) {
+			if (elements.m_label.size() > 10) {
+				Fail(Error::ErrorCode::ERR_INVALID_LABEL, line.m_number);
+			}
+			if (std::ranges::find(symbols, elements.m_label, &Symbol::m_name) != symbols.end()) {
+				Fail(Error::ErrorCode::ERR_DUPLICATE_LABEL, line.m_number);
+			}
+			symbols.push_back({ elements.m_label, loc, length });
+		}
+
+		if (orgFl) {
+			loc = static_cast<int>(value % config.GetMemorySize());
+		}
+		else {
+			loc = (loc + length) % config.GetMemorySize();
+		}
+	}
+	if (endLine == lines.size()) {
+		Fail(Error::ErrorCode::ERR_MISSING_END_STATEMENT, static_cast<int>(lines.size()));
+	}
+
+	// Pass II: the translation
+	Image image{};
+	loc = 0;
+	bool haltFl = false;
+	for (size_t i = 0; i < endLine; ++i) {
+		const Line& line = lines[i];
+		const Instruction::Elements& elements = line.m_elements;
+		if (line.m_blankFl) {
+			continue;
+		}
+		if (!elements.m_extra.empty()) {
+			Fail(Error::ErrorCode::ERR_EXTRA_ELEMENTS, line.m_number);
+		}
+
+		const int opCode = Instruction::LookupOpCode(elements.m_opCode, a_extendedFl);
+		int value = ParseNumber(elements.m_operand);
+		const bool numericFl = !elements.m_operand.empty() && elements.m_operand.find_first_not_of("0123456789") == std::string_view::npos;
+		if (opCode == 13) {
+			// HALT
+			if (haltFl) {
+				Fail(Error::ErrorCode::ERR_MACHINE_CODE_AFTER_HALT, line.m_number);
+			}
+			if (!elements.m_operand.empty()) {
+				Fail(Error::ErrorCode::ERR_EXTRA_ELEMENTS, line.m_number);
+			}
+			image[loc] = config.MakeWord(opCode, 0);
+			haltFl = true;
+		}
+		else if (opCode > 0) {
+			if (haltFl) {
+				Fail(Error::ErrorCode::ERR_MACHINE_CODE_AFTER_HALT, line.m_number);
+			}
+			if (elements.m_operand.empty()) {
+				Fail(Error::ErrorCode::ERR_MISSING_OPERAND, line.m_number);
+			}
+
+			// The operand of an immediate instruction may be a number; any other operand is a label
+			int operand = 0;
+			if (a_extendedFl && Instruction::IsImmediateOpCode(elements.m_opCode) && numericFl) {
+				if (value < 0 || value >= config.GetMemorySize()) {
+					Fail(Error::ErrorCode::ERR_OPERAND_OVERFLOW, line.m_number);
+				}
+				operand = value;
+			}
+			else if (Expression::IsExpression(elements.m_operand)) {
+				operand = EvaluateOperand(elements.m_operand, symbols, !(a_extendedFl && Instruction::IsImmediateOpCode(elements.m_opCode)),
+					false, config.GetMemorySize(), line.m_number);
+			}
+			else {
+				const char first = elements.m_operand[0];
+				if (!((first >= 'A' && first <= 'Z') || (first >= 'a' && first <= 'z'))) {
+					Fail(Error::ErrorCode::ERR_SYNTAX_ERROR, line.m_number);
+				}
+				if (elements.m_operand.size() > 10) {
+					Fail(Error::ErrorCode::ERR_INVALID_OPERAND, line.m_number);
+				}
+				const auto symbol = std::ranges::find(symbols, elements.m_operand, &Symbol::m_name);
+				if (symbol == symbols.end()) {
+					Fail(Error::ErrorCode::ERR_UNDEFINED_LABEL, line.m_number);
+				}
+				operand = symbol->m_loc;
+			}
+			if (operand == 0 && Instruction::MatchesOpCode(elements.m_opCode, "DIVI") && Expression::EvaluateConstant(elements.m_operand) == 0) {
+				Fail(Error::ErrorCode::ERR_DIVISION_BY_ZERO, line.m_number);
+			}
+			image[loc] = config.MakeWord(opCode, operand);
+		}
+		else if (Instruction::IsAssemblyOpCode(elements.m_opCode)) {
+			if (Instruction::MatchesOpCode(elements.m_opCode, "ENTRY") || Instruction::MatchesOpCode(elements.m_opCode, "EXTRN")) {
+				Fail(Error::ErrorCode::ERR_UNRESOLVED_EXTERNAL, line.m_number);
+			}
+			if (!haltFl && !Instruction::MatchesOpCode(elements.m_opCode, "ORG")) {
+				Fail(Error::ErrorCode::ERR_ASSEMBLY_CODE_BEFORE_HALT, line.m_number);
+			}
+			if (elements.m_operand.empty()) {
+				Fail(Error::ErrorCode::ERR_MISSING_OPERAND, line.m_number);
+			}
+
+			// DC may hold an address; ORG and DS were needed in Pass I, before the labels were known
+			if (Expression::IsExpression(elements.m_operand)) {
+				value = EvaluateOperand(elements.m_operand, symbols, false, !Instruction::MatchesOpCode(elements.m_opCode, "DC"),
+					config.GetWordLimit(), line.m_number);
+			}
+			else if (!numericFl) {
+				Fail(Error::ErrorCode::ERR_SYNTAX_ERROR, line.m_number);
+			}
+			if (value < 0 || value >= config.GetWordLimit()) {
+				Fail(Error::ErrorCode::ERR_OPERAND_OVERFLOW, line.m_number);
+			}
+
+			if (Instruction::MatchesOpCode(elements.m_opCode, "ORG")) {
+				loc = config.GetOperand(value);
+				continue;
+			}
+			if (Instruction::MatchesOpCode(elements.m_opCode, "DS")) {
+				if (loc + config.GetOperand(value) >= config.GetMemorySize()) {
+					Fail(Error::ErrorCode::ERR_MEMORY_OVERFLOW, line.m_number);
+				}
+				loc += config.GetOperand(value);
+				continue;
+			}
+			image[loc] = value;
+		}
+		else {
+			Fail(Error::ErrorCode::ERR_INVALID_OPCODE, line.m_number);
+		}
+
+		if (++loc >= config.GetMemorySize()) {
+			Fail(Error::ErrorCode::ERR_MEMORY_OVERFLOW, line.m_number);
+		}
+	}
+
+	// END takes no operand and is the last line
+	if (!lines[endLine].m_elements.m_operand.empty()) {
+		Fail(Error::ErrorCode::ERR_EXTRA_ELEMENTS, lines[endLine].m_number);
+	}
+	if (endLine + 1 < lines.size()) {
+		Fail(Error::ErrorCode::ERR_END_STATEMENT_NOT_LAST, lines[endLine + 1].m_number);
+	}
+
+	return image;
+}
@@ -1,39 +1,104 @@
 #include "SymbolTable.h"
 #include "stdafx.h"
+#include "Metrics.h"
+#include "Probes.h"
+#include <iterator>
+
+/// <summary>
+/// Constructor for the symbol table.
+/// </summary>
+/// <param name="a_resource">The memory resource the symbols are allocated from</param>
+SymbolTable::SymbolTable(std::pmr::memory_resource* a_resource)
+	: m_symbolTable(a_resource)
+{
+}
 
 /// <summary>
 /// Adds a symbol to the symbol table
 /// </summary>
 /// <param name="a_symbol">The symbol to be added</param>
 /// <param name="a_loc">The location of the symbol</param>
-void SymbolTable::AddSymbol(const std::string& a_symbol, int a_loc)
+/// <param name="a_length">The words of the statement the symbol labels</param>
+void SymbolTable::AddSymbol(const std::string& a_symbol, int a_loc, int a_length)
 {
+	Metrics::ScopedTimer timer(Metrics::Phase::SYMBOL_TABLE);
+	Metrics::Count(Metrics::Counter::SYMBOLS_INSERTED);
+	VC370_PROBE2(symbol__add, a_symbol.c_str(), a_loc);
+
 	// If the symbol is already in the symbol table, record it as multiply defined.
-	if (auto result = m_symbolTable.find(a_symbol); result != m_symbolTable.end()) {
-		result->second = multiplyDefinedSymbol;
+	if (auto result = m_symbolTable.find(std::string_view(a_symbol)); result != m_symbolTable.end()) {
+		result->second.m_loc = multiplyDefinedSymbol;
 		return;
 	}
 
 	// Record a the location in the symbol table.
-	m_symbolTable[a_symbol] = a_loc;
+	m_symbolTable.emplace(a_symbol, Symbol{ a_loc, a_length, SymbolKind::SYM_LOCAL });
+}
+
+/// <summary>
+/// Adds a symbol that is declared with EXTRN. Its location is not known
+/// until the module is linked, so it is recorded with location 0.
+/// </summary>
+/// <param name="a_symbol">The external symbol</param>
+void SymbolTable::AddExternalSymbol(const std::string& a_symbol)
+{
+	Metrics::ScopedTimer timer(Metrics::Phase::SYMBOL_TABLE);
+	Metrics::Count(Metrics::Counter::SYMBOLS_INSERTED);
+
+	// A symbol cannot be both defined in this module and imported from another one.
+	if (auto result = m_symbolTable.find(std::string_view(a_symbol)); result != m_symbolTable.end()) {
+		result->second.m_loc = multiplyDefinedSymbol;
+		return;
+	}
+
+	m_symbolTable.emplace(a_symbol, Symbol{ 0, 0, SymbolKind::SYM_EXTERNAL });
+}
+
+/// <summary>
+/// Marks a symbol defined in this module as exported (ENTRY)
+/// </summary>
+/// <param name="a_symbol">The symbol to be exported</param>
+/// <returns>True if the symbol is defined in this module, false otherwise</returns>
+bool SymbolTable::ExportSymbol(std::string_view a_symbol)
+{
+	auto it = m_symbolTable.find(a_symbol);
+	if (it == m_symbolTable.end() || it->second.m_kind == SymbolKind::SYM_EXTERNAL) {
+		return false;
+	}
+
+	it->second.m_kind = SymbolKind::SYM_EXPORTED;
+	return true;
 }
 
 /// <summary>
 /// Displays the symbol table
 /// </summary>
-void SymbolTable::DisplaySymbolTable() const
+/// <param name="a_out">The stream the table is written to</param>
+/// <param name="a_pauseFl">True to pause after the table</param>
+void SymbolTable::DisplaySymbolTable(std::ostream& a_out, bool a_pauseFl) const
 {
-	std::cout << "Symbol Table:\n";
-	std::cout << "Symbol #    Symbol    Location\n";
+	a_out << "Symbol Table:\n";
+	a_out << "Symbol #    Symbol    Location\n";
 	int i = 0;
 
-	for (const auto& [symbol, location] : m_symbolTable) {
-		std::cout << std::format(" {:<12}{:<10}{:<10}\n", i++, symbol, location);
+	for (const auto& [symbol, entry] : m_symbolTable) {
+		std::format_to(std::ostreambuf_iterator<char>(a_out), " {:<12}{:<10}{:<10}", i++, std::string_view(symbol), entry.m_loc);
+
+		// Only the linkage of non-local symbols is shown so that plain programs list as before
+		if (entry.m_kind == SymbolKind::SYM_EXPORTED) {
+			a_out << "ENTRY";
+		}
+		else if (entry.m_kind == SymbolKind::SYM_EXTERNAL) {
+			a_out << "EXTRN";
+		}
+		a_out << '\n';
 	}
 
-	std::cout << "____________________________________________\n\n";
-	system("pause");
-	std::cout << '\n';
+	a_out << "____________________________________________\n\n";
+	if (a_pauseFl) {
+		system("pause");
+	}
+	a_out << '\n';
 }
 
 /// <summary>
@@ -43,9 +108,11 @@ void SymbolTable::DisplaySymbolTable() const
 /// <returns>True if the symbol is found and not multiply defined, false otherwise</returns>
 bool SymbolTable::LookupSymbol(std::string_view a_symbol) const
 {
-	const std::string symbolStr{a_symbol};
-	if (auto it = m_symbolTable.find(symbolStr); it != m_symbolTable.end()) {
-		return it->second != multiplyDefinedSymbol;
+	Metrics::ScopedTimer timer(Metrics::Phase::SYMBOL_TABLE);
+	Metrics::Count(Metrics::Counter::SYMBOL_LOOKUPS);
+
+	if (auto it = m_symbolTable.find(a_symbol); it != m_symbolTable.end()) {
+		return it->second.m_loc != multiplyDefinedSymbol;
 	}
 	return false;
 }
@@ -57,9 +124,72 @@ bool SymbolTable::LookupSymbol(std::string_view a_symbol) const
 /// <returns>The location of the symbol if it exists, 0 otherwise</returns>
 int SymbolTable::GetSymbolLocation(std::string_view a_symbol) const
 {
-	const std::string symbolStr{a_symbol};
-	if (auto it = m_symbolTable.find(symbolStr); it != m_symbolTable.end()) {
-		return it->second;
+	Metrics::ScopedTimer timer(Metrics::Phase::SYMBOL_TABLE);
+	Metrics::Count(Metrics::Counter::SYMBOL_LOOKUPS);
+
+	if (auto it = m_symbolTable.find(a_symbol); it != m_symbolTable.end()) {
+		return it->second.m_loc;
 	}
 	return 0;
 }
+
+/// <summary>
+/// Finds the entry of a symbol in the symbol table
+/// </summary>
+/// <param name="a_symbol">The symbol to be looked up</param>
+/// <returns>The entry of the symbol, or nullptr if it is not in the table</returns>
+const SymbolTable::Symbol* SymbolTable::FindSymbol(std::string_view a_symbol) const
+{
+	Metrics::ScopedTimer timer(Metrics::Phase::SYMBOL_TABLE);
+	Metrics::Count(Metrics::Counter::SYMBOL_LOOKUPS);
+
+	if (auto it = m_symbolTable.find(a_symbol); it != m_symbolTable.end()) {
+		return &it->second;
+	}
+	return nullptr;
+}
+
+/// <summary>
+/// Checks if a symbol was declared with EXTRN
+/// </summary>
+/// <param name="a_symbol">The symbol to be looked up</param>
+/// <returns>True if the symbol is external and not multiply defined, false otherwise</returns>
+bool SymbolTable::IsExternalSymbol(std::string_view a_symbol) const
+{
+	Metrics::ScopedTimer timer(Metrics::Phase::SYMBOL_TABLE);
+	Metrics::Count(Metrics::Counter::SYMBOL_LOOKUPS);
+
+	if (auto it = m_symbolTable.find(a_symbol); it != m_symbolTable.end()) {
+		return it->second.m_kind == SymbolKind::SYM_EXTERNAL && it->second.m_loc != multiplyDefinedSymbol;
+	}
+	return false;
+}
+
+/// <summary>
+/// Collects the symbols exported with ENTRY
+/// </summary>
+/// <returns>The exported symbols together with their locations</returns>
+std::vector<std::pair<std::string, int>> SymbolTable::GetExportedSymbols() const
+{
+	std::vector<std::pair<std::string, int>> exports;
+	for (const auto& [symbol, entry] : m_symbolTable) {
+		if (entry.m_kind == SymbolKind::SYM_EXPORTED && entry.m_loc != multiplyDefinedSymbol) {
+			exports.emplace_back(std::string(symbol), entry.m_loc);
+		}
+	}
+	return exports;
+}
+
+/// <summary>
+/// Returns all the symbols, e.g. for a program that embeds the assembler.
+/// </summary>
+/// <returns>The symbols in the order of DisplaySymbolTable</returns>
+std::vector<SymbolTable::Entry> SymbolTable::GetSymbols() const
+{
+	std::vector<Entry> symbols;
+	symbols.reserve(m_symbolTable.size());
+	for (const auto& [symbol, entry] : m_symbolTable) {
+		symbols.push_back({ std::string(symbol), entry.m_loc, entry.m_kind });
+	}
+	return symbols;
+}
@@ -5,21 +5,36 @@
 #include "stdafx.h"
 #include <unordered_map>
 #include <string_view>
+#include <memory_resource>
 
 // This class is our symbol table.
 class SymbolTable {
 
 public:
-    SymbolTable() = default;
+    // The symbols are allocated from a_resource, e.g. the arena of an assembly.
+    explicit SymbolTable(std::pmr::memory_resource* a_resource = std::pmr::get_default_resource());
     ~SymbolTable() = default;
 
     static constexpr int multiplyDefinedSymbol = -999;
 
-    // Add a new symbol to the symbol table.
-    void AddSymbol(const std::string& a_symbol, int a_loc);
+    // The linkage of a symbol: local to the module, exported with ENTRY or imported with EXTRN.
+    enum class SymbolKind {
+        SYM_LOCAL,
+        SYM_EXPORTED,
+        SYM_EXTERNAL
+    };
+
+    // Add a new symbol to the symbol table; a_length is the words of the statement it labels.
+    void AddSymbol(const std::string& a_symbol, int a_loc, int a_length = 1);
+
+    // Add a symbol that is defined in another module.
+    void AddExternalSymbol(const std::string& a_symbol);
+
+    // Mark a symbol defined in this module as visible to other modules.
+    bool ExportSymbol(std::string_view a_symbol);
 
     // Display the symbol table.
-    void DisplaySymbolTable() const;
+    void DisplaySymbolTable(std::ostream& a_out = std::cout, bool a_pauseFl = true) const;
 
     // Lookup a symbol in the symbol table.
     [[nodiscard]] bool LookupSymbol(std::string_view a_symbol) const;
@@ -27,10 +42,45 @@ public:
     // Get location of symbol in the symbol table.
     [[nodiscard]] int GetSymbolLocation(std::string_view a_symbol) const;
 
+    // Returns true if the symbol was declared with EXTRN.
+    [[nodiscard]] bool IsExternalSymbol(std::string_view a_symbol) const;
+
+    // An entry of the symbol table.
+    struct Symbol {
+        int m_loc;
+        int m_length;       // The words of the statement it labels, for LEN in operand expressions
+        SymbolKind m_kind;
+    };
+
+    // Returns the entry of a symbol, or null if it is not in the table.
+    [[nodiscard]] const Symbol* FindSymbol(std::string_view a_symbol) const;
+
+    // Returns the exported symbols and their locations.
+    [[nodiscard]] std::vector<std::pair<std::string, int>> GetExportedSymbols() const;
+
+    // A symbol, its location (multiplyDefinedSymbol if it is defined more than once) and its linkage.
+    struct Entry {
+        std::string m_symbol;
+        int m_loc;
+        SymbolKind m_kind;
+    };
+
+    // Returns the symbols in the order they are displayed.
+    [[nodiscard]] std::vector<Entry> GetSymbols() const;
+
+    // Removes all the symbols and gives back the buckets, so the memory resource can be released.
+    void Clear() noexcept { m_symbolTable = decltype(m_symbolTable)(m_symbolTable.get_allocator()); }
+
 private:
 
+    // Hashes std::string_view and std::pmr::string alike, so that a lookup does not copy the symbol.
+    struct SymbolHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view a_symbol) const noexcept { return std::hash<std::string_view>{}(a_symbol); }
+    };
+
     // This is the actual symbol table.  The symbol is the key to the map.
     // Using unordered_map for O(1) average lookup
-    std::unordered_map<std::string, int> m_symbolTable;
+    std::pmr::unordered_map<std::pmr::string, Symbol, SymbolHash, std::equal_to<>> m_symbolTable;
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,88 @@
+//
+//		WorkStealingDeque class - the lock-free task queue of one worker of a work-stealing pool.
+//
+#pragma once
+
+#include "stdafx.h"
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+// The Chase-Lev deque: the worker that owns it pushes and pops tasks at the bottom, most
+// recent first, so a task it has just made runnable runs next while its data is still in
+// the cache.  Other workers with nothing to do steal the oldest task from the top.  Owner
+// and thieves only meet over the last task, which they settle with a compare-and-swap on m_top.
+//
+// The pool never has more tasks than it was started with, and a task is in at most one
+// deque at a time, so the ring has a fixed size and is never grown.
+template <typename T>
+class WorkStealingDeque {
+
+public:
+	// A deque for at most a_capacity tasks.
+	explicit WorkStealingDeque(size_t a_capacity) : m_slots(std::bit_ceil(std::max<size_t>(a_capacity, 1))), m_mask(m_slots.size() - 1) { }
+	~WorkStealingDeque() = default;
+
+	// Prevent copying
+	WorkStealingDeque(const WorkStealingDeque&) = delete;
+	WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+	// Owner: adds a task at the bottom.
+	void Push(T* a_task) noexcept
+	{
+		const std::int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+		m_slots[static_cast<size_t>(bottom) & m_mask].store(a_task, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	// Owner: takes the most recent task, or null if there is none.
+	[[nodiscard]] T* Pop() noexcept
+	{
+		const std::int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		std::int64_t top = m_top.load(std::memory_order_relaxed);
+
+		T* task = nullptr;
+		if (top <= bottom) {
+			task = m_slots[static_cast<size_t>(bottom) & m_mask].load(std::memory_order_relaxed);
+			if (top == bottom) {
+				// The last task; a thief may be taking it
+				if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					task = nullptr;
+				}
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+		}
+		else {
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return task;
+	}
+
+	// Any worker: takes the oldest task, or null if there is none or another worker got it first.
+	[[nodiscard]] T* Steal() noexcept
+	{
+		std::int64_t top = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const std::int64_t bottom = m_bottom.load(std::memory_order_acquire);
+		if (top >= bottom) {
+			return nullptr;
+		}
+
+		T* task = m_slots[static_cast<size_t>(top) & m_mask].load(std::memory_order_relaxed);
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr;
+		}
+		return task;
+	}
+
+private:
+	std::vector<std::atomic<T*>> m_slots;
+	size_t m_mask;
+
+	// Thieves take from m_top, the owner pushes and pops at m_bottom
+	alignas(64) std::atomic<std::int64_t> m_top{ 0 };
+	alignas(64) std::atomic<std::int64_t> m_bottom{ 0 };
+};
@@ -1,7 +1,5 @@
 #pragma once
 
-#define WIN32_LEAN_AND_MEAN		// Exclude rarely-used stuff from Windows headers
-
 // C++ Standard Library headers
 #include <iostream>
 #include <string>
@@ -20,6 +18,9 @@
 #include <cstdio>
 
 // Windows headers
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN		// Exclude rarely-used stuff from Windows headers
 #include <windows.h>
+#endif
 
 using namespace std;
\ No newline at end of file